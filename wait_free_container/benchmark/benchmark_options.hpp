@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//--key value command line of the benchmarks, every option has a default so any of them can be left out
+//integer options take positive numbers unless given a lower minimum, real ones always name theirs, an unknown key,
+//a missing value or a bad number fails the parse
+class benchmark_options
+{
+public:
+	explicit benchmark_options(const char* usage) :
+		m_usage(usage)
+	{
+	}
+
+	void add(const char* key, int64_t& value, int64_t minimum = 1)
+	{
+		this->m_options.push_back({ key, &value, nullptr, nullptr, minimum, 0.0 });
+	}
+
+	void add(const char* key, double& value, double minimum)
+	{
+		this->m_options.push_back({ key, nullptr, nullptr, &value, 0, minimum });
+	}
+
+	void add(const char* key, std::string& value)
+	{
+		this->m_options.push_back({ key, nullptr, &value, nullptr, 0, 0.0 });
+	}
+
+	//-1 to go on with the run, otherwise what main returns: 0 after --help, 1 for a bad command line
+	int parse(int argc, char* argv[]) const
+	{
+		for (int i = 1; i < argc; i += 2)
+		{
+			std::string key = argv[i];
+			if (key == "--help" || key == "-h")
+			{
+				std::cout << this->m_usage << std::endl;
+				return 0;
+			}
+
+			const option* o = find(key);
+			if (o == nullptr)
+			{
+				std::cerr << "unknown option " << key << std::endl << this->m_usage << std::endl;
+				return 1;
+			}
+
+			if (i + 1 >= argc)
+			{
+				std::cerr << "missing value for " << key << std::endl;
+				return 1;
+			}
+
+			const char* value = argv[i + 1];
+			if (o->text != nullptr)
+			{
+				*o->text = value;
+				continue;
+			}
+
+			char* end(nullptr);
+			if (o->real != nullptr)
+			{
+				double real = std::strtod(value, &end);
+				if (end == value || *end != '\0' || !(real >= o->real_minimum))
+				{
+					std::cerr << key << " takes a number of at least " << o->real_minimum << ", got " << value << std::endl;
+					return 1;
+				}
+
+				*o->real = real;
+				continue;
+			}
+
+			long long number = std::strtoll(value, &end, 10);
+			if (end == value || *end != '\0' || number < o->minimum)
+			{
+				std::cerr << key << " takes an integer of at least " << o->minimum << ", got " << value << std::endl;
+				return 1;
+			}
+
+			*o->number = static_cast<int64_t>(number);
+		}
+
+		return -1;
+	}
+
+private:
+	struct option
+	{
+		std::string		key;
+		int64_t*		number;
+		std::string*	text;
+		double*			real;
+		int64_t			minimum;
+		double			real_minimum;
+	};
+
+	const char*				m_usage;
+	std::vector<option>		m_options;
+
+	const option* find(const std::string& key) const
+	{
+		for (auto& o : this->m_options)
+		{
+			if (o.key == key)
+			{
+				return &o;
+			}
+		}
+
+		return nullptr;
+	}
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+//mutex guarded std containers, the baselines the benchmarks measure the wait free containers against
+
+template<typename T>
+class locked_deque
+{
+public:
+	void enqueue(const T& value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_data.push_back(value);
+	}
+
+	template<typename TIterator>
+	void enqueue_range(TIterator it_start, const TIterator& it_end)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_data.insert(this->m_data.end(), it_start, it_end);
+	}
+
+	int64_t dequeue_range(T* out, int64_t count)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		count = (std::min)(count, static_cast<int64_t>(this->m_data.size()));
+		std::copy(this->m_data.begin(), this->m_data.begin() + count, out);
+		this->m_data.erase(this->m_data.begin(), this->m_data.begin() + count);
+
+		return count;
+	}
+
+private:
+	std::mutex		m_mutex;
+	std::deque<T>	m_data;
+};
+
+template<typename T>
+class locked_vector
+{
+public:
+	void push_back(const T& value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_data.push_back(value);
+	}
+
+	bool get(int64_t index, T& elem)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		if (index >= static_cast<int64_t>(this->m_data.size()))
+		{
+			return false;
+		}
+
+		elem = this->m_data[index];
+		return true;
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		return this->m_data.size();
+	}
+
+private:
+	std::mutex		m_mutex;
+	std::vector<T>	m_data;
+};
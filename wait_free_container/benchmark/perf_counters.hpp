@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//hardware counters for the benchmark harness over perf_event_open
+//counters are opened with inherit, so construct perf_counters before spawning the threads to measure;
+//inherited counts are folded into the parent when those threads exit, read after joining them
+//counters the kernel/pmu refuses (containers, vms, perf_event_paranoid) are reported unavailable, never fail the run
+
+enum class perf_counter : int32_t
+{
+	cycles = 0,
+	instructions,
+	l1d_misses,
+	llc_misses,
+	branch_misses,
+	count
+};
+
+struct perf_counter_values
+{
+	static const int32_t COUNT = static_cast<int32_t>(perf_counter::count);
+
+	bool		valid[COUNT] = {};
+	double		values[COUNT] = {};
+
+	bool available(perf_counter counter) const noexcept
+	{
+		return this->valid[static_cast<int32_t>(counter)];
+	}
+
+	double operator[](perf_counter counter) const noexcept
+	{
+		return this->values[static_cast<int32_t>(counter)];
+	}
+};
+
+class perf_counters
+{
+	static const int32_t COUNT = perf_counter_values::COUNT;
+
+public:
+	static const char* name(perf_counter counter) noexcept
+	{
+		static const char* names[COUNT] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+		return names[static_cast<int32_t>(counter)];
+	}
+
+	perf_counters()
+	{
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			this->m_fds[i] = open_counter(static_cast<perf_counter>(i));
+		}
+	}
+
+	~perf_counters()
+	{
+#if defined(__linux__)
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			if (this->m_fds[i] != -1)
+			{
+				::close(this->m_fds[i]);
+			}
+		}
+#endif
+	}
+
+	perf_counters(const perf_counters&) = delete;
+	perf_counters& operator=(const perf_counters&) = delete;
+
+	bool available() const noexcept
+	{
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			if (this->m_fds[i] != -1)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	//why the first counter failed to open, empty when everything opened
+	const std::string& error() const noexcept
+	{
+		return this->m_error;
+	}
+
+	void start() noexcept
+	{
+#if defined(__linux__)
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			if (this->m_fds[i] != -1)
+			{
+				::ioctl(this->m_fds[i], PERF_EVENT_IOC_RESET, 0);
+				::ioctl(this->m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	//values are scaled up when the pmu multiplexed the counters
+	perf_counter_values stop() noexcept
+	{
+		perf_counter_values ret;
+
+#if defined(__linux__)
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			if (this->m_fds[i] != -1)
+			{
+				::ioctl(this->m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+
+		for (int32_t i = 0; i < COUNT; i++)
+		{
+			//value, time_enabled, time_running
+			uint64_t data[3] = {};
+			if (this->m_fds[i] == -1 || ::read(this->m_fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0)
+			{
+				continue;
+			}
+
+			ret.valid[i] = true;
+			ret.values[i] = static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+		}
+#endif
+
+		return ret;
+	}
+
+private:
+	int				m_fds[COUNT];
+	std::string		m_error;
+
+	int open_counter(perf_counter counter)
+	{
+#if defined(__linux__)
+		perf_event_attr attr;
+		::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		switch (counter)
+		{
+		case perf_counter::cycles:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+
+		case perf_counter::instructions:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+
+		case perf_counter::l1d_misses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			break;
+
+		case perf_counter::llc_misses:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			break;
+
+		case perf_counter::branch_misses:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+
+		default:
+			return -1;
+		}
+
+		int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fd == -1 && this->m_error.empty())
+		{
+			this->m_error = std::string(name(counter)) + ": " + ::strerror(errno);
+		}
+
+		return fd;
+#else
+		(void)counter;
+		if (this->m_error.empty())
+		{
+			this->m_error = "perf_event_open is linux only";
+		}
+
+		return -1;
+#endif
+	}
+};
@@ -0,0 +1,207 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "thread_pool.hpp"
+#include "wait_free_generic_queue.hpp"
+
+//submit latency and tiny task throughput of thread_pool, against the usual hand written worker loop
+//spinning on wait_free_generic_queue::dequeue with yield()
+//usage: thread_pool_benchmark [--tasks 1000000] [--latency-samples 10000]
+
+using clock_type = std::chrono::steady_clock;
+
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+static void print_latency(const char* name, std::vector<int64_t>& samples)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+
+	std::cout << name << " submit latency ns: p50 " << percentile(0.5)
+		<< " p99 " << percentile(0.99)
+		<< " p999 " << percentile(0.999)
+		<< " max " << samples.back() << std::endl;
+}
+
+static void print_throughput(const char* name, int64_t count, clock_type::duration elapsed)
+{
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	std::cout << name << " throughput: " << static_cast<int64_t>(count / seconds) << " tasks/s" << std::endl;
+}
+
+//the per-service loop the pool replaces
+class spinning_executor
+{
+public:
+	using task = void(*)(std::atomic<int64_t>*);
+
+	struct item
+	{
+		task					func;
+		std::atomic<int64_t>*	arg;
+	};
+
+	explicit spinning_executor(int64_t worker_count) :
+		m_queue(1024),
+		m_stop(false)
+	{
+		for (int64_t i = 0; i < worker_count; i++)
+		{
+			this->m_workers.emplace_back([this]()
+			{
+				item it{};
+				while (!this->m_stop || this->m_queue.size() > 0)
+				{
+					if (this->m_queue.dequeue(it) != -1)
+					{
+						it.func(it.arg);
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+	}
+
+	~spinning_executor()
+	{
+		this->m_stop = true;
+		for (auto& worker : this->m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	void post(task func, std::atomic<int64_t>* arg)
+	{
+		this->m_queue.enqueue({ func, arg });
+	}
+
+private:
+	wait_free_generic_queue<item>	m_queue;
+	std::vector<std::thread>		m_workers;
+	std::atomic<bool>				m_stop;
+};
+
+static void increase(std::atomic<int64_t>* counter)
+{
+	counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+static void wait_for(std::atomic<int64_t>& counter, int64_t target)
+{
+	while (counter.load(std::memory_order_acquire) < target)
+	{
+		std::this_thread::yield();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t worker_count = (std::max)(static_cast<int64_t>(std::thread::hardware_concurrency()), static_cast<int64_t>(2));
+	int64_t task_count = 1000000;
+	int64_t latency_samples = 10000;
+	int64_t batch_size = 256;
+
+	benchmark_options options("usage: thread_pool_benchmark [--tasks 1000000] [--latency-samples 10000]");
+	options.add("--tasks", task_count);
+	options.add("--latency-samples", latency_samples);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "workers: " << worker_count << std::endl;
+
+	{
+		thread_pool pool(worker_count);
+		std::vector<int64_t> samples;
+		samples.reserve(latency_samples);
+
+		//one task in flight at a time, measured from submit to start of execution, so parked workers are included
+		for (int64_t i = 0; i < latency_samples; i++)
+		{
+			int64_t submit_ns = now_ns();
+			samples.push_back(pool.submit([=]() { return now_ns() - submit_ns; }).get());
+		}
+
+		print_latency("thread_pool", samples);
+	}
+
+	{
+		std::atomic<int64_t> counter(0);
+		thread_pool pool(worker_count);
+
+		auto start = clock_type::now();
+		for (int64_t i = 0; i < task_count; i++)
+		{
+			pool.post([&counter]() { increase(&counter); });
+		}
+		wait_for(counter, task_count);
+
+		print_throughput("thread_pool post", task_count, clock_type::now() - start);
+	}
+
+	{
+		std::atomic<int64_t> counter(0);
+		thread_pool pool(worker_count);
+
+		auto func = [&counter]() { increase(&counter); };
+		std::vector<decltype(func)> batch(batch_size, func);
+
+		auto start = clock_type::now();
+		for (int64_t i = 0; i < task_count; i += batch_size)
+		{
+			pool.post_range(batch.begin(), batch.end());
+		}
+		wait_for(counter, (task_count + batch_size - 1) / batch_size * batch_size);
+
+		print_throughput("thread_pool post_range", task_count, clock_type::now() - start);
+	}
+
+	{
+		std::atomic<int64_t> counter(0);
+		thread_pool pool(worker_count);
+
+		//fan out from inside the pool so tasks land in the worker deques and are stolen
+		auto start = clock_type::now();
+		pool.post([&]()
+		{
+			for (int64_t i = 0; i < task_count; i++)
+			{
+				pool.post([&counter]() { increase(&counter); });
+			}
+		});
+		wait_for(counter, task_count);
+
+		print_throughput("thread_pool nested post", task_count, clock_type::now() - start);
+	}
+
+	{
+		std::atomic<int64_t> counter(0);
+		spinning_executor executor(worker_count);
+
+		auto start = clock_type::now();
+		for (int64_t i = 0; i < task_count; i++)
+		{
+			executor.post(increase, &counter);
+		}
+		wait_for(counter, task_count);
+
+		print_throughput("spinning generic_queue", task_count, clock_type::now() - start);
+	}
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_async_queue.hpp"
+
+//ping-pong latency between two coroutines started on different threads
+//direct: the waiter is resumed inline by the thread that made progress
+//home thread: the waiter is posted back to the run loop of the thread it started on
+//usage: wait_free_async_queue_benchmark [--round-trips 200000]
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+using clock_type = std::chrono::steady_clock;
+
+class run_loop
+{
+public:
+	run_loop() :
+		m_inbox(nullptr, 64)
+	{
+	}
+
+	void post(std::coroutine_handle<> handle)
+	{
+		this->m_inbox.enqueue(handle.address());
+	}
+
+	//spins, never blocks the thread
+	void run(const std::atomic<bool>& running)
+	{
+		void* address(nullptr);
+		while (running)
+		{
+			if (this->m_inbox.dequeue(address) != -1)
+			{
+				std::coroutine_handle<>::from_address(address).resume();
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+private:
+	wait_free_queue<void*> m_inbox;
+};
+
+struct ping_task
+{
+	struct promise_type
+	{
+		run_loop* home{ nullptr };
+
+		ping_task get_return_object()
+		{
+			return ping_task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+static ping_task ping(wait_free_async_queue<int64_t>& out, wait_free_async_queue<int64_t>& in, int64_t round_trips,
+	std::vector<int64_t>& samples, std::atomic<int64_t>& finished)
+{
+	for (int64_t i = 0; i < round_trips; i++)
+	{
+		auto start = clock_type::now();
+		co_await out.async_enqueue(i);
+		int64_t value = co_await in.async_dequeue();
+		samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+		if (value != i)
+		{
+			std::terminate();
+		}
+	}
+
+	finished++;
+}
+
+static ping_task pong(wait_free_async_queue<int64_t>& in, wait_free_async_queue<int64_t>& out, int64_t round_trips,
+	std::atomic<int64_t>& finished)
+{
+	for (int64_t i = 0; i < round_trips; i++)
+	{
+		int64_t value = co_await in.async_dequeue();
+		co_await out.async_enqueue(value);
+	}
+
+	finished++;
+}
+
+static void report(const char* name, std::vector<int64_t>& samples)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+
+	std::cout << name << " round trip ns: p50 " << percentile(0.5)
+		<< " p99 " << percentile(0.99)
+		<< " p999 " << percentile(0.999)
+		<< " max " << samples.back() << std::endl;
+}
+
+static void run_ping_pong(const char* name, int64_t round_trips, bool home_thread)
+{
+	run_loop loops[2];
+	auto resume_home = [](std::coroutine_handle<> handle)
+	{
+		auto typed = std::coroutine_handle<ping_task::promise_type>::from_address(handle.address());
+		typed.promise().home->post(handle);
+	};
+
+	using resumer = wait_free_async_queue<int64_t>::resumer;
+	wait_free_async_queue<int64_t> ping_queue(16, 1, home_thread ? resumer(resume_home) : resumer());
+	wait_free_async_queue<int64_t> pong_queue(16, 1, home_thread ? resumer(resume_home) : resumer());
+
+	std::vector<int64_t> samples;
+	samples.reserve(round_trips);
+	std::atomic<int64_t> finished(0);
+	std::atomic<bool> running(true);
+
+	ping_task a = ping(ping_queue, pong_queue, round_trips, samples, finished);
+	ping_task b = pong(ping_queue, pong_queue, round_trips, finished);
+	a.handle.promise().home = &loops[0];
+	b.handle.promise().home = &loops[1];
+
+	loops[1].post(b.handle);
+	loops[0].post(a.handle);
+
+	std::thread th1([&]() { loops[0].run(running); });
+	std::thread th2([&]() { loops[1].run(running); });
+
+	while (finished < 2)
+	{
+		std::this_thread::yield();
+	}
+
+	//a coroutine resumed inline is still on the stack of a loop thread until the join
+	running = false;
+	th1.join();
+	th2.join();
+
+	a.handle.destroy();
+	b.handle.destroy();
+
+	report(name, samples);
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t round_trips = 200000;
+
+	benchmark_options options("usage: wait_free_async_queue_benchmark [--round-trips 200000]");
+	options.add("--round-trips", round_trips);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	run_ping_pong("direct resume", round_trips, false);
+	run_ping_pong("home thread resume", round_trips, true);
+
+	return 0;
+}
+
+#else
+
+int main()
+{
+	std::cout << "wait_free_async_queue requires C++20 coroutines" << std::endl;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_bitset.hpp"
+#include "wait_free_queue.hpp"
+
+//id allocation: wait_free_bitset against a free list kept in a wait_free_queue
+//every thread holds up to a window of ids, taking new ones and handing back the oldest, the table starts half full
+//usage: wait_free_bitset_benchmark [--threads 8] [--ids 1048576] [--ops 1000000] [--window 64]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static void report(const char* name, int64_t operations, double seconds, int64_t failed)
+{
+	std::cout << name << ": " << static_cast<int64_t>(operations / seconds / 1000) << " Kops/s";
+	if (failed != 0)
+	{
+		std::cout << ", failed allocations: " << failed;
+	}
+	std::cout << std::endl;
+}
+
+template<typename TAllocate, typename TRelease>
+static void run(const char* name, int64_t thread_count, int64_t ops, int64_t window, TAllocate allocate, TRelease release)
+{
+	std::atomic<int64_t> failed(0);
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		std::vector<int64_t> held(window, -1);
+		int64_t local_failed(0);
+		for (int64_t i = 0; i < ops; i++)
+		{
+			int64_t& slot = held[i % window];
+			if (slot != -1)
+			{
+				release(slot);
+			}
+
+			slot = allocate(index);
+			local_failed += slot == -1 ? 1 : 0;
+		}
+
+		for (int64_t id : held)
+		{
+			if (id != -1)
+			{
+				release(id);
+			}
+		}
+		failed += local_failed;
+	});
+
+	report(name, thread_count * ops * 2, seconds, failed);
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 8;
+	int64_t id_count = 1 << 20;
+	int64_t ops = 1000000;
+	int64_t window = 64;
+
+	benchmark_options options("usage: wait_free_bitset_benchmark [--threads 8] [--ids 1048576] [--ops 1000000] [--window 64]");
+	options.add("--threads", thread_count);
+	options.add("--ids", id_count);
+	options.add("--ops", ops);
+	options.add("--window", window);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", ids: " << id_count << ", ops per thread: " << ops
+		<< ", window: " << window << std::endl;
+
+	{
+		wait_free_bitset<> bitset(id_count);
+		for (int64_t id = 0; id < id_count; id += 2)
+		{
+			bitset.set(id);
+		}
+
+		//a per thread hint spreads the threads over the table, as a caller handing out ids would
+		run("wait_free_bitset", thread_count, ops, window,
+			[&](int64_t index) { return bitset.allocate(index * id_count / thread_count); },
+			[&](int64_t id) { bitset.release(id); });
+	}
+
+	{
+		wait_free_queue<int64_t> free_list(-1, id_count);
+		for (int64_t id = 1; id < id_count; id += 2)
+		{
+			free_list.enqueue(id);
+		}
+
+		run("wait_free_queue free list", thread_count, ops, window,
+			[&](int64_t) { int64_t id(-1); return free_list.dequeue(id) == -1 ? -1 : id; },
+			[&](int64_t id) { free_list.enqueue(id); });
+	}
+
+	return 0;
+}
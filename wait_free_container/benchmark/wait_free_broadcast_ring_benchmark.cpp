@@ -0,0 +1,204 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_broadcast_ring.hpp"
+#include "wait_free_generic_queue.hpp"
+
+//fan out of one feed to K consumers, wait_free_broadcast_ring (one copy, read in place)
+//versus K wait_free_generic_queue (K copies), reports publish to consume latency and throughput
+//usage: wait_free_broadcast_ring_benchmark [--consumers 8] [--messages 200000] [--interval-ns 1000]
+
+struct market_data
+{
+	int64_t		timestamp_ns;
+	int64_t		sequence;
+	double		bid[3];
+	double		ask[3];
+};
+
+using clock_type = std::chrono::steady_clock;
+
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, std::vector<std::vector<int64_t>>& latencies, int64_t message_count, clock_type::duration elapsed)
+{
+	std::vector<int64_t> samples;
+	for (auto& consumer_samples : latencies)
+	{
+		samples.insert(samples.end(), consumer_samples.begin(), consumer_samples.end());
+	}
+
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&](double p) { return samples.empty() ? 0 : samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+	double seconds = std::chrono::duration<double>(elapsed).count();
+
+	std::cout << name << ": " << static_cast<int64_t>(message_count / seconds) << " msg/s"
+		<< ", latency ns p50 " << percentile(0.5)
+		<< " p99 " << percentile(0.99)
+		<< " p999 " << percentile(0.999)
+		<< " max " << (samples.empty() ? 0 : samples.back()) << std::endl;
+}
+
+//paced producer so the latency is not dominated by a full ring
+static void produce(int64_t message_count, int64_t interval_ns, const std::function<void(const market_data&)>& publish)
+{
+	int64_t next_ns = now_ns();
+	for (int64_t i = 0; i < message_count; i++)
+	{
+		while (now_ns() < next_ns)
+		{
+		}
+		next_ns += interval_ns;
+
+		market_data md{ now_ns(), i, { 1.0, 2.0, 3.0 }, { 4.0, 5.0, 6.0 } };
+		publish(md);
+	}
+}
+
+static void run_broadcast_ring(int64_t consumer_count, int64_t message_count, int64_t interval_ns, bool lossy)
+{
+	wait_free_broadcast_ring<market_data> ring(4096, consumer_count, lossy);
+	std::vector<std::vector<int64_t>> latencies(consumer_count);
+	std::vector<int64_t> consumers;
+	std::atomic<bool> producing(true);
+
+	for (int64_t i = 0; i < consumer_count; i++)
+	{
+		consumers.push_back(ring.add_consumer());
+		latencies[i].reserve(message_count);
+	}
+
+	std::vector<std::thread> threads;
+	for (int64_t i = 0; i < consumer_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			int64_t consumed(0);
+			while (consumed + ring.lost(consumers[i]) < message_count)
+			{
+				int64_t count = ring.consume(consumers[i], [&](const market_data& md, int64_t)
+				{
+					latencies[i].push_back(now_ns() - md.timestamp_ns);
+				}, 64);
+
+				consumed += count;
+				if (count == 0)
+				{
+					if (!producing && ring.available(consumers[i]) == 0 && ring.cursor(consumers[i]) >= ring.claimed())
+					{
+						break;
+					}
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	auto start = clock_type::now();
+	produce(message_count, interval_ns, [&](const market_data& md) { ring.publish(md); });
+	producing = false;
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	report(lossy ? "broadcast_ring lossy" : "broadcast_ring", latencies, message_count, clock_type::now() - start);
+
+	if (lossy)
+	{
+		int64_t lost(0);
+		for (int64_t consumer : consumers)
+		{
+			lost += ring.lost(consumer);
+		}
+		std::cout << "  lost: " << lost << std::endl;
+	}
+}
+
+static void run_generic_queues(int64_t consumer_count, int64_t message_count, int64_t interval_ns)
+{
+	std::vector<std::unique_ptr<wait_free_generic_queue<market_data>>> queues;
+	std::vector<std::vector<int64_t>> latencies(consumer_count);
+
+	for (int64_t i = 0; i < consumer_count; i++)
+	{
+		queues.emplace_back(std::make_unique<wait_free_generic_queue<market_data>>(4096));
+		latencies[i].reserve(message_count);
+	}
+
+	std::vector<std::thread> threads;
+	for (int64_t i = 0; i < consumer_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			market_data md{};
+			int64_t consumed(0);
+			while (consumed < message_count)
+			{
+				if (queues[i]->dequeue(md) != -1)
+				{
+					latencies[i].push_back(now_ns() - md.timestamp_ns);
+					consumed++;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	auto start = clock_type::now();
+	produce(message_count, interval_ns, [&](const market_data& md)
+	{
+		for (auto& queue : queues)
+		{
+			queue->enqueue(md);
+		}
+	});
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	report("generic_queue x K", latencies, message_count, clock_type::now() - start);
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t consumer_count = 8;
+	int64_t message_count = 200000;
+	int64_t interval_ns = 1000;
+
+	benchmark_options options("usage: wait_free_broadcast_ring_benchmark [--consumers 8] [--messages 200000] [--interval-ns 1000]");
+	options.add("--consumers", consumer_count);
+	options.add("--messages", message_count);
+	options.add("--interval-ns", interval_ns, 0);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "consumers: " << consumer_count << ", messages: " << message_count << ", interval ns: " << interval_ns << std::endl;
+
+	run_broadcast_ring(consumer_count, message_count, interval_ns, false);
+	run_broadcast_ring(consumer_count, message_count, interval_ns, true);
+	run_generic_queues(consumer_count, message_count, interval_ns);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_cache.hpp"
+
+//cache in front of a computation: look the key up, compute and insert it on a miss
+//wait_free_cache against the mutex guarded std::list + std::unordered_map lru it replaces
+//the hit path runs over a key space that fits the cache, the mixed run over one twice its size with a skewed key choice
+//usage: wait_free_cache_benchmark [--threads 64] [--capacity 65536] [--ops 200000]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+//stands in for the expensive computation
+static int64_t compute(int64_t key)
+{
+	return key * 2654435761ll;
+}
+
+class clock_cache
+{
+public:
+	explicit clock_cache(int64_t capacity) :
+		m_cache(capacity)
+	{
+	}
+
+	bool find(int64_t key, int64_t& value)
+	{
+		return this->m_cache.find(key, value);
+	}
+
+	void insert(int64_t key, int64_t value)
+	{
+		this->m_cache.insert(key, value);
+	}
+
+	double hit_rate() const
+	{
+		return this->m_cache.cache_stats().hit_rate();
+	}
+
+private:
+	wait_free_cache<int64_t, int64_t> m_cache;
+};
+
+class mutex_lru_cache
+{
+public:
+	explicit mutex_lru_cache(int64_t capacity) :
+		m_capacity(capacity),
+		m_hits(0),
+		m_misses(0)
+	{
+	}
+
+	bool find(int64_t key, int64_t& value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		auto it = this->m_index.find(key);
+		if (it == this->m_index.end())
+		{
+			this->m_misses++;
+			return false;
+		}
+
+		this->m_entries.splice(this->m_entries.begin(), this->m_entries, it->second);
+		value = it->second->second;
+		this->m_hits++;
+		return true;
+	}
+
+	void insert(int64_t key, int64_t value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		auto it = this->m_index.find(key);
+		if (it != this->m_index.end())
+		{
+			it->second->second = value;
+			this->m_entries.splice(this->m_entries.begin(), this->m_entries, it->second);
+			return;
+		}
+
+		if (static_cast<int64_t>(this->m_entries.size()) >= this->m_capacity)
+		{
+			this->m_index.erase(this->m_entries.back().first);
+			this->m_entries.pop_back();
+		}
+
+		this->m_entries.emplace_front(key, value);
+		this->m_index[key] = this->m_entries.begin();
+	}
+
+	double hit_rate() const
+	{
+		return this->m_hits + this->m_misses == 0 ? 0.0 : static_cast<double>(this->m_hits) / static_cast<double>(this->m_hits + this->m_misses);
+	}
+
+private:
+	std::list<std::pair<int64_t, int64_t>>												m_entries;
+	std::unordered_map<int64_t, std::list<std::pair<int64_t, int64_t>>::iterator>		m_index;
+	std::mutex																			m_mutex;
+	int64_t																				m_capacity;
+	int64_t																				m_hits;
+	int64_t																				m_misses;
+};
+
+template<typename TCache>
+static void run(const char* name, int64_t thread_count, int64_t capacity, int64_t ops, int64_t key_count, bool skewed)
+{
+	TCache cache(capacity);
+	for (int64_t key = 0; key < (std::min)(key_count, capacity); key++)
+	{
+		cache.insert(key, compute(key));
+	}
+
+	std::atomic<int64_t> checksum(0);
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		std::mt19937_64 rng(index + 1);
+		int64_t sum(0);
+
+		for (int64_t i = 0; i < ops; i++)
+		{
+			//skewed: the minimum of two draws, low keys come up far more often
+			int64_t key = static_cast<int64_t>(rng() % key_count);
+			if (skewed)
+			{
+				key = (std::min)(key, static_cast<int64_t>(rng() % key_count));
+			}
+
+			int64_t value(0);
+			if (!cache.find(key, value))
+			{
+				value = compute(key);
+				cache.insert(key, value);
+			}
+			sum += value;
+		}
+
+		checksum += sum & 1;
+	});
+
+	std::cout << "  " << name << ": " << static_cast<int64_t>(thread_count * ops / seconds / 1000) << " Klookups/s, hit rate "
+		<< cache.hit_rate() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 64;
+	int64_t capacity = 65536;
+	int64_t ops = 200000;
+
+	benchmark_options options("usage: wait_free_cache_benchmark [--threads 64] [--capacity 65536] [--ops 200000]");
+	options.add("--threads", thread_count);
+	options.add("--capacity", capacity);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", capacity: " << capacity << ", ops per thread: " << ops << std::endl;
+
+	std::cout << "hit path, key space 3/4 of capacity" << std::endl;
+	run<clock_cache>("wait_free_cache", thread_count, capacity, ops, capacity / 4 * 3, false);
+	run<mutex_lru_cache>("std::mutex lru", thread_count, capacity, ops, capacity / 4 * 3, false);
+
+	std::cout << "mixed, skewed key space twice the capacity" << std::endl;
+	run<clock_cache>("wait_free_cache", thread_count, capacity, ops, capacity * 2, true);
+	run<mutex_lru_cache>("std::mutex lru", thread_count, capacity, ops, capacity * 2, true);
+
+	return 0;
+}
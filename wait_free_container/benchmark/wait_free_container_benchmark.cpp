@@ -0,0 +1,818 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "locked_containers.hpp"
+#include "perf_counters.hpp"
+#include "wait_free_buffer.hpp"
+#include "wait_free_generic_queue.hpp"
+#include "wait_free_generic_vector.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_queue.hpp"
+#include "wait_free_static_queue.hpp"
+#include "wait_free_vector.hpp"
+
+//thread scaling matrix over every container and the locked std baselines, one result row per run
+//usage: wait_free_container_benchmark [--threads 1:1,2:2,...] [--batch 1,16] [--value 8,64,256]
+//	[--ops 1000000] [--containers queue,generic_queue,...] [--format csv|json|table] [--output file] [--perf on|off]
+//	[--events trace.json]
+//
+//queue workloads: producers enqueue ops items in batches, consumers dequeue until all of them arrived
+//vector workloads: producers push_back ops items while consumers get ops random indices below the current size
+//pool workload: producers allocate and fill ops slots, consumers read and deallocate them
+//int64_t-only containers run with value size 8, batch only applies to the queue workloads
+//--events writes the gate wait, capacity change and slot spin timeline of every run, needs WAIT_FREE_ENABLE_EVENTS
+//hardware counters are reported per operation, columns stay empty (csv) / null (json) where perf_event_open is unavailable
+
+using clock_type = std::chrono::steady_clock;
+
+template<size_t N>
+struct payload
+{
+	int64_t			value;
+	unsigned char	bytes[N - sizeof(int64_t)];
+};
+
+template<>
+struct payload<sizeof(int64_t)>
+{
+	int64_t			value;
+};
+
+template<typename V>
+static V make_value(int64_t value)
+{
+	V ret{};
+	ret.value = value;
+	return ret;
+}
+
+template<typename V>
+static int64_t value_of(const V& v)
+{
+	return v.value;
+}
+
+template<>
+int64_t make_value<int64_t>(int64_t value)
+{
+	return value;
+}
+
+template<>
+int64_t value_of<int64_t>(const int64_t& v)
+{
+	return v;
+}
+
+#pragma region(adapters)
+//common push/pop surface for the queue workload, pop returns how many elements it took
+template<typename V>
+struct wait_free_queue_adapter
+{
+	wait_free_queue<int64_t> queue{ -1, 1024 };
+
+	void push(std::vector<V>& values)
+	{
+		if (values.size() == 1)
+		{
+			this->queue.enqueue(values[0]);
+		}
+		else
+		{
+			this->queue.enqueue_range(values.begin(), values.end());
+		}
+	}
+
+	int64_t pop(std::vector<V>& out)
+	{
+		if (out.size() == 1)
+		{
+			return this->queue.dequeue(out[0]) != -1 ? 1 : 0;
+		}
+
+		auto it = out.begin();
+		if (this->queue.dequeue_range(it, out.end()) == -1)
+		{
+			return 0;
+		}
+
+		return it - out.begin();
+	}
+
+	wait_free_stats_snapshot stats() const
+	{
+		return this->queue.stats();
+	}
+};
+
+//fixed ring, a full queue makes the producer retry instead of growing
+template<typename V>
+struct static_queue_adapter
+{
+	static_wait_free_queue<int64_t, 1024> queue;
+
+	void push(std::vector<V>& values)
+	{
+		for (const V& value : values)
+		{
+			while (!this->queue.try_enqueue(value))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	int64_t pop(std::vector<V>& out)
+	{
+		int64_t count(0);
+		while (count < static_cast<int64_t>(out.size()) && this->queue.try_dequeue(out[count]))
+		{
+			count++;
+		}
+
+		return count;
+	}
+
+	wait_free_stats_snapshot stats() const
+	{
+		return {};
+	}
+};
+
+template<typename V>
+struct generic_queue_adapter
+{
+	wait_free_generic_queue<V> queue{ 1024 };
+
+	void push(std::vector<V>& values)
+	{
+		if (values.size() == 1)
+		{
+			this->queue.enqueue(values[0]);
+		}
+		else
+		{
+			this->queue.enqueue_range(values.begin(), values.end());
+		}
+	}
+
+	int64_t pop(std::vector<V>& out)
+	{
+		if (out.size() == 1)
+		{
+			return this->queue.dequeue(out[0]) != -1 ? 1 : 0;
+		}
+
+		//the range dequeue doesn't report how many it took, count the slots it overwrote
+		for (V& v : out)
+		{
+			v.value = -1;
+		}
+
+		if (this->queue.dequeue_range(out.begin(), out.end()) == -1)
+		{
+			return 0;
+		}
+
+		return std::count_if(out.begin(), out.end(), [](const V& v) { return v.value != -1; });
+	}
+
+	wait_free_stats_snapshot stats() const
+	{
+		return this->queue.stats();
+	}
+};
+
+template<typename V>
+struct locked_deque_adapter
+{
+	locked_deque<V> queue;
+
+	void push(std::vector<V>& values)
+	{
+		this->queue.enqueue_range(values.begin(), values.end());
+	}
+
+	int64_t pop(std::vector<V>& out)
+	{
+		return this->queue.dequeue_range(out.data(), static_cast<int64_t>(out.size()));
+	}
+
+	wait_free_stats_snapshot stats() const
+	{
+		return {};
+	}
+};
+
+//common push_back/get/size surface for the vector workload
+template<typename V>
+struct wait_free_vector_adapter
+{
+	wait_free_vector<int64_t> vector{ -1, 1024 };
+
+	void push_back(const V& value) { this->vector.push_back(value); }
+	bool get(int64_t index, V& elem) { return this->vector.get(index, elem); }
+	int64_t size() { return static_cast<int64_t>(this->vector.size()); }
+	wait_free_stats_snapshot stats() const { return this->vector.stats(); }
+};
+
+template<typename V>
+struct wait_free_buffer_adapter
+{
+	wait_free_buffer<int64_t> buffer{ -2, -1, 1024 };
+
+	void push_back(const V& value) { this->buffer.push_back(value); }
+	bool get(int64_t index, V& elem) { return this->buffer.load(index, elem); }
+	int64_t size() { return static_cast<int64_t>(this->buffer.cur_pos()); }
+	wait_free_stats_snapshot stats() const { return this->buffer.stats(); }
+};
+
+template<typename V>
+struct generic_vector_adapter
+{
+	wait_free_generic_vecotor<V> vector{ 1024 };
+
+	void push_back(const V& value) { this->vector.push_back(value); }
+	bool get(int64_t index, V& elem) { return this->vector.get(index, elem); }
+	int64_t size() { return static_cast<int64_t>(this->vector.size()); }
+	wait_free_stats_snapshot stats() const { return this->vector.stats(); }
+};
+
+template<typename V>
+struct locked_vector_adapter
+{
+	locked_vector<V> vector;
+
+	void push_back(const V& value) { this->vector.push_back(value); }
+	bool get(int64_t index, V& elem) { return this->vector.get(index, elem); }
+	int64_t size() { return static_cast<int64_t>(this->vector.size()); }
+	wait_free_stats_snapshot stats() const { return {}; }
+};
+#pragma endregion
+
+struct run_config
+{
+	int64_t		producers;
+	int64_t		consumers;
+	int64_t		batch;
+	int64_t		value_size;
+	int64_t		ops;
+};
+
+struct run_timing
+{
+	double					seconds;
+	perf_counter_values		counters;
+};
+
+struct run_result
+{
+	std::string					container;
+	run_config					config;
+	int64_t						operations;
+	run_timing					timing;
+	wait_free_stats_snapshot	stats;
+};
+
+static bool g_perf_enabled = true;
+
+//starts every thread behind a barrier so thread creation is not timed
+//the counters are opened before the threads so they inherit them, and only run between go and the last join
+static run_timing run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	static bool reported = false;
+	perf_counters counters;
+	if (g_perf_enabled && !counters.available() && !reported)
+	{
+		std::cerr << "perf counters unavailable (" << counters.error() << "), reporting without them" << std::endl;
+		reported = true;
+	}
+
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+				std::this_thread::yield();
+			}
+			body(i);
+		});
+	}
+
+	while (ready < thread_count)
+	{
+		std::this_thread::yield();
+	}
+
+	if (g_perf_enabled)
+	{
+		counters.start();
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	run_timing ret;
+	ret.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	if (g_perf_enabled)
+	{
+		ret.counters = counters.stop();
+	}
+
+	return ret;
+}
+
+static int64_t share(int64_t total, int64_t parts, int64_t index)
+{
+	return total / parts + (index < total % parts ? 1 : 0);
+}
+
+template<typename TAdapter, typename V>
+static run_result run_queue(const char* name, const run_config& config)
+{
+	auto container = std::make_unique<TAdapter>();
+	std::atomic<int64_t> consumed(0);
+	std::atomic<int64_t> checksum(0);
+
+	run_timing timing = run_threads(config.producers + config.consumers, [&](int64_t index)
+	{
+		std::vector<V> values(config.batch);
+		if (index < config.producers)
+		{
+			int64_t count = share(config.ops, config.producers, index);
+			for (int64_t i = 0; i < count; i += config.batch)
+			{
+				int64_t n = (std::min)(config.batch, count - i);
+				values.resize(n);
+				for (int64_t j = 0; j < n; j++)
+				{
+					values[j] = make_value<V>(i + j);
+				}
+				container->push(values);
+			}
+			return;
+		}
+
+		int64_t sum(0);
+		while (consumed < config.ops)
+		{
+			int64_t n = container->pop(values);
+			if (n == 0)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			for (int64_t j = 0; j < n; j++)
+			{
+				sum += value_of(values[j]);
+			}
+			consumed += n;
+		}
+		checksum += sum;
+	});
+
+	int64_t expected(0);
+	for (int64_t p = 0; p < config.producers; p++)
+	{
+		int64_t count = share(config.ops, config.producers, p);
+		expected += count * (count - 1) / 2;
+	}
+
+	if (checksum != expected)
+	{
+		std::cerr << name << ": checksum mismatch, " << checksum << " != " << expected << std::endl;
+	}
+
+	return { name, config, config.ops, timing, container->stats() };
+}
+
+template<typename TAdapter, typename V>
+static run_result run_vector(const char* name, const run_config& config)
+{
+	auto container = std::make_unique<TAdapter>();
+
+	run_timing timing = run_threads(config.producers + config.consumers, [&](int64_t index)
+	{
+		if (index < config.producers)
+		{
+			int64_t count = share(config.ops, config.producers, index);
+			for (int64_t i = 0; i < count; i++)
+			{
+				container->push_back(make_value<V>(i));
+			}
+			return;
+		}
+
+		uint64_t state = 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(index + 1);
+		int64_t count = share(config.ops, config.consumers, index - config.producers);
+		V elem{};
+		for (int64_t i = 0; i < count; i++)
+		{
+			int64_t size(0);
+			while ((size = container->size()) == 0)
+			{
+				std::this_thread::yield();
+			}
+
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			container->get(static_cast<int64_t>(state % static_cast<uint64_t>(size)), elem);
+		}
+	});
+
+	return { name, config, config.ops * 2, timing, container->stats() };
+}
+
+template<typename V>
+static run_result run_pool(const char* name, const run_config& config)
+{
+	using iterator = typename wait_free_memory_pool<V>::iterator;
+
+	auto pool = std::make_unique<wait_free_memory_pool<V>>(1024);
+	std::unique_ptr<std::atomic<int64_t>[]> handoff(new std::atomic<int64_t>[config.ops]);
+	for (int64_t i = 0; i < config.ops; i++)
+	{
+		handoff[i] = -1;
+	}
+	std::atomic<int64_t> published(0);
+	std::atomic<int64_t> claimed(0);
+
+	run_timing timing = run_threads(config.producers + config.consumers, [&](int64_t index)
+	{
+		if (index < config.producers)
+		{
+			int64_t count = share(config.ops, config.producers, index);
+			for (int64_t i = 0; i < count; i++)
+			{
+				iterator it = pool->allocate();
+				V* elem = it.lock();
+				*elem = make_value<V>(i);
+				it.unlock();
+				handoff[published++] = it.offset();
+			}
+			return;
+		}
+
+		while (true)
+		{
+			int64_t slot = claimed++;
+			if (slot >= config.ops)
+			{
+				return;
+			}
+
+			int64_t offset(-1);
+			while ((offset = handoff[slot]) == -1)
+			{
+				std::this_thread::yield();
+			}
+
+			iterator it = pool->get(offset);
+			V* elem = it.lock();
+			volatile int64_t value = elem->value;
+			(void)value;
+			it.unlock();
+			pool->deallocate(it);
+		}
+	});
+
+	return { name, config, config.ops * 2, timing, pool->stats() };
+}
+
+#pragma region(matrix)
+struct bench_case
+{
+	std::string													container;
+	bool														batched;
+	std::function<run_result(const char*, const run_config&)>	run;
+};
+
+template<size_t N>
+static void add_sized_cases(std::vector<bench_case>& cases, int64_t value_size)
+{
+	if (value_size != static_cast<int64_t>(N))
+	{
+		return;
+	}
+
+	using V = payload<N>;
+	cases.push_back({ "generic_queue", true, run_queue<generic_queue_adapter<V>, V> });
+	cases.push_back({ "mutex_deque", true, run_queue<locked_deque_adapter<V>, V> });
+	cases.push_back({ "generic_vector", false, run_vector<generic_vector_adapter<V>, V> });
+	cases.push_back({ "mutex_vector", false, run_vector<locked_vector_adapter<V>, V> });
+	cases.push_back({ "pool", false, run_pool<V> });
+}
+
+static std::vector<bench_case> make_cases(int64_t value_size)
+{
+	std::vector<bench_case> cases;
+	if (value_size == 8)
+	{
+		cases.push_back({ "queue", true, run_queue<wait_free_queue_adapter<int64_t>, int64_t> });
+		cases.push_back({ "static_queue", true, run_queue<static_queue_adapter<int64_t>, int64_t> });
+		cases.push_back({ "vector", false, run_vector<wait_free_vector_adapter<int64_t>, int64_t> });
+		cases.push_back({ "buffer", false, run_vector<wait_free_buffer_adapter<int64_t>, int64_t> });
+	}
+
+	add_sized_cases<8>(cases, value_size);
+	add_sized_cases<16>(cases, value_size);
+	add_sized_cases<64>(cases, value_size);
+	add_sized_cases<256>(cases, value_size);
+	add_sized_cases<1024>(cases, value_size);
+
+	return cases;
+}
+#pragma endregion
+
+#pragma region(output)
+static const char* CSV_HEADER =
+	"container,producers,consumers,batch,value_size,ops,operations,seconds,ops_per_sec,"
+	"cas_failures,yields,resizes,resize_stall_ns,spin_waits,"
+	"cycles_per_op,instructions_per_op,l1d_misses_per_op,llc_misses_per_op,branch_misses_per_op";
+
+static int64_t ops_per_sec(const run_result& r)
+{
+	return static_cast<int64_t>(r.operations / r.timing.seconds);
+}
+
+//empty when the counter is unavailable
+static std::string per_op(const run_result& r, perf_counter counter, const char* unavailable)
+{
+	if (!r.timing.counters.available(counter))
+	{
+		return unavailable;
+	}
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(2) << r.timing.counters[counter] / r.operations;
+	return ss.str();
+}
+
+static void write_csv_row(std::ostream& out, const run_result& r)
+{
+	out << r.container << ',' << r.config.producers << ',' << r.config.consumers << ',' << r.config.batch << ','
+		<< r.config.value_size << ',' << r.config.ops << ',' << r.operations << ',' << r.timing.seconds << ','
+		<< ops_per_sec(r) << ','
+		<< r.stats.cas_failures << ',' << r.stats.yields << ',' << r.stats.resize_count << ','
+		<< r.stats.resize_stall_ns << ',' << r.stats.spin_waits;
+
+	for (int32_t i = 0; i < perf_counter_values::COUNT; i++)
+	{
+		out << ',' << per_op(r, static_cast<perf_counter>(i), "");
+	}
+	out << '\n';
+	out.flush();
+}
+
+static void write_json_row(std::ostream& out, const run_result& r, bool first)
+{
+	out << (first ? "\n" : ",\n")
+		<< "  {\"container\": \"" << r.container << "\", \"producers\": " << r.config.producers
+		<< ", \"consumers\": " << r.config.consumers << ", \"batch\": " << r.config.batch
+		<< ", \"value_size\": " << r.config.value_size << ", \"ops\": " << r.config.ops
+		<< ", \"operations\": " << r.operations << ", \"seconds\": " << r.timing.seconds
+		<< ", \"ops_per_sec\": " << ops_per_sec(r)
+		<< ", \"cas_failures\": " << r.stats.cas_failures << ", \"yields\": " << r.stats.yields
+		<< ", \"resizes\": " << r.stats.resize_count << ", \"resize_stall_ns\": " << r.stats.resize_stall_ns
+		<< ", \"spin_waits\": " << r.stats.spin_waits;
+
+	for (int32_t i = 0; i < perf_counter_values::COUNT; i++)
+	{
+		perf_counter counter = static_cast<perf_counter>(i);
+		out << ", \"" << perf_counters::name(counter) << "_per_op\": " << per_op(r, counter, "null");
+	}
+	out << "}";
+	out.flush();
+}
+
+//one block per thread/batch/value configuration, containers side by side
+static void write_table(std::ostream& out, std::vector<run_result> results)
+{
+	std::stable_sort(results.begin(), results.end(), [](const run_result& a, const run_result& b)
+	{
+		if (a.config.producers != b.config.producers) return a.config.producers < b.config.producers;
+		if (a.config.consumers != b.config.consumers) return a.config.consumers < b.config.consumers;
+		if (a.config.value_size != b.config.value_size) return a.config.value_size < b.config.value_size;
+		return a.config.batch < b.config.batch;
+	});
+
+	const run_config* group = nullptr;
+	for (auto& r : results)
+	{
+		if (group == nullptr || group->producers != r.config.producers || group->consumers != r.config.consumers ||
+			group->value_size != r.config.value_size || group->batch != r.config.batch)
+		{
+			group = &r.config;
+			out << "\n" << r.config.producers << ':' << r.config.consumers << " batch " << r.config.batch
+				<< " value " << r.config.value_size << "\n"
+				<< std::left << std::setw(16) << "container" << std::right << std::setw(14) << "ops/s";
+			for (int32_t i = 0; i < perf_counter_values::COUNT; i++)
+			{
+				out << std::setw(16) << perf_counters::name(static_cast<perf_counter>(i));
+			}
+			out << "\n";
+		}
+
+		out << std::left << std::setw(16) << r.container << std::right << std::setw(14) << ops_per_sec(r);
+		for (int32_t i = 0; i < perf_counter_values::COUNT; i++)
+		{
+			out << std::setw(16) << per_op(r, static_cast<perf_counter>(i), "-");
+		}
+		out << "\n";
+	}
+}
+#pragma endregion
+
+static std::vector<std::string> split(const std::string& text, char separator)
+{
+	std::vector<std::string> ret;
+	std::stringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, separator))
+	{
+		if (!item.empty())
+		{
+			ret.push_back(item);
+		}
+	}
+
+	return ret;
+}
+
+static std::vector<int64_t> split_int(const std::string& text)
+{
+	std::vector<int64_t> ret;
+	for (auto& item : split(text, ','))
+	{
+		ret.push_back(std::atoll(item.c_str()));
+	}
+
+	return ret;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string threads = "1:1,2:2,4:4,8:8,16:16,32:32,64:64";
+	std::string batches = "1,16";
+	std::string values = "8,64,256";
+	std::string containers;
+	std::string format = "csv";
+	std::string output;
+	std::string events;
+	std::string perf = "on";
+	int64_t ops = 1000000;
+
+	benchmark_options options("usage: wait_free_container_benchmark [--threads 1:1,2:2,...] [--batch 1,16] [--value 8,64,256]\n"
+		"\t[--ops 1000000] [--containers queue,generic_queue,...] [--format csv|json|table] [--output file] [--perf on|off]\n"
+		"\t[--events trace.json]");
+	options.add("--threads", threads);
+	options.add("--batch", batches);
+	options.add("--value", values);
+	options.add("--containers", containers);
+	options.add("--format", format);
+	options.add("--output", output);
+	options.add("--ops", ops);
+	options.add("--perf", perf);
+	options.add("--events", events);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	g_perf_enabled = perf != "off";
+
+	std::ofstream file;
+	if (!output.empty())
+	{
+		file.open(output);
+		if (!file)
+		{
+			std::cerr << "can't open " << output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = output.empty() ? std::cout : file;
+
+	std::vector<std::string> selected = split(containers, ',');
+	bool json = format == "json";
+	bool table = format == "table";
+	bool first = true;
+	std::vector<run_result> results;
+
+	if (json)
+	{
+		out << "[";
+	}
+	else if (!table)
+	{
+		out << CSV_HEADER << '\n';
+	}
+
+	for (auto& pair : split(threads, ','))
+	{
+		//"p:c", or a single count for both sides
+		size_t colon = pair.find(':');
+		int64_t sides[2] = { std::atoll(pair.c_str()), std::atoll(colon == std::string::npos ? pair.c_str() : pair.c_str() + colon + 1) };
+		for (int64_t value_size : split_int(values))
+		{
+			auto cases = make_cases(value_size);
+			if (cases.empty())
+			{
+				std::cerr << "unsupported value size " << value_size << ", use 8, 16, 64, 256 or 1024" << std::endl;
+				continue;
+			}
+
+			for (auto& c : cases)
+			{
+				if (!selected.empty() && std::find(selected.begin(), selected.end(), c.container) == selected.end())
+				{
+					continue;
+				}
+
+				for (int64_t batch : split_int(batches))
+				{
+					if (!c.batched && batch != 1)
+					{
+						continue;
+					}
+
+					run_config config{ sides[0], sides[1], batch, value_size, ops };
+					run_result result = c.run(c.container.c_str(), config);
+					if (json)
+					{
+						write_json_row(out, result, first);
+					}
+					else if (table)
+					{
+						results.push_back(result);
+					}
+					else
+					{
+						write_csv_row(out, result);
+					}
+					first = false;
+
+					std::cerr << result.container << ' ' << sides[0] << ':' << sides[1] << " batch " << batch
+						<< " value " << value_size << ": " << ops_per_sec(result) << " ops/s" << std::endl;
+				}
+			}
+		}
+	}
+
+	if (json)
+	{
+		out << "\n]\n";
+	}
+	else if (table)
+	{
+		write_table(out, results);
+	}
+
+	if (!events.empty())
+	{
+		if (!WAIT_FREE_ENABLE_EVENTS)
+		{
+			std::cerr << "built without WAIT_FREE_ENABLE_EVENTS, " << events << " has no events" << std::endl;
+		}
+
+		if (!wait_free_events::write_chrome_trace(events))
+		{
+			std::cerr << "can't write " << events << std::endl;
+			return 1;
+		}
+
+		if (wait_free_events::dropped() != 0)
+		{
+			std::cerr << wait_free_events::dropped() << " events dropped, raise WAIT_FREE_EVENT_BUFFER_SIZE" << std::endl;
+		}
+	}
+
+	return 0;
+}
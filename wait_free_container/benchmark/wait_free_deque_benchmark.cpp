@@ -0,0 +1,290 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_deque.hpp"
+#include "wait_free_queue.hpp"
+
+//fork/join benchmark, parallel fib and parallel quicksort on a per-worker wait_free_deque scheduler
+//versus a single shared wait_free_queue scheduler
+//usage: wait_free_deque_benchmark [--fib 32] [--sort-count 4000000]
+
+struct task
+{
+	void (*run)(task*);
+	std::atomic<bool> done{ false };
+};
+
+class scheduler
+{
+public:
+	virtual ~scheduler() {}
+	virtual void spawn(task* t) = 0;
+	virtual bool run_one() = 0;
+};
+
+static scheduler*				g_scheduler(nullptr);
+static thread_local int64_t		t_worker_id(0);
+
+static void execute(task* t)
+{
+	t->run(t);
+	t->done.store(true, std::memory_order_release);
+}
+
+//help with other tasks until t completed
+static void join(task* t)
+{
+	while (!t->done.load(std::memory_order_acquire))
+	{
+		if (!g_scheduler->run_one())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+class deque_scheduler : public scheduler
+{
+public:
+	explicit deque_scheduler(int64_t worker_count) :
+		m_deques(worker_count)
+	{
+		for (auto& deque : this->m_deques)
+		{
+			deque = std::make_unique<wait_free_deque<task*>>(256);
+		}
+	}
+
+	void spawn(task* t) override
+	{
+		this->m_deques[t_worker_id]->push_bottom(t);
+	}
+
+	bool run_one() override
+	{
+		task* t(nullptr);
+		if (this->m_deques[t_worker_id]->pop_bottom(t))
+		{
+			execute(t);
+			return true;
+		}
+
+		int64_t count = static_cast<int64_t>(this->m_deques.size());
+		for (int64_t i = 1; i < count; i++)
+		{
+			int64_t victim = (t_worker_id + i) % count;
+			if (this->m_deques[victim]->steal(t))
+			{
+				execute(t);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+private:
+	std::vector<std::unique_ptr<wait_free_deque<task*>>> m_deques;
+};
+
+class queue_scheduler : public scheduler
+{
+public:
+	explicit queue_scheduler(int64_t) :
+		m_queue(nullptr, 1024)
+	{
+	}
+
+	void spawn(task* t) override
+	{
+		this->m_queue.enqueue(t);
+	}
+
+	bool run_one() override
+	{
+		task* t(nullptr);
+		if (this->m_queue.dequeue(t) != -1)
+		{
+			execute(t);
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+	wait_free_queue<task*> m_queue;
+};
+
+#pragma region(fib)
+static const int FIB_CUTOFF = 16;
+
+static int64_t fib_serial(int n)
+{
+	return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+struct fib_task : task
+{
+	int		n;
+	int64_t	result;
+};
+
+static int64_t fib_parallel(int n);
+
+static void run_fib_task(task* t)
+{
+	fib_task* ft = static_cast<fib_task*>(t);
+	ft->result = fib_parallel(ft->n);
+}
+
+static int64_t fib_parallel(int n)
+{
+	if (n < FIB_CUTOFF)
+	{
+		return fib_serial(n);
+	}
+
+	fib_task child;
+	child.run = run_fib_task;
+	child.n = n - 1;
+	g_scheduler->spawn(&child);
+
+	int64_t right = fib_parallel(n - 2);
+	join(&child);
+
+	return child.result + right;
+}
+#pragma endregion
+
+#pragma region(quicksort)
+static const int64_t SORT_CUTOFF = 4096;
+
+struct sort_task : task
+{
+	int* first;
+	int* last;
+};
+
+static void quicksort_parallel(int* first, int* last);
+
+static void run_sort_task(task* t)
+{
+	sort_task* st = static_cast<sort_task*>(t);
+	quicksort_parallel(st->first, st->last);
+}
+
+static void quicksort_parallel(int* first, int* last)
+{
+	if (last - first < SORT_CUTOFF)
+	{
+		std::sort(first, last);
+		return;
+	}
+
+	int pivot = *(first + (last - first) / 2);
+	int* middle1 = std::partition(first, last, [=](int v) { return v < pivot; });
+	int* middle2 = std::partition(middle1, last, [=](int v) { return !(pivot < v); });
+
+	sort_task child;
+	child.run = run_sort_task;
+	child.first = first;
+	child.last = middle1;
+	g_scheduler->spawn(&child);
+
+	quicksort_parallel(middle2, last);
+	join(&child);
+}
+#pragma endregion
+
+template<typename TScheduler, typename TFunc>
+double run_fork_join(int64_t worker_count, TFunc&& root)
+{
+	TScheduler sched(worker_count);
+	g_scheduler = &sched;
+
+	std::atomic<bool> running(true);
+	std::vector<std::thread> workers;
+	for (int64_t i = 1; i < worker_count; i++)
+	{
+		workers.emplace_back([&, i]()
+		{
+			t_worker_id = i;
+			while (running)
+			{
+				if (!g_scheduler->run_one())
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	//the main thread is worker 0
+	t_worker_id = 0;
+	auto start = std::chrono::steady_clock::now();
+	root();
+	auto end = std::chrono::steady_clock::now();
+
+	running = false;
+	for (auto& th : workers)
+	{
+		th.join();
+	}
+
+	g_scheduler = nullptr;
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t worker_count = (std::max)(static_cast<int64_t>(std::thread::hardware_concurrency()), static_cast<int64_t>(2));
+	int64_t fib_n = 32;
+	int64_t sort_count = 4000000;
+
+	benchmark_options options("usage: wait_free_deque_benchmark [--fib 32] [--sort-count 4000000]");
+	options.add("--fib", fib_n);
+	options.add("--sort-count", sort_count);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "workers: " << worker_count << std::endl;
+
+	int64_t fib_result(0);
+	double deque_ms = run_fork_join<deque_scheduler>(worker_count, [&]() { fib_result = fib_parallel(static_cast<int>(fib_n)); });
+	double queue_ms = run_fork_join<queue_scheduler>(worker_count, [&]() { fib_result = fib_parallel(static_cast<int>(fib_n)); });
+	std::cout << "fib(" << fib_n << ") = " << fib_result << std::endl;
+	std::cout << "  wait_free_deque: " << deque_ms << " ms" << std::endl;
+	std::cout << "  wait_free_queue: " << queue_ms << " ms" << std::endl;
+
+	std::vector<int> source(sort_count);
+	std::mt19937 re(0);
+	std::generate(source.begin(), source.end(), [&]() { return static_cast<int>(re()); });
+
+	std::vector<int> data(source);
+	deque_ms = run_fork_join<deque_scheduler>(worker_count, [&]() { quicksort_parallel(data.data(), data.data() + data.size()); });
+	bool sorted = std::is_sorted(data.begin(), data.end());
+
+	data = source;
+	queue_ms = run_fork_join<queue_scheduler>(worker_count, [&]() { quicksort_parallel(data.data(), data.data() + data.size()); });
+	sorted = sorted && std::is_sorted(data.begin(), data.end());
+
+	std::cout << "quicksort(" << sort_count << ") sorted: " << (sorted ? "yes" : "no") << std::endl;
+	std::cout << "  wait_free_deque: " << deque_ms << " ms" << std::endl;
+	std::cout << "  wait_free_queue: " << queue_ms << " ms" << std::endl;
+
+	return sorted ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_hash_map.hpp"
+
+//id -> handle lookups at several read ratios, wait_free_hash_map against std::unordered_map behind a std::shared_mutex
+//writes are split evenly between update, erase and insert, so the key count stays around its initial value
+//usage: wait_free_hash_map_benchmark [--threads 8] [--keys 100000] [--ops 1000000]
+
+using clock_type = std::chrono::steady_clock;
+
+class locked_map
+{
+public:
+	bool find(int64_t key, int64_t& value)
+	{
+		std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+		auto it = this->m_data.find(key);
+		if (it == this->m_data.end())
+		{
+			return false;
+		}
+
+		value = it->second;
+		return true;
+	}
+
+	bool insert(int64_t key, int64_t value)
+	{
+		std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+		return this->m_data.emplace(key, value).second;
+	}
+
+	bool update(int64_t key, int64_t value)
+	{
+		std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+		auto it = this->m_data.find(key);
+		if (it == this->m_data.end())
+		{
+			return false;
+		}
+
+		it->second = value;
+		return true;
+	}
+
+	bool erase(int64_t key)
+	{
+		std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+		return this->m_data.erase(key) != 0;
+	}
+
+private:
+	std::shared_mutex						m_mutex;
+	std::unordered_map<int64_t, int64_t>	m_data;
+};
+
+class wait_free_map
+{
+public:
+	bool find(int64_t key, int64_t& value) { return this->m_map.find(key, value); }
+	bool insert(int64_t key, int64_t value) { return this->m_map.insert(key, value); }
+	bool update(int64_t key, int64_t value) { return this->m_map.update(key, value); }
+	bool erase(int64_t key) { return this->m_map.erase(key); }
+
+private:
+	wait_free_hash_map<int64_t, int64_t> m_map{ -1, -1, -2 };
+};
+
+template<typename TMap>
+static double run(int64_t thread_count, int64_t key_count, int64_t ops, int32_t read_percent)
+{
+	TMap map;
+	for (int64_t key = 0; key < key_count; key += 2)
+	{
+		map.insert(key, key);
+	}
+
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::atomic<int64_t> hits(0);
+	std::vector<std::thread> threads;
+
+	for (int64_t t = 0; t < thread_count; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937_64 rng(t + 1);
+			int64_t local_hits(0);
+			int64_t value(0);
+
+			ready++;
+			while (!go)
+			{
+			}
+
+			for (int64_t i = 0; i < ops; i++)
+			{
+				uint64_t r = rng();
+				int64_t key = static_cast<int64_t>(r % key_count);
+				int32_t op = static_cast<int32_t>((r >> 32) % 100);
+
+				if (op < read_percent)
+				{
+					local_hits += map.find(key, value) ? 1 : 0;
+				}
+				else if (op % 3 == 0)
+				{
+					map.update(key, i);
+				}
+				else if (op % 3 == 1)
+				{
+					map.erase(key);
+				}
+				else
+				{
+					map.insert(key, i);
+				}
+			}
+
+			hits += local_hits;
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	return thread_count * ops / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 8;
+	int64_t key_count = 100000;
+	int64_t ops = 1000000;
+
+	benchmark_options options("usage: wait_free_hash_map_benchmark [--threads 8] [--keys 100000] [--ops 1000000]");
+	options.add("--threads", thread_count);
+	options.add("--keys", key_count);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", keys: " << key_count << ", ops per thread: " << ops << std::endl;
+	std::cout << std::left << std::setw(8) << "read%" << std::right << std::setw(20) << "hash_map ops/s"
+		<< std::setw(24) << "shared_mutex ops/s" << std::setw(10) << "ratio" << std::endl;
+
+	for (int32_t read_percent : { 50, 75, 90, 95, 99 })
+	{
+		double wait_free_ops = run<wait_free_map>(thread_count, key_count, ops, read_percent);
+		double locked_ops = run<locked_map>(thread_count, key_count, ops, read_percent);
+
+		std::cout << std::left << std::setw(8) << read_percent << std::right << std::setw(20) << static_cast<int64_t>(wait_free_ops)
+			<< std::setw(24) << static_cast<int64_t>(locked_ops) << std::setw(10) << std::fixed << std::setprecision(2)
+			<< wait_free_ops / locked_ops << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,225 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_kcas.hpp"
+
+//k word transfers: read k words, move one unit from the first to the second, write all k back in one atomic step
+//wait_free_kcas_array against the same words behind a striped mutex, locked in stripe order
+//few words means heavy contention, the total over all words must stay what it started as
+//usage: wait_free_kcas_benchmark [--threads 8] [--words 64] [--ops 500000] [--stripes 16]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+class kcas_words
+{
+public:
+	kcas_words(int64_t size, int64_t) :
+		m_words(size, 1000)
+	{
+	}
+
+	bool transfer(const int64_t* indices, int32_t k)
+	{
+		wait_free_kcas_entry entries[wait_free_kcas_array<>::MAX_WORDS];
+		for (int32_t i = 0; i < k; i++)
+		{
+			int64_t value = this->m_words.load(indices[i]);
+			entries[i] = { indices[i], value, value + (i == 0 ? -1 : (i == 1 ? 1 : 0)) };
+		}
+
+		return this->m_words.compare_and_exchange_strong(entries, k);
+	}
+
+	int64_t load(int64_t index)
+	{
+		return this->m_words.load(index);
+	}
+
+private:
+	wait_free_kcas_array<> m_words;
+};
+
+class striped_words
+{
+public:
+	striped_words(int64_t size, int64_t stripes) :
+		m_words(size, 1000),
+		m_mutexes(stripes)
+	{
+	}
+
+	bool transfer(const int64_t* indices, int32_t k)
+	{
+		//distinct stripes in ascending order, so two transfers never wait on each other in a cycle
+		int64_t stripes[wait_free_kcas_array<>::MAX_WORDS];
+		int32_t stripe_count(0);
+		for (int32_t i = 0; i < k; i++)
+		{
+			int64_t stripe = indices[i] % static_cast<int64_t>(this->m_mutexes.size());
+			int32_t j = stripe_count;
+			while (j > 0 && stripes[j - 1] > stripe)
+			{
+				j--;
+			}
+
+			if (j > 0 && stripes[j - 1] == stripe)
+			{
+				continue;
+			}
+
+			for (int32_t m = stripe_count; m > j; m--)
+			{
+				stripes[m] = stripes[m - 1];
+			}
+			stripes[j] = stripe;
+			stripe_count++;
+		}
+
+		for (int32_t i = 0; i < stripe_count; i++)
+		{
+			this->m_mutexes[stripes[i]].lock();
+		}
+
+		this->m_words[indices[0]]--;
+		this->m_words[indices[1]]++;
+
+		for (int32_t i = stripe_count - 1; i >= 0; i--)
+		{
+			this->m_mutexes[stripes[i]].unlock();
+		}
+
+		return true;
+	}
+
+	int64_t load(int64_t index)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutexes[index % static_cast<int64_t>(this->m_mutexes.size())]);
+		return this->m_words[index];
+	}
+
+private:
+	std::vector<int64_t>		m_words;
+	std::vector<std::mutex>		m_mutexes;
+};
+
+template<typename TWords>
+static void run(const char* name, int64_t thread_count, int64_t word_count, int64_t ops, int32_t k, int64_t stripes)
+{
+	TWords words(word_count, stripes);
+	std::atomic<int64_t> failed(0);
+
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		std::mt19937_64 rng(index + 1);
+		int64_t indices[wait_free_kcas_array<>::MAX_WORDS];
+		int64_t local_failed(0);
+
+		for (int64_t i = 0; i < ops; i++)
+		{
+			for (int32_t j = 0; j < k; j++)
+			{
+				bool duplicate(true);
+				while (duplicate)
+				{
+					indices[j] = static_cast<int64_t>(rng() % word_count);
+					duplicate = std::find(indices, indices + j, indices[j]) != indices + j;
+				}
+			}
+
+			//a stale read makes the kcas fail, it reads again and retries until the transfer goes through
+			while (!words.transfer(indices, k))
+			{
+				local_failed++;
+			}
+		}
+
+		failed += local_failed;
+	});
+
+	int64_t total(0);
+	for (int64_t i = 0; i < word_count; i++)
+	{
+		total += words.load(i);
+	}
+
+	std::cout << "  " << name << ": " << static_cast<int64_t>(thread_count * ops / seconds / 1000) << " Ktransfers/s, retries "
+		<< failed;
+	if (total != word_count * 1000)
+	{
+		std::cout << ", total " << total << " expected " << word_count * 1000;
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 8;
+	int64_t word_count = 64;
+	int64_t ops = 500000;
+	int64_t stripes = 16;
+
+	benchmark_options options("usage: wait_free_kcas_benchmark [--threads 8] [--words 64] [--ops 500000] [--stripes 16]");
+	options.add("--threads", thread_count);
+	options.add("--words", word_count);
+	options.add("--ops", ops);
+	options.add("--stripes", stripes);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", words: " << word_count << ", ops per thread: " << ops
+		<< ", stripes: " << stripes << std::endl;
+
+	for (int32_t k = 2; k <= 4; k++)
+	{
+		std::cout << "k = " << k << std::endl;
+		run<kcas_words>("wait_free_kcas_array", thread_count, word_count, ops, k, stripes);
+		run<striped_words>("striped mutex", thread_count, word_count, ops, k, stripes);
+	}
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_lossy_queue.hpp"
+
+//telemetry samples through wait_free_lossy_queue: producers never wait, consumers take what is left
+//checks every sample that comes out is intact and in producer order, and that taken + lost == produced
+//the second run starts the consumers only after the producers are done, so all but one lap is lost
+//usage: wait_free_lossy_queue_benchmark [--producers 4] [--consumers 2] [--capacity 4096] [--ops 1000000]
+
+using clock_type = std::chrono::steady_clock;
+
+struct sample
+{
+	int64_t		producer;
+	int64_t		index;
+	int64_t		check;
+};
+
+static int64_t check_of(int64_t producer, int64_t index)
+{
+	return (producer * 0x9e3779b97f4a7c15ll) ^ (index * 0xbf58476d1ce4e5b9ll);
+}
+
+//false when the counts don't add up or a sample came out torn or out of order
+static bool run(const char* name, int64_t producer_count, int64_t consumer_count, int64_t capacity, int64_t ops, bool consume_after)
+{
+	wait_free_lossy_queue<sample> queue(capacity);
+	std::atomic<int64_t> producers_done(0);
+	std::atomic<int64_t> taken(0);
+	std::atomic<int64_t> corrupt(0);
+
+	auto consume = [&]()
+	{
+		std::vector<int64_t> last(producer_count, -1);
+		int64_t local_taken(0);
+		int64_t local_corrupt(0);
+
+		while (true)
+		{
+			bool done = producers_done.load(std::memory_order_acquire) == producer_count;
+
+			sample s{};
+			if (queue.dequeue(s) == -1)
+			{
+				//nothing is being written once every producer is done, so empty is final
+				if (done)
+				{
+					break;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+
+			if (s.producer < 0 || s.producer >= producer_count || s.check != check_of(s.producer, s.index) || s.index <= last[s.producer])
+			{
+				local_corrupt++;
+			}
+			else
+			{
+				last[s.producer] = s.index;
+			}
+			local_taken++;
+		}
+
+		taken += local_taken;
+		corrupt += local_corrupt;
+	};
+
+	std::vector<std::thread> consumers;
+	if (!consume_after)
+	{
+		for (int64_t i = 0; i < consumer_count; i++)
+		{
+			consumers.emplace_back(consume);
+		}
+	}
+
+	auto start = clock_type::now();
+	std::vector<std::thread> producers;
+	for (int64_t p = 0; p < producer_count; p++)
+	{
+		producers.emplace_back([&, p]()
+		{
+			for (int64_t i = 0; i < ops; i++)
+			{
+				queue.enqueue({ p, i, check_of(p, i) });
+			}
+			producers_done++;
+		});
+	}
+
+	for (auto& th : producers)
+	{
+		th.join();
+	}
+	double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	if (consume_after)
+	{
+		for (int64_t i = 0; i < consumer_count; i++)
+		{
+			consumers.emplace_back(consume);
+		}
+	}
+
+	for (auto& th : consumers)
+	{
+		th.join();
+	}
+
+	int64_t produced = producer_count * ops;
+	int64_t lost = queue.lost();
+	bool ok = taken + lost == produced && corrupt == 0;
+
+	std::cout << "  " << name << ": " << static_cast<int64_t>(produced / seconds / 1000) << " Kenqueues/s, taken " << taken
+		<< ", lost " << lost << " (" << 100.0 * static_cast<double>(lost) / static_cast<double>(produced) << "%)";
+	if (!ok)
+	{
+		std::cout << ", FAILED: produced " << produced << ", corrupt " << corrupt;
+	}
+	std::cout << std::endl;
+
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t producer_count = 4;
+	int64_t consumer_count = 2;
+	int64_t capacity = 4096;
+	int64_t ops = 1000000;
+
+	benchmark_options options("usage: wait_free_lossy_queue_benchmark [--producers 4] [--consumers 2] [--capacity 4096] [--ops 1000000]");
+	options.add("--producers", producer_count);
+	options.add("--consumers", consumer_count);
+	options.add("--capacity", capacity);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "producers: " << producer_count << ", consumers: " << consumer_count << ", capacity: " << capacity
+		<< ", ops per producer: " << ops << std::endl;
+
+	bool ok = run("concurrent consumers", producer_count, consumer_count, capacity, ops, false);
+	ok &= run("consumers after producers", producer_count, consumer_count, capacity, ops, true);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_numa.hpp"
+#include "wait_free_queue.hpp"
+
+//node local sharded queue and per node pool against the single shared ones
+//on a single node machine pass a node count to simulate the topology, threads are then spread over nodes by index
+//usage: wait_free_numa_benchmark [--nodes 2 (0 = real topology)] [--threads 8] [--ops 200000]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static void report(const char* name, int64_t operations, double seconds)
+{
+	std::cout << name << ": " << static_cast<int64_t>(operations / seconds / 1000) << " Kops/s" << std::endl;
+}
+
+//every thread enqueues then dequeues in turn, so a node local queue hands elements back to the node that made them
+template<typename TQueue>
+static void run_queue(const char* name, TQueue& queue, int64_t thread_count, int64_t ops)
+{
+	std::atomic<int64_t> lost(0);
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		int64_t value(0);
+		for (int64_t i = 0; i < ops; i++)
+		{
+			queue.enqueue(index * ops + i);
+			if (queue.dequeue(value) == -1)
+			{
+				lost++;
+			}
+		}
+	});
+
+	report(name, thread_count * ops * 2, seconds);
+	if (lost != 0)
+	{
+		std::cout << "  empty dequeues: " << lost << std::endl;
+	}
+}
+
+template<typename TPool>
+static void run_pool(const char* name, TPool& pool, int64_t thread_count, int64_t ops)
+{
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		for (int64_t i = 0; i < ops; i++)
+		{
+			auto it = pool.allocate();
+			int64_t* elem = it.lock();
+			*elem = index;
+			it.unlock();
+			pool.deallocate(it);
+		}
+	});
+
+	report(name, thread_count * ops * 2, seconds);
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t nodes = 2;
+	int64_t thread_count = 8;
+	int64_t ops = 200000;
+
+	benchmark_options options("usage: wait_free_numa_benchmark [--nodes 2 (0 = real topology)] [--threads 8] [--ops 200000]");
+	options.add("--nodes", nodes, 0);
+	options.add("--threads", thread_count);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	wait_free_numa_topology& topology = wait_free_numa_topology::instance();
+	topology.simulate(static_cast<int32_t>(nodes));
+
+	std::cout << "nodes: " << topology.node_count() << (topology.simulated() ? " (simulated)" : "")
+		<< ", threads: " << thread_count << ", ops per thread: " << ops << std::endl;
+
+	{
+		wait_free_queue<int64_t> queue(-1, 1024);
+		run_queue("wait_free_queue", queue, thread_count, ops);
+	}
+
+	{
+		wait_free_numa_queue<int64_t> queue(-1, 1024);
+		run_queue("wait_free_numa_queue", queue, thread_count, ops);
+		std::cout << "  remote dequeues: " << queue.remote_dequeues() << std::endl;
+	}
+
+	{
+		wait_free_memory_pool<int64_t> pool(1024);
+		run_pool("wait_free_memory_pool", pool, thread_count, ops);
+	}
+
+	{
+		wait_free_numa_pool<int64_t> pool(1024);
+		run_pool("wait_free_numa_pool", pool, thread_count, ops);
+		for (int32_t node = 0; node < pool.node_count(); node++)
+		{
+			std::cout << "  node " << node << " capacity: " << pool.node_pool(node).capacity() << std::endl;
+		}
+	}
+
+	return 0;
+}
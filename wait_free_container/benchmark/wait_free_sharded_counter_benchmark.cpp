@@ -0,0 +1,124 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_buffer.hpp"
+#include "wait_free_sharded_counter.hpp"
+
+//many threads bumping a few hot counters: wait_free_sharded_counter_array against wait_free_buffer_integer::fetch_add
+//and a plain array of atomics, each thread walks the counters in its own order
+//usage: wait_free_sharded_counter_benchmark [--threads 64] [--counters 16] [--ops 1000000]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+template<typename TAdd, typename TLoad>
+static void run(const char* name, int64_t thread_count, int64_t counter_count, int64_t ops, TAdd add, TLoad load)
+{
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		for (int64_t i = 0; i < ops; i++)
+		{
+			add((index + i) % counter_count);
+		}
+	});
+
+	int64_t total(0);
+	for (int64_t counter = 0; counter < counter_count; counter++)
+	{
+		total += load(counter);
+	}
+
+	std::cout << name << ": " << static_cast<int64_t>(thread_count * ops / seconds / 1000) << " Kops/s";
+	if (total != thread_count * ops)
+	{
+		std::cout << ", total " << total << " expected " << thread_count * ops;
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 64;
+	int64_t counter_count = 16;
+	int64_t ops = 1000000;
+
+	benchmark_options options("usage: wait_free_sharded_counter_benchmark [--threads 64] [--counters 16] [--ops 1000000]");
+	options.add("--threads", thread_count);
+	options.add("--counters", counter_count);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", counters: " << counter_count << ", ops per thread: " << ops << std::endl;
+
+	{
+		wait_free_sharded_counter_array<int64_t> counters(counter_count);
+		std::cout << "shards: " << counters.shard_count() << std::endl;
+		run("wait_free_sharded_counter_array", thread_count, counter_count, ops,
+			[&](int64_t counter) { counters.increment(counter); },
+			[&](int64_t counter) { return counters.load(counter); });
+	}
+
+	{
+		wait_free_buffer<int64_t> counters(-2, -1, counter_count);
+		for (int64_t counter = 0; counter < counter_count; counter++)
+		{
+			counters.push_back(0);
+		}
+
+		int64_t result(0);
+		run("wait_free_buffer_integer::fetch_add", thread_count, counter_count, ops,
+			[&](int64_t counter) { int64_t old(0); counters.fetch_add(counter, 1, old); },
+			[&](int64_t counter) { counters.load(counter, result); return result; });
+	}
+
+	{
+		std::vector<std::atomic<int64_t>> counters(counter_count);
+		run("std::atomic fetch_add", thread_count, counter_count, ops,
+			[&](int64_t counter) { counters[counter].fetch_add(1, std::memory_order_relaxed); },
+			[&](int64_t counter) { return counters[counter].load(); });
+	}
+
+	return 0;
+}
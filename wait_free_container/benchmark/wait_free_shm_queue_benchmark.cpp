@@ -0,0 +1,209 @@
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "benchmark_options.hpp"
+#include "wait_free_shm_queue.hpp"
+
+//cross process throughput, a forked producer sends fixed size messages to the parent through
+//wait_free_shm_queue, a pipe and a unix domain socket pair
+//usage: wait_free_shm_queue_benchmark [--messages 2000000] [--capacity 4096]
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+struct message
+{
+	int64_t		sequence;
+	char		payload[56];
+};
+
+using clock_type = std::chrono::steady_clock;
+
+static void report(const char* name, int64_t message_count, clock_type::duration elapsed)
+{
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	std::cout << name << ": " << static_cast<int64_t>(message_count / seconds) << " msg/s, "
+		<< static_cast<int64_t>(message_count * sizeof(message) / seconds / (1024 * 1024)) << " MiB/s" << std::endl;
+}
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = ::write(fd, p, size);
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool read_all(int fd, void* data, size_t size)
+{
+	char* p = static_cast<char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = ::read(fd, p, size);
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool run_shm_queue(int64_t message_count, int64_t capacity)
+{
+	std::string name = "/wait_free_shm_queue_benchmark_" + std::to_string(::getpid());
+	wait_free_shm_queue<message>::remove(name.c_str());
+
+	wait_free_shm_queue<message> consumer;
+	if (!consumer.create(name.c_str(), capacity))
+	{
+		std::cout << "shm_open failed: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	auto start = clock_type::now();
+	pid_t child = ::fork();
+	if (child == 0)
+	{
+		wait_free_shm_queue<message> producer;
+		if (!producer.attach(name.c_str()))
+		{
+			::_exit(1);
+		}
+
+		message msg{};
+		for (int64_t i = 0; i < message_count; i++)
+		{
+			msg.sequence = i;
+			while (!producer.try_enqueue(msg))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		::_exit(0);
+	}
+
+	message msg{};
+	bool ordered(true);
+	for (int64_t i = 0; i < message_count; i++)
+	{
+		while (!consumer.try_dequeue(msg))
+		{
+			std::this_thread::yield();
+		}
+		ordered = ordered && msg.sequence == i;
+	}
+	auto elapsed = clock_type::now() - start;
+
+	::waitpid(child, nullptr, 0);
+	wait_free_shm_queue<message>::remove(name.c_str());
+
+	report("wait_free_shm_queue", message_count, elapsed);
+
+	return ordered;
+}
+
+static bool run_stream(const char* name, int64_t message_count, int fds[2])
+{
+	auto start = clock_type::now();
+	pid_t child = ::fork();
+	if (child == 0)
+	{
+		::close(fds[0]);
+		message msg{};
+		for (int64_t i = 0; i < message_count; i++)
+		{
+			msg.sequence = i;
+			if (!write_all(fds[1], &msg, sizeof(msg)))
+			{
+				::_exit(1);
+			}
+		}
+
+		::_exit(0);
+	}
+
+	::close(fds[1]);
+	message msg{};
+	bool ordered(true);
+	for (int64_t i = 0; i < message_count; i++)
+	{
+		if (!read_all(fds[0], &msg, sizeof(msg)))
+		{
+			ordered = false;
+			break;
+		}
+		ordered = ordered && msg.sequence == i;
+	}
+	auto elapsed = clock_type::now() - start;
+
+	::close(fds[0]);
+	::waitpid(child, nullptr, 0);
+
+	report(name, message_count, elapsed);
+
+	return ordered;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t message_count = 2000000;
+	int64_t capacity = 4096;
+
+	benchmark_options options("usage: wait_free_shm_queue_benchmark [--messages 2000000] [--capacity 4096]");
+	options.add("--messages", message_count);
+	options.add("--capacity", capacity);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "messages: " << message_count << " x " << sizeof(message) << " bytes" << std::endl;
+
+	bool ok = run_shm_queue(message_count, capacity);
+
+	int pipe_fds[2];
+	if (::pipe(pipe_fds) == 0)
+	{
+		ok = run_stream("pipe", message_count, pipe_fds) && ok;
+	}
+
+	int socket_fds[2];
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds) == 0)
+	{
+		ok = run_stream("unix socket", message_count, socket_fds) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+	std::cout << "wait_free_shm_queue requires posix shared memory" << std::endl;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_skiplist_map.hpp"
+
+//ordered map under a mix of point reads, short range scans and insert / erase pairs
+//wait_free_skiplist_map against std::map behind a std::shared_mutex, scans and reads share the lock, writes take it alone
+//the key space starts half full and writers insert and erase at random, so it stays about half full
+//usage: wait_free_skiplist_map_benchmark [--threads 8] [--keys 100000] [--ops 200000] [--range 32]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+class skiplist_map
+{
+public:
+	explicit skiplist_map(int64_t key_count) :
+		m_map(key_count)
+	{
+	}
+
+	bool insert(int64_t key, int64_t value)
+	{
+		return this->m_map.insert(key, value);
+	}
+
+	bool erase(int64_t key)
+	{
+		return this->m_map.erase(key);
+	}
+
+	bool find(int64_t key, int64_t& value)
+	{
+		return this->m_map.find(key, value);
+	}
+
+	int64_t range(int64_t from, int64_t to, int64_t& sum)
+	{
+		return this->m_map.for_each_range(from, to, [&](int64_t, int64_t value)
+		{
+			sum += value;
+		});
+	}
+
+private:
+	wait_free_skiplist_map<int64_t, int64_t> m_map;
+};
+
+class shared_mutex_map
+{
+public:
+	explicit shared_mutex_map(int64_t)
+	{
+	}
+
+	bool insert(int64_t key, int64_t value)
+	{
+		std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+		return this->m_map.emplace(key, value).second;
+	}
+
+	bool erase(int64_t key)
+	{
+		std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+		return this->m_map.erase(key) != 0;
+	}
+
+	bool find(int64_t key, int64_t& value)
+	{
+		std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+		auto it = this->m_map.find(key);
+		if (it == this->m_map.end())
+		{
+			return false;
+		}
+
+		value = it->second;
+		return true;
+	}
+
+	int64_t range(int64_t from, int64_t to, int64_t& sum)
+	{
+		std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+
+		int64_t ret(0);
+		for (auto it = this->m_map.lower_bound(from); it != this->m_map.end() && it->first <= to; ++it)
+		{
+			sum += it->second;
+			ret++;
+		}
+
+		return ret;
+	}
+
+private:
+	std::map<int64_t, int64_t>	m_map;
+	std::shared_mutex			m_mutex;
+};
+
+template<typename TMap>
+static void run(const char* name, int64_t thread_count, int64_t key_count, int64_t ops, int64_t range_length,
+	int32_t read_percent, int32_t range_percent)
+{
+	TMap map(key_count);
+	for (int64_t key = 0; key < key_count; key += 2)
+	{
+		map.insert(key, key);
+	}
+
+	std::atomic<int64_t> scanned(0);
+	double seconds = run_threads(thread_count, [&](int64_t index)
+	{
+		std::mt19937_64 rng(index + 1);
+		int64_t local_scanned(0);
+		int64_t sum(0);
+
+		for (int64_t i = 0; i < ops; i++)
+		{
+			int64_t key = static_cast<int64_t>(rng() % key_count);
+			int32_t dice = static_cast<int32_t>(rng() % 100);
+			if (dice < read_percent)
+			{
+				int64_t value(0);
+				map.find(key, value);
+				sum += value;
+			}
+			else if (dice < read_percent + range_percent)
+			{
+				local_scanned += map.range(key, key + range_length - 1, sum);
+			}
+			else if (dice & 1)
+			{
+				map.insert(key, key);
+			}
+			else
+			{
+				map.erase(key);
+			}
+		}
+
+		//keeps the reads from being optimized away
+		scanned += local_scanned + (sum & 1);
+	});
+
+	std::cout << "  " << name << ": " << static_cast<int64_t>(thread_count * ops / seconds / 1000) << " Kops/s, scanned "
+		<< scanned << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t thread_count = 8;
+	int64_t key_count = 100000;
+	int64_t ops = 200000;
+	int64_t range_length = 32;
+
+	benchmark_options options("usage: wait_free_skiplist_map_benchmark [--threads 8] [--keys 100000] [--ops 200000] [--range 32]");
+	options.add("--threads", thread_count);
+	options.add("--keys", key_count);
+	options.add("--ops", ops);
+	options.add("--range", range_length);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "threads: " << thread_count << ", keys: " << key_count << ", ops per thread: " << ops
+		<< ", range length: " << range_length << std::endl;
+
+	//read / range / write percentages
+	const int32_t mixes[][2] = { { 90, 0 }, { 80, 10 }, { 50, 10 }, { 10, 10 } };
+	for (const auto& mix : mixes)
+	{
+		std::cout << mix[0] << "% find, " << mix[1] << "% range, " << 100 - mix[0] - mix[1] << "% insert / erase" << std::endl;
+		run<skiplist_map>("wait_free_skiplist_map", thread_count, key_count, ops, range_length, mix[0], mix[1]);
+		run<shared_mutex_map>("std::map + shared_mutex", thread_count, key_count, ops, range_length, mix[0], mix[1]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "wait_free_stack.hpp"
+
+//object cache pattern: every thread takes an object from the stack and gives one back, in bursts of a few
+//wait_free_stack with and without its elimination array against a std::vector behind a std::mutex,
+//at 1, 2, 4 ... up to the given thread count
+//usage: wait_free_stack_benchmark [--threads hardware threads] [--ops 1000000] [--burst 4]
+//	[--elimination -1 for half the hardware threads, 0 for off]
+
+using clock_type = std::chrono::steady_clock;
+
+static double run_threads(int64_t thread_count, const std::function<void(int64_t)>& body)
+{
+	std::atomic<int64_t> ready(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> threads;
+
+	for (int64_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			ready++;
+			while (!go)
+			{
+			}
+			body(i);
+		});
+	}
+
+	while (ready != thread_count)
+	{
+	}
+
+	auto start = clock_type::now();
+	go = true;
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+class treiber_stack
+{
+public:
+	explicit treiber_stack(int64_t elimination_width) :
+		m_stack(1024, elimination_width)
+	{
+	}
+
+	void push(int64_t value)
+	{
+		this->m_stack.push(value);
+	}
+
+	bool pop(int64_t& value)
+	{
+		return this->m_stack.pop(value);
+	}
+
+private:
+	wait_free_stack<int64_t> m_stack;
+};
+
+class mutex_stack
+{
+public:
+	explicit mutex_stack(int64_t)
+	{
+	}
+
+	void push(int64_t value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_stack.push_back(value);
+	}
+
+	bool pop(int64_t& value)
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		if (this->m_stack.empty())
+		{
+			return false;
+		}
+
+		value = this->m_stack.back();
+		this->m_stack.pop_back();
+		return true;
+	}
+
+private:
+	std::vector<int64_t>	m_stack;
+	std::mutex				m_mutex;
+};
+
+template<typename TStack>
+static void run(const char* name, int64_t thread_count, int64_t ops, int64_t burst, int64_t elimination_width)
+{
+	TStack stack(elimination_width);
+	for (int64_t i = 0; i < thread_count * burst; i++)
+	{
+		stack.push(i);
+	}
+
+	std::atomic<int64_t> missed(0);
+	double seconds = run_threads(thread_count, [&](int64_t)
+	{
+		std::vector<int64_t> held;
+		held.reserve(burst);
+		int64_t local_missed(0);
+
+		for (int64_t i = 0; i < ops; i += burst)
+		{
+			for (int64_t j = 0; j < burst; j++)
+			{
+				int64_t value(0);
+				if (stack.pop(value))
+				{
+					held.push_back(value);
+				}
+				else
+				{
+					local_missed++;
+				}
+			}
+
+			for (int64_t value : held)
+			{
+				stack.push(value);
+			}
+			held.clear();
+		}
+
+		missed += local_missed;
+	});
+
+	std::cout << "  " << name << ": " << static_cast<int64_t>(thread_count * ops * 2 / seconds / 1000) << " Kops/s";
+	if (missed != 0)
+	{
+		std::cout << ", empty pops " << missed;
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	int64_t max_threads = (std::max)(static_cast<int64_t>(std::thread::hardware_concurrency()), static_cast<int64_t>(1));
+	int64_t ops = 1000000;
+	int64_t burst = 4;
+	int64_t elimination_width = -1;
+
+	benchmark_options options("usage: wait_free_stack_benchmark [--threads hardware threads] [--ops 1000000] [--burst 4]\n"
+		"\t[--elimination -1 for half the hardware threads, 0 for off]");
+	options.add("--threads", max_threads);
+	options.add("--ops", ops);
+	options.add("--burst", burst);
+	options.add("--elimination", elimination_width, -1);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	std::cout << "max threads: " << max_threads << ", ops per thread: " << ops << ", burst: " << burst
+		<< ", elimination width: " << elimination_width << std::endl;
+
+	for (int64_t thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+	{
+		std::cout << "threads = " << thread_count << std::endl;
+		run<treiber_stack>("wait_free_stack, elimination", thread_count, ops, burst, elimination_width);
+		run<treiber_stack>("wait_free_stack, no elimination", thread_count, ops, burst, 0);
+		run<mutex_stack>("std::mutex stack", thread_count, ops, burst, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,543 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmark_options.hpp"
+#include "locked_containers.hpp"
+#include "wait_free_generic_queue.hpp"
+#include "wait_free_generic_vector.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_queue.hpp"
+#include "wait_free_trace.hpp"
+#include "wait_free_vector.hpp"
+
+//replays a recorded wait_free_trace against a chosen container configuration, for A/B runs of the same workload
+//usage: wait_free_trace_replay --trace file [--queue wait_free|generic|mutex] [--vector wait_free|generic|mutex]
+//	[--speed 1] [--repeat 1]
+//	wait_free_trace_replay --generate file [--threads 4] [--ops 100000]
+//
+//one replay thread per recorded thread, each issues its own records in order
+//--speed 1 keeps the recorded pacing, 2 replays twice as fast, 0 issues every record back to back
+//dequeue on an empty queue and get on an empty vector still count as operations, the trace is the call pattern
+//pool deallocate releases the oldest slot still allocated by the replay, it is skipped when there is none
+//--generate records a producer/consumer demo workload through the traced wrappers
+
+using clock_type = std::chrono::steady_clock;
+
+static const int32_t OP_COUNT = static_cast<int32_t>(wait_free_op::count);
+
+static const char* op_name(int32_t op)
+{
+	static const char* names[OP_COUNT] = { "enqueue", "dequeue", "push_back", "get", "allocate", "deallocate" };
+	return op >= 0 && op < OP_COUNT ? names[op] : "unknown";
+}
+
+static const char* kind_name(wait_free_trace_kind kind)
+{
+	switch (kind)
+	{
+	case wait_free_trace_kind::queue: return "queue";
+	case wait_free_trace_kind::vector: return "vector";
+	case wait_free_trace_kind::pool: return "pool";
+	default: return "unknown";
+	}
+}
+
+#pragma region(engines)
+struct payload
+{
+	int64_t		value;
+};
+
+//scratch space owned by one replay thread
+struct replay_context
+{
+	std::vector<int64_t>	values;
+	std::vector<payload>	payloads;
+	uint64_t				random;
+
+	int64_t next_random() noexcept
+	{
+		this->random ^= this->random << 13;
+		this->random ^= this->random >> 7;
+		this->random ^= this->random << 17;
+		return static_cast<int64_t>(this->random >> 1);
+	}
+};
+
+class replay_engine
+{
+public:
+	virtual ~replay_engine() = default;
+	virtual void execute(wait_free_op op, int64_t batch, replay_context& context) = 0;
+};
+
+class wait_free_queue_engine : public replay_engine
+{
+public:
+	void execute(wait_free_op op, int64_t batch, replay_context& context) override
+	{
+		context.values.resize(batch);
+		if (op == wait_free_op::enqueue)
+		{
+			if (batch == 1)
+			{
+				this->m_queue.enqueue(0);
+			}
+			else
+			{
+				this->m_queue.enqueue_range(context.values.begin(), context.values.end());
+			}
+		}
+		else if (op == wait_free_op::dequeue)
+		{
+			if (batch == 1)
+			{
+				this->m_queue.dequeue(context.values[0]);
+			}
+			else
+			{
+				auto it = context.values.begin();
+				this->m_queue.dequeue_range(it, context.values.end());
+			}
+		}
+	}
+
+private:
+	wait_free_queue<int64_t>	m_queue{ -1, 1024 };
+};
+
+class generic_queue_engine : public replay_engine
+{
+public:
+	void execute(wait_free_op op, int64_t batch, replay_context& context) override
+	{
+		context.payloads.resize(batch);
+		if (op == wait_free_op::enqueue)
+		{
+			if (batch == 1)
+			{
+				this->m_queue.enqueue(context.payloads[0]);
+			}
+			else
+			{
+				this->m_queue.enqueue_range(context.payloads.begin(), context.payloads.end());
+			}
+		}
+		else if (op == wait_free_op::dequeue)
+		{
+			if (batch == 1)
+			{
+				this->m_queue.dequeue(context.payloads[0]);
+			}
+			else
+			{
+				this->m_queue.dequeue_range(context.payloads.begin(), context.payloads.end());
+			}
+		}
+	}
+
+private:
+	wait_free_generic_queue<payload>	m_queue{ 1024 };
+};
+
+class locked_queue_engine : public replay_engine
+{
+public:
+	void execute(wait_free_op op, int64_t batch, replay_context& context) override
+	{
+		context.values.resize(batch);
+		if (op == wait_free_op::enqueue)
+		{
+			this->m_queue.enqueue_range(context.values.begin(), context.values.end());
+		}
+		else if (op == wait_free_op::dequeue)
+		{
+			this->m_queue.dequeue_range(context.values.data(), batch);
+		}
+	}
+
+private:
+	locked_deque<int64_t>	m_queue;
+};
+
+template<typename TVector, typename V>
+class vector_engine : public replay_engine
+{
+public:
+	template<typename ...TArgs>
+	explicit vector_engine(TArgs&&... args) :
+		m_vector(std::forward<TArgs>(args)...)
+	{
+	}
+
+	void execute(wait_free_op op, int64_t batch, replay_context& context) override
+	{
+		for (int64_t i = 0; i < batch; i++)
+		{
+			V value{};
+			if (op == wait_free_op::push_back)
+			{
+				this->m_vector.push_back(value);
+			}
+			else if (op == wait_free_op::get)
+			{
+				int64_t size = static_cast<int64_t>(this->m_vector.size());
+				if (size > 0)
+				{
+					this->m_vector.get(context.next_random() % size, value);
+				}
+			}
+		}
+	}
+
+private:
+	TVector		m_vector;
+};
+
+class pool_engine : public replay_engine
+{
+	using iterator = wait_free_memory_pool<payload>::iterator;
+
+public:
+	void execute(wait_free_op op, int64_t batch, replay_context&) override
+	{
+		for (int64_t i = 0; i < batch; i++)
+		{
+			if (op == wait_free_op::allocate)
+			{
+				iterator it = this->m_pool.allocate();
+				this->m_allocated.enqueue(it.offset());
+			}
+			else if (op == wait_free_op::deallocate)
+			{
+				int64_t offset(-1);
+				if (this->m_allocated.dequeue(offset) != -1)
+				{
+					this->m_pool.deallocate(this->m_pool.get(offset));
+				}
+			}
+		}
+	}
+
+private:
+	wait_free_memory_pool<payload>	m_pool{ 1024 };
+	wait_free_queue<int64_t>		m_allocated{ -1, 1024 };
+};
+
+static std::unique_ptr<replay_engine> make_engine(wait_free_trace_kind kind, const std::string& queue_engine, const std::string& vector_engine_name)
+{
+	switch (kind)
+	{
+	case wait_free_trace_kind::queue:
+		if (queue_engine == "wait_free") return std::make_unique<wait_free_queue_engine>();
+		if (queue_engine == "generic") return std::make_unique<generic_queue_engine>();
+		if (queue_engine == "mutex") return std::make_unique<locked_queue_engine>();
+		break;
+
+	case wait_free_trace_kind::vector:
+		if (vector_engine_name == "wait_free") return std::make_unique<vector_engine<wait_free_vector<int64_t>, int64_t>>(-1, 1024);
+		if (vector_engine_name == "generic") return std::make_unique<vector_engine<wait_free_generic_vecotor<payload>, payload>>(1024);
+		if (vector_engine_name == "mutex") return std::make_unique<vector_engine<locked_vector<int64_t>, int64_t>>();
+		break;
+
+	case wait_free_trace_kind::pool:
+		return std::make_unique<pool_engine>();
+
+	default:
+		break;
+	}
+
+	return nullptr;
+}
+#pragma endregion
+
+#pragma region(replay)
+struct replay_result
+{
+	double										seconds;
+	double										lag_ms;
+	std::vector<wait_free_latency_histogram>	histograms;
+};
+
+static replay_result replay(const wait_free_trace& trace, std::vector<std::unique_ptr<replay_engine>>& engines, double speed)
+{
+	int32_t thread_count(0);
+	for (auto& r : trace.records)
+	{
+		thread_count = (std::max)(thread_count, r.thread + 1);
+	}
+
+	std::vector<std::vector<const wait_free_trace_record*>> per_thread(thread_count);
+	for (auto& r : trace.records)
+	{
+		per_thread[r.thread].push_back(&r);
+	}
+
+	int64_t histogram_count = static_cast<int64_t>(trace.containers.size()) * OP_COUNT;
+	std::vector<std::vector<wait_free_latency_histogram>> histograms(thread_count, std::vector<wait_free_latency_histogram>(histogram_count));
+	std::vector<int64_t> lag_ns(thread_count, 0);
+	std::atomic<int32_t> ready(0);
+	std::atomic<bool> go(false);
+	int64_t first_ns = trace.records.empty() ? 0 : trace.records.front().timestamp_ns;
+	clock_type::time_point start;
+
+	std::vector<std::thread> threads;
+	for (int32_t t = 0; t < thread_count; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			replay_context context{ {}, {}, 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(t + 1) };
+			ready++;
+			while (!go.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+
+			for (const wait_free_trace_record* r : per_thread[t])
+			{
+				if (speed > 0)
+				{
+					auto due = start + std::chrono::nanoseconds(static_cast<int64_t>((r->timestamp_ns - first_ns) / speed));
+					while (clock_type::now() < due)
+					{
+						std::this_thread::yield();
+					}
+
+					//how far behind the recorded schedule this thread fell, the engine under test couldn't keep up
+					lag_ns[t] = (std::max)(lag_ns[t], static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - due).count()));
+				}
+
+				if (r->op < 0 || r->op >= OP_COUNT || r->container < 0 || r->container >= static_cast<int32_t>(engines.size()))
+				{
+					continue;
+				}
+
+				int64_t op_start = wait_free_latency_clock::now();
+				engines[r->container]->execute(static_cast<wait_free_op>(r->op), (std::max)(r->batch, 1), context);
+				histograms[t][r->container * OP_COUNT + r->op].record(wait_free_latency_clock::now() - op_start);
+			}
+		});
+	}
+
+	while (ready.load() != thread_count)
+	{
+		std::this_thread::yield();
+	}
+
+	start = clock_type::now();
+	go.store(true, std::memory_order_release);
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	replay_result ret;
+	ret.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	ret.lag_ms = lag_ns.empty() ? 0.0 : *std::max_element(lag_ns.begin(), lag_ns.end()) / 1e6;
+	ret.histograms.resize(histogram_count);
+	for (auto& thread_histograms : histograms)
+	{
+		for (int64_t i = 0; i < histogram_count; i++)
+		{
+			ret.histograms[i].merge(thread_histograms[i]);
+		}
+	}
+
+	return ret;
+}
+#pragma endregion
+
+#pragma region(generate)
+//producers push jobs in bursts and log them, consumers drain jobs with scratch buffers from the pool
+static wait_free_trace generate(int64_t thread_count, int64_t ops)
+{
+	wait_free_trace_recorder recorder;
+	traced_queue<wait_free_queue<int64_t>> jobs(recorder, "jobs", -1, 1024);
+	traced_vector<wait_free_vector<int64_t>> log(recorder, "log", -1, 1024);
+	traced_pool<wait_free_memory_pool<payload>> buffers(recorder, "buffers", 1024);
+
+	int64_t producers = (std::max)(thread_count / 2, static_cast<int64_t>(1));
+	int64_t consumers = (std::max)(thread_count - producers, static_cast<int64_t>(1));
+	std::atomic<int64_t> consumed(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t t = 0; t < producers + consumers; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			uint64_t random = 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(t + 1);
+			auto next_random = [&]()
+			{
+				random ^= random << 13;
+				random ^= random >> 7;
+				random ^= random << 17;
+				return static_cast<int64_t>(random >> 1);
+			};
+
+			if (t < producers)
+			{
+				int64_t count = ops / producers + (t < ops % producers ? 1 : 0);
+				std::vector<int64_t> burst;
+				for (int64_t i = 0; i < count; i += static_cast<int64_t>(burst.size()))
+				{
+					burst.assign((std::min)(count - i, next_random() % 16 + 1), i);
+					if (burst.size() == 1)
+					{
+						jobs.enqueue(burst[0]);
+					}
+					else
+					{
+						jobs.enqueue_range(burst.begin(), burst.end());
+					}
+					log.push_back(i);
+
+					//bursty arrivals, so the replay has idle gaps to reproduce
+					if (next_random() % 64 == 0)
+					{
+						std::this_thread::sleep_for(std::chrono::microseconds(50));
+					}
+				}
+				return;
+			}
+
+			std::vector<int64_t> batch(8);
+			while (consumed.load(std::memory_order_relaxed) < ops)
+			{
+				auto it = batch.begin();
+				if (jobs.dequeue_range(it, batch.end()) == -1)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				int64_t taken = it - batch.begin();
+				consumed += taken;
+				for (int64_t i = 0; i < taken; i++)
+				{
+					auto buffer = buffers.allocate();
+					int64_t value(0);
+					int64_t size = static_cast<int64_t>(log.size());
+					if (size > 0)
+					{
+						log.get(next_random() % size, value);
+					}
+					buffers.deallocate(buffer);
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	return recorder.take();
+}
+#pragma endregion
+
+int main(int argc, char* argv[])
+{
+	std::string trace_path;
+	std::string generate_path;
+	std::string queue_engine = "wait_free";
+	std::string vector_engine_name = "wait_free";
+	double speed = 1.0;
+	int64_t repeat = 1;
+	int64_t threads = 4;
+	int64_t ops = 100000;
+
+	benchmark_options options("usage: wait_free_trace_replay --trace file [--queue wait_free|generic|mutex] [--vector wait_free|generic|mutex]\n"
+		"\t[--speed 1] [--repeat 1]\n"
+		"\twait_free_trace_replay --generate file [--threads 4] [--ops 100000]");
+	options.add("--trace", trace_path);
+	options.add("--generate", generate_path);
+	options.add("--queue", queue_engine);
+	options.add("--vector", vector_engine_name);
+	options.add("--speed", speed, 0.0);
+	options.add("--repeat", repeat);
+	options.add("--threads", threads);
+	options.add("--ops", ops);
+	if (int ret = options.parse(argc, argv); ret >= 0)
+	{
+		return ret;
+	}
+
+	if (threads > wait_free_trace::MAX_THREADS)
+	{
+		std::cerr << "--threads takes at most " << wait_free_trace::MAX_THREADS << std::endl;
+		return 1;
+	}
+
+	if (!generate_path.empty())
+	{
+		wait_free_trace trace = generate(threads, ops);
+		if (!trace.save(generate_path))
+		{
+			std::cerr << "can't write " << generate_path << std::endl;
+			return 1;
+		}
+
+		std::cerr << "recorded " << trace.records.size() << " operations on " << trace.containers.size() << " containers to " << generate_path << std::endl;
+		return 0;
+	}
+
+	wait_free_trace trace;
+	if (trace_path.empty() || !trace.load(trace_path))
+	{
+		std::cerr << "can't read trace " << trace_path << ", pass --trace file or record one with --generate file" << std::endl;
+		return 1;
+	}
+
+	for (int64_t run = 0; run < repeat; run++)
+	{
+		std::vector<std::unique_ptr<replay_engine>> engines;
+		for (auto& container : trace.containers)
+		{
+			engines.push_back(make_engine(container.kind, queue_engine, vector_engine_name));
+			if (!engines.back())
+			{
+				std::cerr << "unknown engine for " << kind_name(container.kind) << " " << container.name << std::endl;
+				return 1;
+			}
+		}
+
+		replay_result result = replay(trace, engines, speed);
+		std::cout << "run " << run << " queue=" << queue_engine << " vector=" << vector_engine_name << " speed=" << speed
+			<< ": " << std::fixed << std::setprecision(3) << result.seconds << " s, max lag " << result.lag_ms << " ms\n";
+
+		std::cout << std::left << std::setw(24) << "container" << std::setw(12) << "op" << std::right
+			<< std::setw(12) << "count" << std::setw(10) << "p50_ns" << std::setw(10) << "p99_ns"
+			<< std::setw(10) << "p999_ns" << std::setw(12) << "max_ns" << '\n';
+
+		for (size_t c = 0; c < trace.containers.size(); c++)
+		{
+			for (int32_t op = 0; op < OP_COUNT; op++)
+			{
+				wait_free_latency_summary s = result.histograms[c * OP_COUNT + op].summary();
+				if (s.count == 0)
+				{
+					continue;
+				}
+
+				std::string name = std::string(kind_name(trace.containers[c].kind)) + ":" + trace.containers[c].name;
+				std::cout << std::left << std::setw(24) << name << std::setw(12) << op_name(op) << std::right
+					<< std::setw(12) << s.count << std::setw(10) << s.p50_ns << std::setw(10) << s.p99_ns
+					<< std::setw(10) << s.p999_ns << std::setw(12) << s.max_ns << '\n';
+			}
+		}
+	}
+
+	return 0;
+}
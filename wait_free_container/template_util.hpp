@@ -1,6 +1,10 @@
 #pragma once
 #include <atomic>
 #include <thread>
+#include <type_traits>
+
+#include "wait_free_events.hpp"
+#include "wait_free_stats.hpp"
 
 #pragma region(select_type)
 template <bool, typename T1, typename T2>
@@ -21,10 +25,30 @@ struct select_type<false, T1, T2>
 };
 #pragma endregion
 
+#pragma region(trivially_relocatable)
+//storage that may be moved with memcpy, then used at the new address without running a constructor or destructor
+//trivially copyable types are, a type made of atomics can say so with using wait_free_trivially_relocatable = std::true_type
+template <typename T, typename = void>
+struct wait_free_is_trivially_relocatable : std::is_trivially_copyable<T>
+{
+};
+
+template <typename T>
+struct wait_free_is_trivially_relocatable<T, std::void_t<typename T::wait_free_trivially_relocatable>> : T::wait_free_trivially_relocatable
+{
+};
+
+template <typename T>
+inline constexpr bool wait_free_is_trivially_relocatable_v = wait_free_is_trivially_relocatable<T>::value;
+#pragma endregion
+
 #pragma region(mutex_check_template)
-template<typename TCount, typename ...TMutex>
-TCount mutex_check_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
+//the TStats overloads count every yield spent waiting on the gate, the plain ones forward with the disabled policy
+//with WAIT_FREE_ENABLE_EVENTS on every wait is also recorded as a gate_wait event
+template<typename TStats, typename TCount, typename ...TMutex>
+auto mutex_check_weak(const TStats& stats, std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) -> std::enable_if_t<is_wait_free_stats_v<TStats>, TCount>
 {
+	wait_free_events::wait gate(wait_free_event::gate_wait, &count);
 	TCount ret = count;
 
 	while (true)
@@ -38,7 +62,9 @@ TCount mutex_check_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mute
 
 			while (true)
 			{
+				gate.tick();
 				std::this_thread::yield();
+				stats.add(wait_free_stat::yield);
 				TCount new_mutex_total = (0 + ... + mutex);
 				if (new_mutex_total < old_mutex_count)
 				{
@@ -56,15 +82,24 @@ TCount mutex_check_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mute
 }
 
 template<typename TCount, typename ...TMutex>
-TCount mutex_check_strong(std::atomic<TCount>& count, std::atomic<TMutex>&...mutex)
+TCount mutex_check_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
 {
+	return mutex_check_weak(wait_free_stats_policy<false>(), count, mutex...);
+}
+
+template<typename TStats, typename TCount, typename ...TMutex>
+auto mutex_check_strong(const TStats& stats, std::atomic<TCount>& count, std::atomic<TMutex>&...mutex) -> std::enable_if_t<is_wait_free_stats_v<TStats>, TCount>
+{
+	wait_free_events::wait gate(wait_free_event::gate_wait, &count);
 	TCount ret = count++;
 	while (true)
 	{
 		TCount old_mutex_count = (0 + ... + mutex);
 		if (old_mutex_count)
 		{
+			gate.tick();
 			std::this_thread::yield();
+			stats.add(wait_free_stat::yield);
 		}
 		else
 		{
@@ -76,8 +111,15 @@ TCount mutex_check_strong(std::atomic<TCount>& count, std::atomic<TMutex>&...mut
 }
 
 template<typename TCount, typename ...TMutex>
-TCount mutex_check_cas_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
+TCount mutex_check_strong(std::atomic<TCount>& count, std::atomic<TMutex>&...mutex)
 {
+	return mutex_check_strong(wait_free_stats_policy<false>(), count, mutex...);
+}
+
+template<typename TStats, typename TCount, typename ...TMutex>
+auto mutex_check_cas_weak(const TStats& stats, std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) -> std::enable_if_t<is_wait_free_stats_v<TStats>, TCount>
+{
+	wait_free_events::wait gate(wait_free_event::gate_wait, &count);
 	TCount ret = count;
 	while (true)
 	{
@@ -90,7 +132,9 @@ TCount mutex_check_cas_weak(std::atomic<TCount>& count, std::atomic<TMutex>&...
 
 			while (true)
 			{
+				gate.tick();
 				std::this_thread::yield();
+				stats.add(wait_free_stat::yield);
 				TCount new_mutex_total = (0 + ... + mutex);
 				if (new_mutex_total < old_mutex_count)
 				{
@@ -108,13 +152,22 @@ TCount mutex_check_cas_weak(std::atomic<TCount>& count, std::atomic<TMutex>&...
 }
 
 template<typename TCount, typename ...TMutex>
-void mutex_check_cas_lock_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
+TCount mutex_check_cas_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
 {
+	return mutex_check_cas_weak(wait_free_stats_policy<false>(), count, mutex...);
+}
+
+template<typename TStats, typename TCount, typename ...TMutex>
+auto mutex_check_cas_lock_weak(const TStats& stats, std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) -> std::enable_if_t<is_wait_free_stats_v<TStats>>
+{
+	wait_free_events::wait gate(wait_free_event::gate_wait, &count);
 	while (true)
 	{
 		while (count.exchange(true))
 		{
+			gate.tick();
 			std::this_thread::yield();
+			stats.add(wait_free_stat::yield);
 		}
 
 		TCount old_mutex_count = (0 + ... + mutex);
@@ -124,7 +177,9 @@ void mutex_check_cas_lock_weak(std::atomic<TCount>& count, std::atomic<TMutex>&.
 
 			while (true)
 			{
+				gate.tick();
 				std::this_thread::yield();
+				stats.add(wait_free_stat::yield);
 				TCount new_mutex_total = (0 + ... + mutex);
 				if (new_mutex_total < old_mutex_count)
 				{
@@ -140,11 +195,20 @@ void mutex_check_cas_lock_weak(std::atomic<TCount>& count, std::atomic<TMutex>&.
 }
 
 template<typename TCount, typename ...TMutex>
-void mutex_check_cas_lock_strong(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) 
+void mutex_check_cas_lock_weak(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex)
 {
+	mutex_check_cas_lock_weak(wait_free_stats_policy<false>(), count, mutex...);
+}
+
+template<typename TStats, typename TCount, typename ...TMutex>
+auto mutex_check_cas_lock_strong(const TStats& stats, std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) -> std::enable_if_t<is_wait_free_stats_v<TStats>>
+{
+	wait_free_events::wait gate(wait_free_event::gate_wait, &count);
 	while (count.exchange(true))
 	{
+		gate.tick();
 		std::this_thread::yield();
+		stats.add(wait_free_stat::yield);
 	}
 
 	while (true)
@@ -152,7 +216,9 @@ void mutex_check_cas_lock_strong(std::atomic<TCount>& count, std::atomic<TMutex>
 		TCount old_mutex_count = (0 + ... + mutex);
 		if (old_mutex_count)
 		{
+			gate.tick();
 			std::this_thread::yield();
+			stats.add(wait_free_stat::yield);
 		}
 		else
 		{
@@ -161,4 +227,10 @@ void mutex_check_cas_lock_strong(std::atomic<TCount>& count, std::atomic<TMutex>
 	}
 }
 
+template<typename TCount, typename ...TMutex>
+void mutex_check_cas_lock_strong(std::atomic<TCount>& count, std::atomic<TMutex>&... mutex) 
+{
+	mutex_check_cas_lock_strong(wait_free_stats_policy<false>(), count, mutex...);
+}
+
 #pragma endregion
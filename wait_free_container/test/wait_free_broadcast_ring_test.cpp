@@ -0,0 +1,190 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wait_free_broadcast_ring.hpp"
+
+//regression tests for wait_free_broadcast_ring, exits non zero on the first failed check
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+using clock_type = std::chrono::steady_clock;
+
+//producers that ran with no consumer must not keep a gate that lets them lap a consumer added afterwards
+static void consumer_added_after_wrap()
+{
+	const int64_t capacity = 4;
+	const int64_t count = 8;
+
+	wait_free_broadcast_ring<int64_t> ring(capacity);
+	for (int64_t i = 0; i < count; i++)
+	{
+		ring.publish(i);
+	}
+
+	int64_t consumer = ring.add_consumer();
+	CHECK(consumer >= 0);
+	CHECK(ring.cursor(consumer) == count);
+
+	std::thread producer([&]()
+	{
+		for (int64_t i = 0; i < count; i++)
+		{
+			ring.publish(count + i);
+		}
+	});
+
+	//give the producer time to run ahead, it has to stop once the ring is full
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(ring.claimed() <= count + capacity + 1);
+
+	std::vector<int64_t> received;
+	auto deadline = clock_type::now() + std::chrono::seconds(10);
+	while (static_cast<int64_t>(received.size()) < count && clock_type::now() < deadline)
+	{
+		int64_t consumed = ring.consume(consumer, [&](const int64_t& value, int64_t sequence)
+		{
+			CHECK(value == sequence);
+			received.push_back(value);
+		});
+
+		if (consumed == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	producer.join();
+
+	CHECK(static_cast<int64_t>(received.size()) == count);
+	for (int64_t i = 0; i < count; i++)
+	{
+		CHECK(received[i] == count + i);
+	}
+}
+
+//a consumer removed and added again starts at the claim and sees everything after it
+static void consumer_readded()
+{
+	wait_free_broadcast_ring<int64_t> ring(4);
+	int64_t consumer = ring.add_consumer();
+	CHECK(consumer >= 0);
+
+	for (int64_t i = 0; i < 4; i++)
+	{
+		ring.publish(i);
+	}
+	CHECK(ring.consume(consumer, [](const int64_t&, int64_t) {}) == 4);
+
+	ring.remove_consumer(consumer);
+	for (int64_t i = 4; i < 12; i++)
+	{
+		ring.publish(i);
+	}
+
+	consumer = ring.add_consumer();
+	CHECK(consumer >= 0);
+	std::thread producer([&]()
+	{
+		for (int64_t i = 12; i < 20; i++)
+		{
+			ring.publish(i);
+		}
+	});
+
+	int64_t expected(12);
+	auto deadline = clock_type::now() + std::chrono::seconds(10);
+	while (expected < 20 && clock_type::now() < deadline)
+	{
+		ring.consume(consumer, [&](const int64_t& value, int64_t)
+		{
+			CHECK(value == expected);
+			expected++;
+		});
+	}
+
+	producer.join();
+	CHECK(expected == 20);
+}
+
+//lossy producers lapping each other through claim and commit, with ranges up to the whole ring,
+//must neither deadlock on each other's slots nor let a consumer read a value under another sequence
+static void lossy_claim_commit()
+{
+	const int64_t capacity = 8;
+	const int64_t producer_count = 4;
+	const int64_t rounds = 20000;
+
+	wait_free_broadcast_ring<int64_t> ring(capacity, 8, true);
+	int64_t consumer = ring.add_consumer();
+	CHECK(consumer >= 0);
+
+	std::atomic<int64_t> producers_done(0);
+	std::vector<std::thread> producers;
+	for (int64_t p = 0; p < producer_count; p++)
+	{
+		producers.emplace_back([&, p]()
+		{
+			for (int64_t i = 0; i < rounds; i++)
+			{
+				int64_t count = (i + p) % capacity + 1;
+				int64_t sequence = ring.claim(count);
+				for (int64_t k = 0; k < count; k++)
+				{
+					ring[sequence + k] = sequence + k;
+				}
+				ring.commit(sequence, count);
+			}
+			producers_done++;
+		});
+	}
+
+	int64_t bad(0);
+	int64_t last(-1);
+	auto deadline = clock_type::now() + std::chrono::seconds(60);
+	while (producers_done.load(std::memory_order_acquire) != producer_count && clock_type::now() < deadline)
+	{
+		if (ring.consume(consumer, [&](const int64_t& value, int64_t sequence)
+		{
+			if (value != sequence || sequence <= last)
+			{
+				bad++;
+			}
+			last = sequence;
+		}) == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	for (auto& th : producers)
+	{
+		th.join();
+	}
+
+	CHECK(bad == 0);
+	CHECK(ring.claimed() >= producer_count * rounds);
+}
+
+int main()
+{
+	consumer_added_after_wrap();
+	consumer_readded();
+	lossy_claim_commit();
+
+	std::cout << "wait_free_broadcast_ring_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wait_free_cache.hpp"
+
+//regression tests for wait_free_cache, exits non zero on the first failed check
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+//every key in one bucket under one tag, so the bucket fills up and every lookup has to compare keys
+struct same_bucket_hash
+{
+	size_t operator()(int64_t) const noexcept
+	{
+		return 0;
+	}
+};
+
+//replacing a cached key and an insert into a full bucket must leave the other entries alone
+static void full_cache_keeps_entries()
+{
+	wait_free_cache<int64_t, int64_t, same_bucket_hash> cache(8);
+	for (int64_t key = 0; key < 8; key++)
+	{
+		CHECK(cache.insert(key, key * 10));
+	}
+	CHECK(cache.size() == 8);
+
+	CHECK(cache.insert(3, 31));
+	CHECK(!cache.insert(8, 80));
+	CHECK(cache.size() == 8);
+
+	for (int64_t key = 0; key < 8; key++)
+	{
+		int64_t value(0);
+		CHECK(cache.find(key, value));
+		CHECK(value == (key == 3 ? 31 : key * 10));
+	}
+	CHECK(!cache.contains(8));
+
+	wait_free_cache_stats stats = cache.cache_stats();
+	CHECK(stats.evictions == 0);
+	CHECK(stats.rejected == 1);
+
+	CHECK(cache.erase(3));
+	CHECK(!cache.contains(3));
+	CHECK(cache.insert(8, 80));
+	CHECK(cache.contains(8));
+	CHECK(cache.size() == 8);
+}
+
+//threads insert, replace and erase the same few keys, a key indexed twice would outlive its erase
+static void same_key_inserts()
+{
+	const int64_t thread_count = 4;
+	const int64_t key_count = 16;
+	const int64_t rounds = 20000;
+
+	wait_free_cache<int64_t, int64_t> cache(1024);
+	std::atomic<int64_t> bad_reads(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t t = 0; t < thread_count; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int64_t i = 0; i < rounds; i++)
+			{
+				int64_t key = (i * 7 + t) % key_count;
+				if (i % 5 == 4)
+				{
+					cache.erase(key);
+					continue;
+				}
+
+				CHECK(cache.insert(key, key * 1000 + t));
+
+				int64_t value(0);
+				if (cache.find(key, value) && (value % 1000 >= thread_count || value / 1000 != key))
+				{
+					bad_reads++;
+				}
+			}
+		});
+	}
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	CHECK(bad_reads == 0);
+	CHECK(static_cast<int64_t>(cache.size()) <= key_count);
+	CHECK(cache.cache_stats().evictions == 0);
+
+	for (int64_t key = 0; key < key_count; key++)
+	{
+		cache.erase(key);
+		CHECK(!cache.contains(key));
+	}
+	CHECK(cache.size() == 0);
+}
+
+int main()
+{
+	full_cache_keeps_entries();
+	same_key_inserts();
+
+	std::cout << "wait_free_cache_test passed" << std::endl;
+	return 0;
+}
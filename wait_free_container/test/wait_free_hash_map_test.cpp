@@ -0,0 +1,166 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wait_free_hash_map.hpp"
+
+//regression tests for wait_free_hash_map, exits non zero on the first failed check
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+static int64_t value_of(int64_t key, int64_t round)
+{
+	return key * 4 + round + 1;
+}
+
+//writers grow the map from its minimum through many migrations while updating and erasing their own keys,
+//readers must only ever see a value some round wrote for the key, and no key may be lost or doubled on the way
+static void migration_under_writes()
+{
+	const int64_t writer_count = 4;
+	const int64_t reader_count = 2;
+	const int64_t key_count = 100000;
+
+	wait_free_hash_map<int64_t, int64_t> map(0, 0, -1);
+	std::atomic<int64_t> writers_done(0);
+	std::atomic<int64_t> bad_reads(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t w = 0; w < writer_count; w++)
+	{
+		threads.emplace_back([&, w]()
+		{
+			for (int64_t key = w + 1; key <= key_count; key += writer_count)
+			{
+				CHECK(map.insert(key, value_of(key, 0)));
+				CHECK(!map.insert(key, value_of(key, 0)));
+			}
+
+			for (int64_t key = w + 1; key <= key_count; key += writer_count)
+			{
+				CHECK(map.update(key, value_of(key, 1)));
+				if (key % 3 == 0)
+				{
+					int64_t erased(0);
+					CHECK(map.erase(key, &erased));
+					CHECK(erased == value_of(key, 1));
+				}
+			}
+
+			//the erased keys come back, into tombstones or slots of a later table
+			for (int64_t key = w + 1; key <= key_count; key += writer_count)
+			{
+				if (key % 3 == 0)
+				{
+					CHECK(map.insert(key, value_of(key, 2)));
+				}
+			}
+
+			writers_done++;
+		});
+	}
+
+	for (int64_t r = 0; r < reader_count; r++)
+	{
+		threads.emplace_back([&, r]()
+		{
+			int64_t key = r + 1;
+			while (writers_done.load(std::memory_order_acquire) != writer_count)
+			{
+				int64_t value(0);
+				if (map.find(key, value) && value != value_of(key, 0) && value != value_of(key, 1) && value != value_of(key, 2))
+				{
+					bad_reads++;
+				}
+
+				key = key % key_count + 1;
+			}
+		});
+	}
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	CHECK(bad_reads == 0);
+	CHECK(static_cast<int64_t>(map.size()) == key_count);
+	for (int64_t key = 1; key <= key_count; key++)
+	{
+		int64_t value(0);
+		CHECK(map.find(key, value));
+		CHECK(value == value_of(key, key % 3 == 0 ? 2 : 1));
+	}
+	CHECK(map.memory_usage().growth_count > 0);
+}
+
+//threads insert fresh keys and erase them a window later, so tombstones keep filling the table and it keeps being
+//rebuilt at the same size, the replaced tables have to be freed rather than pile up
+static void tombstone_churn()
+{
+	const int64_t thread_count = 4;
+	const int64_t window = 64;
+	const int64_t rounds = 100000;
+
+	wait_free_hash_map<int64_t, int64_t> map(0, 0, -1);
+	std::atomic<int64_t> peak_reserved(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t t = 0; t < thread_count; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int64_t i = 0; i < rounds; i++)
+			{
+				int64_t key = i * thread_count + t + 1;
+				CHECK(map.insert(key, key));
+				if (i >= window)
+				{
+					CHECK(map.erase(key - window * thread_count));
+				}
+
+				if (i % 1000 == 0)
+				{
+					int64_t reserved = map.memory_usage().reserved_bytes;
+					int64_t peak = peak_reserved.load(std::memory_order_relaxed);
+					while (reserved > peak && !peak_reserved.compare_exchange_weak(peak, reserved))
+					{
+					}
+				}
+			}
+		});
+	}
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	CHECK(static_cast<int64_t>(map.size()) == thread_count * window);
+	CHECK(map.memory_usage().growth_count > 100);
+
+	//a few tables of twice the live keys, whatever the number of rebuilds
+	CHECK(peak_reserved < 256 * 1024);
+	CHECK(map.memory_usage().reserved_bytes < 256 * 1024);
+}
+
+int main()
+{
+	migration_under_writes();
+	tombstone_churn();
+
+	std::cout << "wait_free_hash_map_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,278 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wait_free_record_ring.hpp"
+
+//regression tests for wait_free_record_ring, exits non zero on the first failed check
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+using clock_type = std::chrono::steady_clock;
+
+//a header landing on an earlier lap's payload must not pass for committed because the payload held its sequence
+static void stale_payload_header()
+{
+	wait_free_record_ring<> ring(64);
+
+	//one 48 byte record fills the lap, its payload covers offset 16 where the second record of the next lap goes
+	int64_t payload[6] = { 64 + 16 + 1, 0, 0, 0, 0, 0 };
+	CHECK(ring.write(payload, sizeof(payload)));
+
+	wait_free_record_ring<>::record rec;
+	CHECK(ring.read(rec));
+	ring.release(rec);
+
+	CHECK(ring.write(payload, 0));
+	CHECK(ring.read(rec));
+	CHECK(rec.position == 64);
+	ring.release(rec);
+
+	wait_free_record_ring<>::reservation res;
+	CHECK(ring.reserve(8, res));
+	CHECK(res.position == 64 + 16);
+	CHECK(!ring.read(rec));
+
+	ring.commit(res);
+	CHECK(ring.read(rec));
+	CHECK(rec.position == res.position && rec.size == 8);
+	ring.release(rec);
+}
+
+//payloads laid out as committed headers of the next lap, a consumer racing a reservation into those bytes must not
+//take one for a record, every real record is at least 16 bytes, the forged ones are empty
+static void forged_headers_under_load()
+{
+	const int64_t capacity = 256;
+	const int64_t thread_count = 2;
+	const int64_t count = 50000;
+
+	wait_free_record_ring<> ring(capacity);
+	std::atomic<int64_t> producers_done(0);
+	std::atomic<int64_t> consumed(0);
+	std::atomic<int64_t> forged(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t p = 0; p < thread_count; p++)
+	{
+		threads.emplace_back([&, p]()
+		{
+			for (int64_t i = 0; i < count; i++)
+			{
+				int64_t size = 16 * ((p + i) % 6 + 1);
+
+				wait_free_record_ring<>::reservation res;
+				while (!ring.reserve(size, res))
+				{
+					std::this_thread::yield();
+				}
+
+				//a header is 16 bytes, the payload starts right after the record's own
+				int64_t* words = static_cast<int64_t*>(res.data);
+				for (int64_t w = 0; w < size / 8; w += 2)
+				{
+					words[w] = res.position + 16 + w * 8 + capacity + 1;
+					words[w + 1] = 0;
+				}
+
+				ring.commit(res);
+			}
+			producers_done++;
+		});
+	}
+
+	for (int64_t c = 0; c < thread_count; c++)
+	{
+		threads.emplace_back([&]()
+		{
+			auto deadline = clock_type::now() + std::chrono::seconds(60);
+			while (clock_type::now() < deadline)
+			{
+				bool done = producers_done.load(std::memory_order_acquire) == thread_count;
+
+				wait_free_record_ring<>::record rec;
+				if (!ring.read(rec))
+				{
+					if (done && ring.empty())
+					{
+						break;
+					}
+					std::this_thread::yield();
+					continue;
+				}
+
+				const int64_t* words = static_cast<const int64_t*>(rec.data);
+				if (rec.size < 16 || words[0] != rec.position + 16 + capacity + 1)
+				{
+					forged++;
+				}
+				consumed++;
+
+				ring.release(rec);
+			}
+		});
+	}
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	CHECK(forged == 0);
+	CHECK(consumed == thread_count * count);
+	CHECK(ring.size() == 0);
+}
+
+struct record_prefix
+{
+	int64_t		producer;
+	int64_t		index;
+};
+
+static uint8_t fill_of(int64_t producer, int64_t index, int64_t offset)
+{
+	return static_cast<uint8_t>(producer * 131 + index * 31 + offset);
+}
+
+//producers write records of varying size, padding laps included, consumers check every byte and release in batches
+static void mpmc_payload_integrity()
+{
+	const int64_t producer_count = 3;
+	const int64_t consumer_count = 3;
+	const int64_t count = 20000;
+	const int64_t batch = 4;
+
+	wait_free_record_ring<> ring(1024);
+	std::atomic<int64_t> producers_done(0);
+	std::atomic<int64_t> consumed(0);
+	std::atomic<int64_t> corrupt(0);
+
+	std::vector<std::thread> threads;
+	for (int64_t p = 0; p < producer_count; p++)
+	{
+		threads.emplace_back([&, p]()
+		{
+			for (int64_t i = 0; i < count; i++)
+			{
+				int64_t size = static_cast<int64_t>(sizeof(record_prefix)) + (p * 7 + i * 13) % 200;
+
+				wait_free_record_ring<>::reservation res;
+				while (!ring.reserve(size, res))
+				{
+					std::this_thread::yield();
+				}
+
+				uint8_t* data = static_cast<uint8_t*>(res.data);
+				record_prefix prefix{ p, i };
+				memcpy(data, &prefix, sizeof(prefix));
+				for (int64_t offset = sizeof(prefix); offset < size; offset++)
+				{
+					data[offset] = fill_of(p, i, offset);
+				}
+
+				ring.commit(res);
+			}
+			producers_done++;
+		});
+	}
+
+	for (int64_t c = 0; c < consumer_count; c++)
+	{
+		threads.emplace_back([&]()
+		{
+			std::vector<int64_t> last(producer_count, -1);
+			std::vector<wait_free_record_ring<>::record> held;
+			int64_t local_consumed(0);
+			int64_t local_corrupt(0);
+
+			auto deadline = clock_type::now() + std::chrono::seconds(60);
+			while (clock_type::now() < deadline)
+			{
+				bool done = producers_done.load(std::memory_order_acquire) == producer_count;
+
+				wait_free_record_ring<>::record rec;
+				if (!ring.read(rec))
+				{
+					ring.release(held.data(), static_cast<int64_t>(held.size()));
+					held.clear();
+
+					if (done && ring.empty())
+					{
+						break;
+					}
+					std::this_thread::yield();
+					continue;
+				}
+
+				record_prefix prefix{};
+				const uint8_t* data = static_cast<const uint8_t*>(rec.data);
+				bool ok = rec.size >= static_cast<int64_t>(sizeof(prefix));
+				if (ok)
+				{
+					memcpy(&prefix, data, sizeof(prefix));
+					ok = prefix.producer >= 0 && prefix.producer < producer_count && prefix.index > last[prefix.producer]
+						&& rec.size == static_cast<int64_t>(sizeof(prefix)) + (prefix.producer * 7 + prefix.index * 13) % 200;
+				}
+
+				for (int64_t offset = sizeof(prefix); ok && offset < rec.size; offset++)
+				{
+					ok = data[offset] == fill_of(prefix.producer, prefix.index, offset);
+				}
+
+				if (ok)
+				{
+					last[prefix.producer] = prefix.index;
+				}
+				else
+				{
+					local_corrupt++;
+				}
+				local_consumed++;
+
+				held.push_back(rec);
+				if (static_cast<int64_t>(held.size()) == batch)
+				{
+					ring.release(held.data(), batch);
+					held.clear();
+				}
+			}
+
+			ring.release(held.data(), static_cast<int64_t>(held.size()));
+			consumed += local_consumed;
+			corrupt += local_corrupt;
+		});
+	}
+
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+
+	CHECK(corrupt == 0);
+	CHECK(consumed == producer_count * count);
+	CHECK(ring.size() == 0);
+}
+
+int main()
+{
+	stale_payload_header();
+	forged_headers_under_load();
+	mpmc_payload_integrity();
+
+	std::cout << "wait_free_record_ring_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "wait_free_skiplist_map.hpp"
+
+//regression tests for wait_free_skiplist_map, exits non zero on the first failed check
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #expr << std::endl; \
+			std::exit(1); \
+		} \
+	} while (0)
+
+using clock_type = std::chrono::steady_clock;
+
+//lookups from a range scan callback must not take the pool gate again, a growth waiting for the scan would block them
+static void find_inside_scan_while_growing()
+{
+	const int64_t key_count = 16;
+	const int64_t insert_count = 20000;
+
+	wait_free_skiplist_map<int64_t, int64_t> map(key_count);
+	for (int64_t key = 0; key < key_count; key++)
+	{
+		CHECK(map.insert(key, key * 10));
+	}
+
+	std::atomic<bool> inserted(false);
+	std::thread inserter([&]()
+	{
+		for (int64_t key = key_count; key < key_count + insert_count; key++)
+		{
+			CHECK(map.insert(key, key * 10));
+		}
+		inserted = true;
+	});
+
+	int64_t bad(0);
+	auto deadline = clock_type::now() + std::chrono::seconds(60);
+	while (!inserted.load(std::memory_order_acquire) && clock_type::now() < deadline)
+	{
+		map.for_each_range(0, key_count - 1, [&](const int64_t& key, const int64_t& value)
+		{
+			int64_t found(0);
+			if (!map.find(key, found) || found != value)
+			{
+				bad++;
+			}
+			std::this_thread::yield();
+		});
+	}
+
+	inserter.join();
+
+	CHECK(bad == 0);
+	CHECK(static_cast<int64_t>(map.size()) == key_count + insert_count);
+	CHECK(map.memory_usage().growth_count > 0);
+}
+
+int main()
+{
+	find_inside_scan_while_growing();
+
+	std::cout << "wait_free_skiplist_map_test passed" << std::endl;
+	return 0;
+}
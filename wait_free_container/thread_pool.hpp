@@ -0,0 +1,401 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "template_util.hpp"
+#include "wait_free_deque.hpp"
+#include "wait_free_queue.hpp"
+
+//work-stealing executor, every worker owns a wait_free_deque, tasks submitted from outside the pool
+//go through a shared wait_free_queue, idle workers steal from each other and park on a condition variable
+class thread_pool
+{
+	struct task_base
+	{
+		virtual ~task_base() {}
+		virtual void run() = 0;
+	};
+
+	template<typename TFunc>
+	struct task_impl : task_base
+	{
+		explicit task_impl(TFunc&& func) :
+			m_func(std::move(func))
+		{
+		}
+
+		void run() override
+		{
+			this->m_func();
+		}
+
+		TFunc m_func;
+	};
+
+	static const int64_t SPIN_COUNT = 64;
+
+public:
+	explicit thread_pool(int64_t worker_count = std::thread::hardware_concurrency(), bool pin_workers = false) :
+		m_injection(nullptr, 1024),
+		m_stop(false),
+		m_sleeping(0),
+		m_epoch(0)
+	{
+		if (worker_count <= 0)
+		{
+			worker_count = 1;
+		}
+
+		for (int64_t i = 0; i < worker_count; i++)
+		{
+			this->m_deques.emplace_back(std::make_unique<wait_free_deque<task_base*>>(256));
+		}
+
+		for (int64_t i = 0; i < worker_count; i++)
+		{
+			this->m_workers.emplace_back(&thread_pool::worker_loop, this, i);
+			if (pin_workers)
+			{
+				pin_to_core(this->m_workers.back(), i % (std::max)(std::thread::hardware_concurrency(), 1u));
+			}
+		}
+	}
+
+	//runs every task already submitted, then joins the workers
+	~thread_pool()
+	{
+		this->m_stop = true;
+		wake_workers(true);
+
+		for (auto& worker : this->m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	//fire and forget, an exception thrown by func is dropped and counted in dropped_exception_count()
+	template<typename TFunc>
+	void post(TFunc&& func)
+	{
+		push_task(make_task(std::forward<TFunc>(func)));
+	}
+
+	template<typename TFunc>
+	auto submit(TFunc&& func) -> std::future<std::invoke_result_t<std::decay_t<TFunc>>>
+	{
+		using result_type = std::invoke_result_t<std::decay_t<TFunc>>;
+
+		auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<TFunc>(func));
+		std::future<result_type> ret = packaged->get_future();
+		push_task(make_task([packaged]() { (*packaged)(); }));
+
+		return ret;
+	}
+
+	//on_complete runs on the worker with the result of func (or no argument when func returns void)
+	//when func throws, on_complete gets the std::exception_ptr instead if it takes one, otherwise the exception is dropped
+	template<typename TFunc, typename TCallback>
+	void submit(TFunc&& func, TCallback&& on_complete)
+	{
+		using result_type = std::invoke_result_t<std::decay_t<TFunc>>;
+
+		push_task(make_task(
+		[func = std::forward<TFunc>(func), on_complete = std::forward<TCallback>(on_complete)]() mutable
+		{
+			if constexpr (std::is_invocable_v<std::decay_t<TCallback>&, std::exception_ptr>)
+			{
+				//only func runs inside the try, an exception from on_complete itself must not call it a second time
+				std::exception_ptr error;
+				if constexpr (std::is_void_v<result_type>)
+				{
+					try
+					{
+						func();
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+
+					if (error)
+					{
+						on_complete(error);
+					}
+					else
+					{
+						on_complete();
+					}
+				}
+				else
+				{
+					std::optional<result_type> result;
+					try
+					{
+						result.emplace(func());
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+
+					if (error)
+					{
+						on_complete(error);
+					}
+					else
+					{
+						on_complete(std::move(*result));
+					}
+				}
+			}
+			else if constexpr (std::is_void_v<result_type>)
+			{
+				func();
+				on_complete();
+			}
+			else
+			{
+				on_complete(func());
+			}
+		}));
+	}
+
+	//batch submission, one enqueue_range on the shared queue and one wake up for the whole batch
+	template<typename TIterator>
+	void post_range(TIterator it_start, const TIterator& it_end)
+	{
+		std::vector<task_base*> tasks;
+		for (; it_start != it_end; it_start++)
+		{
+			tasks.push_back(make_task(*it_start));
+		}
+
+		if (tasks.empty())
+		{
+			return;
+		}
+
+		if (t_pool == this)
+		{
+			for (task_base* task : tasks)
+			{
+				this->m_deques[t_worker_index]->push_bottom(task);
+			}
+		}
+		else
+		{
+			this->m_injection.enqueue_range(tasks.begin(), tasks.end());
+		}
+
+		wake_workers(tasks.size() > 1);
+	}
+
+	size_t worker_count() const noexcept
+	{
+		return this->m_workers.size();
+	}
+
+	//exceptions that escaped a task with nowhere to go
+	int64_t dropped_exception_count() const noexcept
+	{
+		return this->m_dropped_exceptions.load(std::memory_order_relaxed);
+	}
+
+	//-1 when the calling thread is not a worker of this pool
+	int64_t current_worker_index() const noexcept
+	{
+		return t_pool == this ? t_worker_index : -1;
+	}
+
+private:
+
+	std::vector<std::unique_ptr<wait_free_deque<task_base*>>>	m_deques;
+	wait_free_queue<task_base*>									m_injection;
+	std::vector<std::thread>									m_workers;
+	std::atomic<bool>											m_stop;
+
+	std::mutex													m_park_mutex;
+	std::condition_variable										m_park_cv;
+	std::atomic<int64_t>										m_sleeping;
+	std::atomic<int64_t>										m_epoch;
+	std::atomic<int64_t>										m_dropped_exceptions{ 0 };
+
+	static inline thread_local thread_pool*						t_pool = nullptr;
+	static inline thread_local int64_t							t_worker_index = -1;
+
+	template<typename TFunc>
+	static task_base* make_task(TFunc&& func)
+	{
+		return new task_impl<std::decay_t<TFunc>>(std::decay_t<TFunc>(std::forward<TFunc>(func)));
+	}
+
+	void push_task(task_base* task)
+	{
+		if (t_pool == this)
+		{
+			this->m_deques[t_worker_index]->push_bottom(task);
+		}
+		else
+		{
+			this->m_injection.enqueue(task);
+		}
+
+		wake_workers(false);
+	}
+
+	void wake_workers(bool all)
+	{
+		this->m_epoch++;
+		if (this->m_sleeping > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->m_park_mutex);
+			}
+
+			if (all)
+			{
+				this->m_park_cv.notify_all();
+			}
+			else
+			{
+				this->m_park_cv.notify_one();
+			}
+		}
+	}
+
+	task_base* find_task(int64_t index) noexcept
+	{
+		task_base* task(nullptr);
+
+		if (this->m_deques[index]->pop_bottom(task))
+		{
+			return task;
+		}
+
+		if (this->m_injection.size() > 0 && this->m_injection.dequeue(task) != -1)
+		{
+			return task;
+		}
+
+		int64_t count = static_cast<int64_t>(this->m_deques.size());
+		for (int64_t i = 1; i < count; i++)
+		{
+			if (this->m_deques[(index + i) % count]->steal(task))
+			{
+				return task;
+			}
+		}
+
+		return nullptr;
+	}
+
+	bool has_work() const noexcept
+	{
+		if (this->m_injection.size() > 0)
+		{
+			return true;
+		}
+
+		for (auto& deque : this->m_deques)
+		{
+			if (!deque->empty())
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void worker_loop(int64_t index)
+	{
+		t_pool = this;
+		t_worker_index = index;
+
+		int64_t idle_rounds(0);
+
+		while (true)
+		{
+			task_base* task = find_task(index);
+			if (task)
+			{
+				//a throwing task must not take the worker down with it
+				try
+				{
+					task->run();
+				}
+				catch (...)
+				{
+					this->m_dropped_exceptions.fetch_add(1, std::memory_order_relaxed);
+				}
+				delete task;
+				idle_rounds = 0;
+				continue;
+			}
+
+			if (this->m_stop && !has_work())
+			{
+				break;
+			}
+
+			if (++idle_rounds < SPIN_COUNT)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			//park, a submitter bumps m_epoch after publishing so either we see the work or it sees m_sleeping
+			int64_t epoch = this->m_epoch;
+			this->m_sleeping++;
+			if (!has_work() && !this->m_stop)
+			{
+				std::unique_lock<std::mutex> lock(this->m_park_mutex);
+				this->m_park_cv.wait(lock, [&]() { return this->m_epoch != epoch || this->m_stop; });
+			}
+			this->m_sleeping--;
+			idle_rounds = 0;
+		}
+
+		t_pool = nullptr;
+		t_worker_index = -1;
+	}
+
+	static void pin_to_core(std::thread& worker, unsigned core) noexcept
+	{
+#if defined(_WIN32)
+		::SetThreadAffinityMask(worker.native_handle(), static_cast<DWORD_PTR>(1) << core);
+#elif defined(__linux__)
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(core, &cpu_set);
+		::pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set), &cpu_set);
+#else
+		(void)worker;
+		(void)core;
+#endif
+	}
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+
+#include "template_util.hpp"
+#include "wait_free_generic_queue.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_queue.hpp"
+
+//default resumption, the producer/consumer that makes progress resumes the waiter on its own thread
+//nested resumptions are deferred to the outermost one so ping-ponging coroutines don't grow the stack
+struct wait_free_coroutine_trampoline
+{
+	static void resume(std::coroutine_handle<> handle)
+	{
+		if (t_resuming)
+		{
+			t_pending.push_back(handle);
+			return;
+		}
+
+		t_resuming = true;
+		handle.resume();
+		while (!t_pending.empty())
+		{
+			std::coroutine_handle<> next = t_pending.front();
+			t_pending.pop_front();
+			next.resume();
+		}
+		t_resuming = false;
+	}
+
+private:
+	static inline thread_local bool									t_resuming = false;
+	static inline thread_local std::deque<std::coroutine_handle<>>	t_pending;
+};
+
+//wait_free_generic_queue with co_await async_dequeue() / async_enqueue(v)
+//suspended coroutines register in lock-free waiter queues and are resumed by whoever makes progress possible,
+//no thread ever blocks. async_enqueue suspends when size() reaches max_size, the bound is soft under races
+template<typename T, template<typename U> typename TAllocator = std::allocator>
+class wait_free_async_queue
+{
+	static const int64_t WAITING = 0;
+	static const int64_t CLAIMED = 1;
+	static const int64_t CANCELLED = 2;
+
+	//heap allocated and shared by the waiter queue and the awaiter, so a cancelled waiter left in the queue never
+	//points into a destroyed coroutine frame
+	struct waiter
+	{
+		std::atomic<int64_t>		state{ WAITING };
+		std::atomic<int64_t>		ref_count{ 2 };
+		std::coroutine_handle<>		handle{};
+		T							value{};
+
+		bool claim() noexcept
+		{
+			int64_t expected(WAITING);
+			return this->state.compare_exchange_strong(expected, CLAIMED);
+		}
+
+		bool cancel() noexcept
+		{
+			int64_t expected(WAITING);
+			return this->state.compare_exchange_strong(expected, CANCELLED);
+		}
+
+		void release() noexcept
+		{
+			if (this->ref_count.fetch_sub(1) == 1)
+			{
+				delete this;
+			}
+		}
+	};
+
+public:
+	using resumer = std::function<void(std::coroutine_handle<>)>;
+
+	class dequeue_awaiter
+	{
+		friend class wait_free_async_queue;
+
+	public:
+		bool await_ready()
+		{
+			return this->m_queue->try_dequeue(this->m_value);
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			wait_free_async_queue* queue = this->m_queue;
+
+			while (true)
+			{
+				waiter* node = new waiter();
+				node->handle = handle;
+				this->m_node = node;
+				queue->m_consumer_waiters.enqueue(node);
+
+				//from here a producer may resume us at any time, don't touch *this unless the cancel succeeds
+				//an element published before we registered would not wake us, take it ourselves
+				if (queue->m_queue.size() == 0 || !node->cancel())
+				{
+					return true;
+				}
+
+				this->m_node = nullptr;
+				node->release();
+
+				if (queue->try_dequeue(this->m_value))
+				{
+					return false;
+				}
+			}
+		}
+
+		T await_resume()
+		{
+			if (this->m_node)
+			{
+				T value(std::move(this->m_node->value));
+				this->m_node->release();
+				this->m_node = nullptr;
+				return value;
+			}
+
+			return std::move(this->m_value);
+		}
+
+	private:
+		explicit dequeue_awaiter(wait_free_async_queue* queue) :
+			m_queue(queue),
+			m_node(nullptr),
+			m_value()
+		{
+		}
+
+		wait_free_async_queue*	m_queue;
+		waiter*					m_node;
+		T						m_value;
+	};
+
+	class enqueue_awaiter
+	{
+		friend class wait_free_async_queue;
+
+	public:
+		bool await_ready()
+		{
+			if (this->m_queue->size() < static_cast<size_t>(this->m_queue->m_max_size))
+			{
+				this->m_queue->enqueue(this->m_value);
+				return true;
+			}
+
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			wait_free_async_queue* queue = this->m_queue;
+
+			waiter* node = new waiter();
+			node->handle = handle;
+			node->value = this->m_value;
+			queue->m_producer_waiters.enqueue(node);
+
+			//a slot freed before we registered would not wake us
+			if (queue->size() >= static_cast<size_t>(queue->m_max_size) || !node->cancel())
+			{
+				node->release();
+				return true;
+			}
+
+			node->release();
+			queue->enqueue(this->m_value);
+
+			return false;
+		}
+
+		void await_resume() noexcept
+		{
+		}
+
+	private:
+		enqueue_awaiter(wait_free_async_queue* queue, const T& value) :
+			m_queue(queue),
+			m_value(value)
+		{
+		}
+
+		wait_free_async_queue*	m_queue;
+		T						m_value;
+	};
+
+	explicit wait_free_async_queue(
+		int64_t capacity = 10,
+		int64_t max_size = (std::numeric_limits<int64_t>::max)(),
+		resumer resume = nullptr,
+		const TAllocator<T>& memory_pool_allocator = TAllocator<T>(),
+		const TAllocator<std::atomic<int64_t>>& offset_queue_allocator = TAllocator<std::atomic<int64_t>>()) :
+		m_queue(capacity, memory_pool_allocator, offset_queue_allocator),
+		m_consumer_waiters(nullptr, 16),
+		m_producer_waiters(nullptr, 16),
+		m_max_size(max_size),
+		m_resume(std::move(resume))
+	{
+		assert(max_size > 0);
+	}
+
+	//coroutines still suspended on the queue are never resumed
+	~wait_free_async_queue()
+	{
+		this->m_registration.remove();
+
+		waiter* node(nullptr);
+		while (this->m_consumer_waiters.dequeue(node) != -1)
+		{
+			node->release();
+		}
+
+		while (this->m_producer_waiters.dequeue(node) != -1)
+		{
+			node->release();
+		}
+	}
+
+	wait_free_async_queue(const wait_free_async_queue&) = delete;
+	wait_free_async_queue& operator=(const wait_free_async_queue&) = delete;
+
+	dequeue_awaiter async_dequeue() noexcept
+	{
+		return dequeue_awaiter(this);
+	}
+
+	enqueue_awaiter async_enqueue(const T& value)
+	{
+		return enqueue_awaiter(this, value);
+	}
+
+	//never suspends, ignores max_size, usable from plain threads
+	void enqueue(const T& value)
+	{
+		this->m_queue.enqueue(value);
+		notify_consumer();
+	}
+
+	bool try_dequeue(T& elem)
+	{
+		if (this->m_queue.size() == 0 || this->m_queue.dequeue(elem) == -1)
+		{
+			return false;
+		}
+
+		notify_producer();
+
+		return true;
+	}
+
+	size_t size() const noexcept
+	{
+		return this->m_queue.size();
+	}
+
+	size_t max_size() const noexcept
+	{
+		return this->m_max_size;
+	}
+
+	//the element queue plus both waiter queues
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret = this->m_queue.memory_usage();
+		ret += this->m_consumer_waiters.memory_usage();
+		ret += this->m_producer_waiters.memory_usage();
+
+		return ret;
+	}
+
+private:
+
+	wait_free_generic_queue<T, TAllocator>		m_queue;
+	wait_free_queue<waiter*, TAllocator>		m_consumer_waiters;
+	wait_free_queue<waiter*, TAllocator>		m_producer_waiters;
+	const int64_t								m_max_size;
+	resumer										m_resume;
+	wait_free_registration						m_registration{ this, "wait_free_async_queue" };
+
+	void resume(std::coroutine_handle<> handle)
+	{
+		if (this->m_resume)
+		{
+			this->m_resume(handle);
+		}
+		else
+		{
+			wait_free_coroutine_trampoline::resume(handle);
+		}
+	}
+
+	//called after an element was published, hands one element to a suspended consumer
+	void notify_consumer()
+	{
+		waiter* node(nullptr);
+
+		while (this->m_queue.size() > 0 && this->m_consumer_waiters.size() > 0)
+		{
+			if (this->m_consumer_waiters.dequeue(node) == -1)
+			{
+				return;
+			}
+
+			if (!node->claim())
+			{
+				node->release();
+				continue;
+			}
+
+			if (this->m_queue.dequeue(node->value) == -1)
+			{
+				//another consumer was faster, give the waiter back and look at the queue again
+				node->state = WAITING;
+				this->m_consumer_waiters.enqueue(node);
+				continue;
+			}
+
+			std::coroutine_handle<> handle = node->handle;
+			node->release();
+
+			notify_producer();
+			resume(handle);
+
+			return;
+		}
+	}
+
+	//called after a slot was freed, enqueues the value of one suspended producer on its behalf
+	void notify_producer()
+	{
+		waiter* node(nullptr);
+
+		while (this->m_queue.size() < static_cast<size_t>(this->m_max_size) && this->m_producer_waiters.size() > 0)
+		{
+			if (this->m_producer_waiters.dequeue(node) == -1)
+			{
+				return;
+			}
+
+			if (!node->claim())
+			{
+				node->release();
+				continue;
+			}
+
+			std::coroutine_handle<> handle = node->handle;
+			this->m_queue.enqueue(node->value);
+			node->release();
+
+			notify_consumer();
+			resume(handle);
+
+			return;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//slot type of the containers: std::atomic<T>, except for 16 byte trivially copyable T where the standard atomic takes a lock,
+//e.g. a (pointer, tag) pair; those get wait_free_atomic16 built on the double width cas (cmpxchg16b, -mcx16 on gcc/clang)
+//a container whose slot still is not lock free fails to compile, define WAIT_FREE_ALLOW_LOCKING_ATOMICS=1 to accept the lock
+#ifndef WAIT_FREE_ALLOW_LOCKING_ATOMICS
+#define WAIT_FREE_ALLOW_LOCKING_ATOMICS 0
+#endif
+
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) || (defined(_MSC_VER) && defined(_M_X64))
+#define WAIT_FREE_HAS_CAS16 1
+#else
+#define WAIT_FREE_HAS_CAS16 0
+#endif
+
+#if WAIT_FREE_HAS_CAS16
+//every operation is a full barrier cas, the memory order arguments are accepted for std::atomic compatibility only
+//comparison is bytewise like std::atomic, T should not have padding
+template<typename T>
+class alignas(16) wait_free_atomic16
+{
+	static_assert(sizeof(T) == 16 && std::is_trivially_copyable_v<T>, "wait_free_atomic16 needs a 16 byte trivially copyable type");
+
+public:
+	static constexpr bool is_always_lock_free = true;
+
+	wait_free_atomic16() noexcept :
+		m_value()
+	{
+	}
+
+	wait_free_atomic16(T value) noexcept :
+		m_value(value)
+	{
+	}
+
+	wait_free_atomic16(const wait_free_atomic16&) = delete;
+	wait_free_atomic16& operator=(const wait_free_atomic16&) = delete;
+
+	bool is_lock_free() const noexcept
+	{
+		return true;
+	}
+
+	T load(std::memory_order = std::memory_order_seq_cst) const noexcept
+	{
+		//a cas that swaps a value with itself, the only 16 byte read that can't tear
+		T ret{};
+		cas(ret, ret);
+		return ret;
+	}
+
+	void store(T value, std::memory_order = std::memory_order_seq_cst) noexcept
+	{
+		exchange(value);
+	}
+
+	T exchange(T value, std::memory_order = std::memory_order_seq_cst) noexcept
+	{
+		T ret{};
+		while (!cas(ret, value))
+		{
+		}
+
+		return ret;
+	}
+
+	bool compare_exchange_strong(T& expected, T desired, std::memory_order = std::memory_order_seq_cst) noexcept
+	{
+		return cas(expected, desired);
+	}
+
+	bool compare_exchange_strong(T& expected, T desired, std::memory_order, std::memory_order) noexcept
+	{
+		return cas(expected, desired);
+	}
+
+	bool compare_exchange_weak(T& expected, T desired, std::memory_order = std::memory_order_seq_cst) noexcept
+	{
+		return cas(expected, desired);
+	}
+
+	bool compare_exchange_weak(T& expected, T desired, std::memory_order, std::memory_order) noexcept
+	{
+		return cas(expected, desired);
+	}
+
+	operator T() const noexcept
+	{
+		return load();
+	}
+
+	T operator=(T value) noexcept
+	{
+		store(value);
+		return value;
+	}
+
+private:
+	mutable T	m_value;
+
+	bool cas(T& expected, const T& desired) const noexcept
+	{
+#if defined(_MSC_VER)
+		int64_t parts[2];
+		int64_t comparand[2];
+		memcpy(parts, &desired, sizeof(parts));
+		memcpy(comparand, &expected, sizeof(comparand));
+
+		bool ret = _InterlockedCompareExchange128(reinterpret_cast<volatile int64_t*>(&this->m_value), parts[1], parts[0], comparand) != 0;
+		memcpy(&expected, comparand, sizeof(comparand));
+
+		return ret;
+#else
+		__extension__ typedef unsigned __int128 word_type;
+
+		word_type old_word;
+		word_type new_word;
+		memcpy(&old_word, &expected, sizeof(word_type));
+		memcpy(&new_word, &desired, sizeof(word_type));
+
+		word_type ret = __sync_val_compare_and_swap(reinterpret_cast<volatile word_type*>(&this->m_value), old_word, new_word);
+		if (ret == old_word)
+		{
+			return true;
+		}
+
+		memcpy(&expected, &ret, sizeof(word_type));
+		return false;
+#endif
+	}
+};
+#endif
+
+template<typename T, typename = void>
+struct wait_free_atomic_select
+{
+	using type = std::atomic<T>;
+};
+
+#if WAIT_FREE_HAS_CAS16
+template<typename T>
+struct wait_free_atomic_locking : std::bool_constant<!std::atomic<T>::is_always_lock_free>
+{
+};
+
+//conjunction so std::atomic<T> is only looked at for types it accepts
+template<typename T>
+struct wait_free_atomic_select<T, std::enable_if_t<std::conjunction_v<
+	std::bool_constant<sizeof(T) == 16 && std::is_trivially_copyable_v<T>>, wait_free_atomic_locking<T>>>>
+{
+	using type = wait_free_atomic16<T>;
+};
+#endif
+
+template<typename T>
+using wait_free_atomic = typename wait_free_atomic_select<T>::type;
+
+template<typename T>
+inline constexpr bool wait_free_atomic_lock_free_v = WAIT_FREE_ALLOW_LOCKING_ATOMICS || wait_free_atomic<T>::is_always_lock_free;
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "wait_free_memory.hpp"
+
+inline int32_t wait_free_ctz64(uint64_t value) noexcept
+{
+	assert(value != 0);
+#if defined(_MSC_VER)
+	unsigned long ret(0);
+	_BitScanForward64(&ret, value);
+	return static_cast<int32_t>(ret);
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+//fixed size concurrent bitset for handing out ids, set/reset/test are one atomic word operation
+//two summary trees sit above the bit words, one bit per word below: "full" for find_first_zero and "non empty" for
+//find_first_set, so a search touches one word per level instead of scanning, 64^levels bits
+//a summary is brought in line with its word after every change that can flip it and rechecked until the word holds still,
+//so it may lag for a moment but never stays wrong; a search that meets a stale hint moves on to the next candidate
+//bits past size() are kept set, they are never found as zeros and are masked out of the non empty summary
+template<template<typename U> typename TAllocator = std::allocator>
+class wait_free_bitset
+{
+	static constexpr uint64_t ALL = ~static_cast<uint64_t>(0);
+
+public:
+	explicit wait_free_bitset(int64_t size, const TAllocator<std::atomic<uint64_t>>& allocator = TAllocator<std::atomic<uint64_t>>()) :
+		m_allocator(allocator),
+		m_size(size)
+	{
+		assert(size > 0);
+
+		int64_t words = (size + 63) / 64;
+		this->m_words.push_back(words);
+		while (words > 1)
+		{
+			words = (words + 63) / 64;
+			this->m_words.push_back(words);
+		}
+
+		//level 0 holds the bits, the summaries of level k describe the words of level k - 1
+		for (size_t level = 0; level < this->m_words.size(); level++)
+		{
+			int64_t count = this->m_words[level];
+			int64_t valid = level == 0 ? size : this->m_words[level - 1];
+
+			this->m_full.push_back(this->m_allocator.allocate(count));
+			this->m_nonempty.push_back(level == 0 ? nullptr : this->m_allocator.allocate(count));
+			for (int64_t i = 0; i < count; i++)
+			{
+				uint64_t tail = i == count - 1 && valid % 64 != 0 ? ALL << (valid % 64) : 0;
+				new (&this->m_full[level][i]) std::atomic<uint64_t>(tail);
+				if (level != 0)
+				{
+					new (&this->m_nonempty[level][i]) std::atomic<uint64_t>(0);
+				}
+			}
+		}
+
+		this->m_registration.add();
+	}
+
+	~wait_free_bitset()
+	{
+		this->m_registration.remove();
+
+		for (size_t level = 0; level < this->m_words.size(); level++)
+		{
+			this->m_allocator.deallocate(this->m_full[level], this->m_words[level]);
+			if (level != 0)
+			{
+				this->m_allocator.deallocate(this->m_nonempty[level], this->m_words[level]);
+			}
+		}
+	}
+
+	wait_free_bitset(const wait_free_bitset&) = delete;
+	wait_free_bitset& operator=(const wait_free_bitset&) = delete;
+
+	bool test(int64_t index) const noexcept
+	{
+		assert(index >= 0 && index < this->m_size);
+		return (this->m_full[0][index >> 6].load(std::memory_order_acquire) >> (index & 63)) & 1;
+	}
+
+	//returns the previous value
+	bool set(int64_t index) noexcept
+	{
+		assert(index >= 0 && index < this->m_size);
+
+		uint64_t bit = static_cast<uint64_t>(1) << (index & 63);
+		uint64_t old_word = this->m_full[0][index >> 6].fetch_or(bit, std::memory_order_acq_rel);
+		if (old_word & bit)
+		{
+			return true;
+		}
+
+		this->m_count.fetch_add(1, std::memory_order_relaxed);
+		if ((old_word | bit) == ALL || (old_word & valid_mask(index >> 6)) == 0)
+		{
+			sync(0, index >> 6);
+		}
+
+		return false;
+	}
+
+	//returns the previous value
+	bool reset(int64_t index) noexcept
+	{
+		assert(index >= 0 && index < this->m_size);
+
+		uint64_t bit = static_cast<uint64_t>(1) << (index & 63);
+		uint64_t old_word = this->m_full[0][index >> 6].fetch_and(~bit, std::memory_order_acq_rel);
+		if (!(old_word & bit))
+		{
+			return false;
+		}
+
+		this->m_count.fetch_sub(1, std::memory_order_relaxed);
+		if (old_word == ALL || (old_word & ~bit & valid_mask(index >> 6)) == 0)
+		{
+			sync(0, index >> 6);
+		}
+
+		return true;
+	}
+
+	//first set bit at or after from, -1 when there is none
+	int64_t find_first_set(int64_t from = 0) const noexcept
+	{
+		return find(false, from);
+	}
+
+	//first clear bit at or after from, -1 when there is none
+	int64_t find_first_zero(int64_t from = 0) const noexcept
+	{
+		return find(true, from);
+	}
+
+	//claims the first clear bit at or after hint, wrapping around, -1 when every bit is set
+	int64_t allocate(int64_t hint = 0) noexcept
+	{
+		int64_t from = hint;
+		bool wrapped(hint == 0);
+
+		while (true)
+		{
+			int64_t index = find(true, from);
+			if (index == -1)
+			{
+				if (wrapped)
+				{
+					return -1;
+				}
+
+				wrapped = true;
+				from = 0;
+				continue;
+			}
+
+			if (!set(index))
+			{
+				return index;
+			}
+
+			from = index;
+		}
+	}
+
+	//returns false when the bit was not set
+	bool release(int64_t index) noexcept
+	{
+		return reset(index);
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>(this->m_size);
+	}
+
+	//set bits, exact only while nobody changes them
+	size_t count() const noexcept
+	{
+		return static_cast<size_t>((std::max)(this->m_count.load(std::memory_order_relaxed), static_cast<int64_t>(0)));
+	}
+
+	//every word is reserved and live, the free list is the clear bits
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		int64_t words(0);
+		for (size_t level = 0; level < this->m_words.size(); level++)
+		{
+			words += this->m_words[level] * (level == 0 ? 1 : 2);
+		}
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = words * static_cast<int64_t>(sizeof(std::atomic<uint64_t>));
+		ret.live_bytes = ret.reserved_bytes;
+		ret.free_list_length = this->m_size - static_cast<int64_t>(count());
+		ret.peak_live_bytes = ret.reserved_bytes;
+
+		return ret;
+	}
+
+private:
+	TAllocator<std::atomic<uint64_t>>		m_allocator;
+	const int64_t							m_size;
+	std::vector<int64_t>					m_words;
+	//m_full[0] is the bitset itself, m_nonempty[0] is unused
+	std::vector<std::atomic<uint64_t>*>		m_full;
+	std::vector<std::atomic<uint64_t>*>		m_nonempty;
+	alignas(64) std::atomic<int64_t>		m_count{ 0 };
+	wait_free_registration					m_registration{ this, "wait_free_bitset", false };
+
+	uint64_t valid_mask(int64_t word) const noexcept
+	{
+		return word == this->m_words[0] - 1 && this->m_size % 64 != 0 ? ~(ALL << (this->m_size % 64)) : ALL;
+	}
+
+	bool child_full(size_t level, int64_t index) const noexcept
+	{
+		return this->m_full[level][index].load(std::memory_order_acquire) == ALL;
+	}
+
+	bool child_nonempty(size_t level, int64_t index) const noexcept
+	{
+		return level == 0 ?
+			(this->m_full[0][index].load(std::memory_order_acquire) & valid_mask(index)) != 0 :
+			this->m_nonempty[level][index].load(std::memory_order_acquire) != 0;
+	}
+
+	//brings the summary bits of word index at level up to date, then the levels above if that flipped a summary word
+	void sync(size_t level, int64_t index) noexcept
+	{
+		size_t parent = level + 1;
+		if (parent >= this->m_words.size())
+		{
+			return;
+		}
+
+		int64_t word = index >> 6;
+		uint64_t bit = static_cast<uint64_t>(1) << (index & 63);
+		bool propagate(false);
+
+		while (true)
+		{
+			bool full = child_full(level, index);
+			bool nonempty = child_nonempty(level, index);
+
+			uint64_t old_full = full ?
+				this->m_full[parent][word].fetch_or(bit, std::memory_order_acq_rel) :
+				this->m_full[parent][word].fetch_and(~bit, std::memory_order_acq_rel);
+			uint64_t new_full = full ? old_full | bit : old_full & ~bit;
+
+			uint64_t old_nonempty = nonempty ?
+				this->m_nonempty[parent][word].fetch_or(bit, std::memory_order_acq_rel) :
+				this->m_nonempty[parent][word].fetch_and(~bit, std::memory_order_acq_rel);
+			uint64_t new_nonempty = nonempty ? old_nonempty | bit : old_nonempty & ~bit;
+
+			propagate = propagate || (old_full == ALL) != (new_full == ALL) || (old_nonempty != 0) != (new_nonempty != 0);
+
+			if (child_full(level, index) == full && child_nonempty(level, index) == nonempty)
+			{
+				break;
+			}
+		}
+
+		if (propagate)
+		{
+			sync(parent, word);
+		}
+	}
+
+	//bits of a word that are candidates for the search
+	uint64_t candidates(bool zero, size_t level, int64_t index) const noexcept
+	{
+		if (zero)
+		{
+			return ~this->m_full[level][index].load(std::memory_order_acquire);
+		}
+
+		return level == 0 ?
+			this->m_full[0][index].load(std::memory_order_acquire) & valid_mask(index) :
+			this->m_nonempty[level][index].load(std::memory_order_acquire);
+	}
+
+	//smallest index >= from at level with a candidate bit, climbing to the summaries when its own word has none
+	int64_t successor(bool zero, size_t level, int64_t from) const noexcept
+	{
+		int64_t bits_count = level == 0 ? this->m_size : this->m_words[level - 1];
+		while (from < bits_count)
+		{
+			int64_t word = from >> 6;
+			uint64_t bits = candidates(zero, level, word) & (ALL << (from & 63));
+			if (bits != 0)
+			{
+				int64_t ret = word * 64 + wait_free_ctz64(bits);
+				return ret < bits_count ? ret : -1;
+			}
+
+			if (level + 1 >= this->m_words.size())
+			{
+				return -1;
+			}
+
+			int64_t next_word = successor(zero, level + 1, word + 1);
+			if (next_word == -1)
+			{
+				return -1;
+			}
+
+			from = next_word * 64;
+		}
+
+		return -1;
+	}
+
+	int64_t find(bool zero, int64_t from) const noexcept
+	{
+		if (from < 0 || from >= this->m_size)
+		{
+			return -1;
+		}
+
+		return successor(zero, 0, from);
+	}
+};
+
+//small id per live thread below WAIT_FREE_MAX_THREADS, taken on first use and handed back when the thread exits,
+//for per thread state that must not be shared, where wait_free_thread_index() only spreads threads over shards
+#ifndef WAIT_FREE_MAX_THREADS
+#define WAIT_FREE_MAX_THREADS 1024
+#endif
+
+inline int64_t wait_free_thread_slot() noexcept
+{
+	static wait_free_bitset<> slots(WAIT_FREE_MAX_THREADS);
+
+	struct holder
+	{
+		int64_t		slot;
+
+		holder() noexcept :
+			slot(slots.allocate())
+		{
+		}
+
+		~holder()
+		{
+			if (this->slot != -1)
+			{
+				slots.release(this->slot);
+			}
+		}
+	};
+
+	static thread_local holder h;
+	assert(h.slot != -1);
+
+	return h.slot;
+}
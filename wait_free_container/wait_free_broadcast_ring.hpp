@@ -0,0 +1,411 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#include "template_util.hpp"
+#include "wait_free_memory.hpp"
+
+//disruptor style multicast ring, every registered consumer sees every element
+//producers claim sequences and gate on the slowest consumer cursor, consumers read published slots in place
+//lossy mode: producers never wait on consumers, consumers that fall a lap behind skip ahead and count the lost elements
+template<typename T, template<typename U> typename TAllocator = std::allocator>
+class wait_free_broadcast_ring : private wait_free_stats_base
+{
+	static constexpr int64_t INACTIVE_CURSOR = (std::numeric_limits<int64_t>::max)();
+	static constexpr int64_t WRITING = (std::numeric_limits<int64_t>::min)();
+
+	struct alignas(64) consumer_cursor
+	{
+		std::atomic<int64_t>	cursor{ INACTIVE_CURSOR };
+		std::atomic<int64_t>	lost{ 0 };
+		std::atomic<bool>		active{ false };
+	};
+
+public:
+	explicit wait_free_broadcast_ring(
+		int64_t capacity = 1024,
+		int64_t max_consumers = 8,
+		bool lossy = false,
+		const TAllocator<T>& allocator = TAllocator<T>(),
+		const TAllocator<std::atomic<int64_t>>& sequence_allocator = TAllocator<std::atomic<int64_t>>()) :
+		m_data(nullptr),
+		m_published(nullptr),
+		m_allocator(allocator),
+		m_sequence_allocator(sequence_allocator),
+		m_capacity(0),
+		m_mask(0),
+		m_lossy(lossy),
+		m_claim(0),
+		m_gate_cache(0),
+		m_consumers(new consumer_cursor[max_consumers]),
+		m_max_consumers(max_consumers)
+	{
+		assert(capacity > 0 && max_consumers > 0);
+
+		int64_t pow2_capacity(1);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		this->m_capacity = pow2_capacity;
+		this->m_mask = pow2_capacity - 1;
+
+		this->m_data = this->m_allocator.allocate(pow2_capacity);
+		assert(this->m_data);
+		std::uninitialized_fill_n(this->m_data, pow2_capacity, T());
+
+		//slot i is initially "published" for sequence i - capacity, i.e. not readable yet
+		this->m_published = this->m_sequence_allocator.allocate(pow2_capacity);
+		assert(this->m_published);
+		for (int64_t i = 0; i < pow2_capacity; i++)
+		{
+			new (&this->m_published[i]) std::atomic<int64_t>(i - pow2_capacity);
+		}
+
+		this->m_registration.add();
+	}
+
+	~wait_free_broadcast_ring()
+	{
+		this->m_registration.remove();
+
+		std::for_each(this->m_data, this->m_data + this->m_capacity,
+		[](T& elem)
+		{
+			elem.~T();
+		});
+		this->m_allocator.deallocate(this->m_data, this->m_capacity);
+
+		std::for_each(this->m_published, this->m_published + this->m_capacity,
+		[](std::atomic<int64_t>& elem)
+		{
+			elem.~atomic<int64_t>();
+		});
+		this->m_sequence_allocator.deallocate(this->m_published, this->m_capacity);
+	}
+
+	wait_free_broadcast_ring(const wait_free_broadcast_ring&) = delete;
+	wait_free_broadcast_ring& operator=(const wait_free_broadcast_ring&) = delete;
+
+	//returns consumer id, -1 when all consumer slots are taken
+	//the consumer starts at the next claimed sequence, elements published before are not visible to it
+	int64_t add_consumer() noexcept
+	{
+		for (int64_t i = 0; i < this->m_max_consumers; i++)
+		{
+			bool active(false);
+			if (this->m_consumers[i].active.compare_exchange_strong(active, true))
+			{
+				int64_t cursor = this->m_claim.load();
+				this->m_consumers[i].lost = 0;
+				this->m_consumers[i].cursor = cursor;
+
+				//the cache may hold a gate taken while nobody was reading, lower it so producers wait for this cursor
+				lower_gate(cursor);
+
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	void remove_consumer(int64_t consumer) noexcept
+	{
+		assert(consumer >= 0 && consumer < this->m_max_consumers);
+
+		this->m_consumers[consumer].cursor = INACTIVE_CURSOR;
+		this->m_consumers[consumer].active = false;
+	}
+
+	//claim count consecutive sequences, returns the first one, write them through operator[] then commit
+	//lossy mode marks every slot of the range WRITING before returning, commit publishes over the mark
+	int64_t claim(int64_t count = 1)
+	{
+		assert(count > 0 && count <= this->m_capacity);
+
+		int64_t sequence = this->m_claim.fetch_add(count);
+		if (!this->m_lossy)
+		{
+			wait_for_gate(sequence + count - this->m_capacity);
+			return sequence;
+		}
+
+		for (int64_t i = 0; i < count; i++)
+		{
+			acquire_slot(sequence + i);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+
+		return sequence;
+	}
+
+	T& operator[](int64_t sequence) noexcept
+	{
+		return this->m_data[sequence & this->m_mask];
+	}
+
+	const T& operator[](int64_t sequence) const noexcept
+	{
+		return this->m_data[sequence & this->m_mask];
+	}
+
+	void commit(int64_t sequence, int64_t count = 1) noexcept
+	{
+		for (int64_t i = 0; i < count; i++)
+		{
+			this->m_published[(sequence + i) & this->m_mask].store(sequence + i, std::memory_order_release);
+		}
+	}
+
+	int64_t publish(const T& value)
+	{
+		int64_t sequence = claim(1);
+		write(sequence, value);
+
+		return sequence;
+	}
+
+	template<typename TIterator>
+	int64_t publish_range(TIterator it_start, const TIterator& it_end)
+	{
+		int64_t count = it_end - it_start;
+		if (count <= 0)
+		{
+			return -1;
+		}
+
+		int64_t sequence = claim(count);
+		for (int64_t i = 0; i < count; i++, it_start++)
+		{
+			write(sequence + i, *it_start);
+		}
+
+		return sequence;
+	}
+
+	//number of contiguous published elements from the consumer cursor, read them with operator[] then release
+	//lossy mode can overwrite them under the reader, prefer consume() there
+	int64_t available(int64_t consumer) noexcept
+	{
+		int64_t cursor = skip_lost(consumer, this->m_consumers[consumer].cursor);
+		int64_t sequence = cursor;
+		while (sequence - cursor < this->m_capacity &&
+			this->m_published[sequence & this->m_mask].load(std::memory_order_acquire) == sequence)
+		{
+			sequence++;
+		}
+
+		return sequence - cursor;
+	}
+
+	int64_t cursor(int64_t consumer) const noexcept
+	{
+		return this->m_consumers[consumer].cursor;
+	}
+
+	void release(int64_t consumer, int64_t count) noexcept
+	{
+		this->m_consumers[consumer].cursor.fetch_add(count, std::memory_order_release);
+	}
+
+	//calls func(const T&, sequence) for up to max_count published elements then releases them as one batch
+	//gated mode reads in place, lossy mode reads a validated copy because the slot may be overwritten concurrently
+	template<typename TFunc>
+	int64_t consume(int64_t consumer, TFunc&& func, int64_t max_count = (std::numeric_limits<int64_t>::max)())
+	{
+		int64_t cursor = skip_lost(consumer, this->m_consumers[consumer].cursor);
+		int64_t count(0);
+
+		while (count < max_count)
+		{
+			int64_t sequence = cursor + count;
+			std::atomic<int64_t>& published = this->m_published[sequence & this->m_mask];
+			if (published.load(std::memory_order_acquire) != sequence)
+			{
+				break;
+			}
+
+			if (this->m_lossy)
+			{
+				T value(this->m_data[sequence & this->m_mask]);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (published.load(std::memory_order_relaxed) != sequence)
+				{
+					break;
+				}
+
+				func(static_cast<const T&>(value), sequence);
+			}
+			else
+			{
+				func(static_cast<const T&>(this->m_data[sequence & this->m_mask]), sequence);
+			}
+
+			count++;
+		}
+
+		this->m_consumers[consumer].cursor.store(cursor + count, std::memory_order_release);
+
+		return count;
+	}
+
+	//elements this consumer missed because producers lapped it, always 0 when not lossy
+	int64_t lost(int64_t consumer) const noexcept
+	{
+		return this->m_consumers[consumer].lost;
+	}
+
+	int64_t claimed() const noexcept
+	{
+		return this->m_claim;
+	}
+
+	bool lossy() const noexcept
+	{
+		return this->m_lossy;
+	}
+
+	size_t capacity() const noexcept
+	{
+		return this->m_capacity;
+	}
+
+	//fixed storage, live is what the slowest active consumer hasn't read yet, peak is every slot written so far
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t elem_size = static_cast<int64_t>(sizeof(T));
+		int64_t claim = this->m_claim.load(std::memory_order_acquire);
+		int64_t cursor = min_cursor();
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_capacity * static_cast<int64_t>(sizeof(T) + sizeof(std::atomic<int64_t>))
+			+ this->m_max_consumers * static_cast<int64_t>(sizeof(consumer_cursor));
+		ret.live_bytes = cursor == INACTIVE_CURSOR ? 0 : (std::min)((std::max)(claim - cursor, static_cast<int64_t>(0)), this->m_capacity) * elem_size;
+		ret.peak_live_bytes = (std::min)(claim, this->m_capacity) * elem_size;
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+
+	T*										m_data;
+	std::atomic<int64_t>*					m_published;
+	TAllocator<T>							m_allocator;
+	TAllocator<std::atomic<int64_t>>		m_sequence_allocator;
+	int64_t									m_capacity;
+	int64_t									m_mask;
+	const bool								m_lossy;
+
+	alignas(64) std::atomic<int64_t>		m_claim;
+	alignas(64) std::atomic<int64_t>		m_gate_cache;
+
+	std::unique_ptr<consumer_cursor[]>		m_consumers;
+	const int64_t							m_max_consumers;
+	wait_free_registration					m_registration{ this, "wait_free_broadcast_ring", false };
+
+	int64_t min_cursor() const noexcept
+	{
+		int64_t ret(INACTIVE_CURSOR);
+		for (int64_t i = 0; i < this->m_max_consumers; i++)
+		{
+			ret = (std::min)(ret, this->m_consumers[i].cursor.load(std::memory_order_acquire));
+		}
+
+		return ret;
+	}
+
+	void wait_for_gate(int64_t wrap_point) noexcept
+	{
+		if (wrap_point <= this->m_gate_cache.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		//with no active consumer the gate is the claim, never INACTIVE_CURSOR, a consumer added later starts at or past it
+		int64_t gate(0);
+		while ((gate = min_cursor()) < wrap_point)
+		{
+			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::yield);
+		}
+
+		if (gate == INACTIVE_CURSOR)
+		{
+			gate = this->m_claim.load();
+		}
+
+		this->m_gate_cache.store(gate);
+
+		//an add_consumer between the cursor scan and the store had its lowered gate overwritten, scan again,
+		//either this sees its cursor or its lower_gate sees the store
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		lower_gate(min_cursor());
+	}
+
+	void lower_gate(int64_t cursor) noexcept
+	{
+		int64_t gate = this->m_gate_cache.load();
+		while (gate > cursor && !this->m_gate_cache.compare_exchange_weak(gate, cursor))
+		{
+		}
+	}
+
+	//lossy producers a lap apart can hit the same slot, the newer one waits for the older to publish so it never
+	//publishes over it, then marks the slot WRITING so a consumer copying it sees the overwrite
+	//a producer only ever waits on an older sequence, so producers holding part of a range never wait in a cycle
+	void acquire_slot(int64_t sequence) noexcept
+	{
+		std::atomic<int64_t>& published = this->m_published[sequence & this->m_mask];
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
+		while (published.load(std::memory_order_acquire) != sequence - this->m_capacity)
+		{
+			spin.tick();
+			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::spin_wait);
+		}
+
+		published.store(WRITING, std::memory_order_relaxed);
+	}
+
+	//claim already waited on the gate or, lossy, owns the slot
+	void write(int64_t sequence, const T& value)
+	{
+		this->m_data[sequence & this->m_mask] = value;
+		this->m_published[sequence & this->m_mask].store(sequence, std::memory_order_release);
+	}
+
+	//lossy mode, move a lapped consumer to the oldest sequence still in the ring
+	int64_t skip_lost(int64_t consumer, int64_t cursor) noexcept
+	{
+		if (!this->m_lossy)
+		{
+			return cursor;
+		}
+
+		int64_t oldest = this->m_claim.load(std::memory_order_acquire) - this->m_capacity;
+		if (cursor < oldest)
+		{
+			this->m_consumers[consumer].lost.fetch_add(oldest - cursor, std::memory_order_relaxed);
+			this->m_consumers[consumer].cursor.store(oldest, std::memory_order_release);
+			return oldest;
+		}
+
+		return cursor;
+	}
+};
@@ -10,6 +10,9 @@
 #include <memory>
 
 #include "template_util.hpp"
+#include "wait_free_atomic.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_pages.hpp"
 
 enum class wait_free_elem_state : int64_t  
 { 
@@ -21,14 +24,15 @@ enum class wait_free_elem_state : int64_t
 
 //ڵԪelem value
 template<typename T, template<typename U> typename TAllocator>
-class wait_free_buffer_base 
+class wait_free_buffer_base : protected wait_free_stats_base
 {
-	
+	static_assert(wait_free_atomic_lock_free_v<T>, "wait_free_buffer element is not lock free as an atomic, define WAIT_FREE_ALLOW_LOCKING_ATOMICS=1 to accept a locking slot");
+
 	using base = wait_free_buffer_base;
 
 public:
 
-	explicit wait_free_buffer_base(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+	explicit wait_free_buffer_base(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		m_data(nullptr),
 		m_allocator(allocator),
 		m_inserting_value(inserting),
@@ -36,14 +40,15 @@ public:
 		m_cur_pos(0),
 		m_size(0),
 		m_elem_operating(0),
-		m_buffer_operating(0)
+		m_buffer_operating(0),
+		m_growth_count(0)
 	{
 
 		this->m_data = this->m_allocator.allocate(capacity);
 		assert(m_data);
 
 		std::for_each(this->m_data, this->m_data + capacity,
-		[=](std::atomic<T>& elem)
+		[this](wait_free_atomic<T>& elem)
 		{
 			elem.store(this->m_inserting_value);
 		});
@@ -53,7 +58,9 @@ public:
 
 	~wait_free_buffer_base()
 	{
-		mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+		this->m_registration.remove();
+
+		mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
 		this->m_allocator.deallocate(this->m_data, this->m_capacity);
 		this->m_data = nullptr;
@@ -71,19 +78,19 @@ public:
 			value != this->m_free_value);
 
 		int64_t old_pos(0);
-        T old_elem{};
 
 		while (true)
 		{
 			while (true)
 			{
-				mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+				mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
 				old_pos = this->m_cur_pos;
 				if (old_pos >= this->m_capacity)
 				{
 					this->m_elem_operating--;
 					std::this_thread::yield();
+					this->m_stats.add(wait_free_stat::yield);
 				}
 				else 
 				{
@@ -91,7 +98,7 @@ public:
 				}
 			}
 
-			if (this->m_cur_pos.compare_exchange_strong(old_pos, old_pos + 1))
+			if (this->m_stats.count_cas(this->m_cur_pos.compare_exchange_strong(old_pos, old_pos + 1)))
 			{
 				break;
 			}
@@ -101,11 +108,10 @@ public:
 			}
 		}
 	
-		old_elem = this->m_data[old_pos];
-		assert(old_elem == this->m_inserting_value);
+		assert(this->m_data[old_pos] == this->m_inserting_value);
 		this->m_data[old_pos].store(value);
 
-		this->m_size++;
+		this->m_peak_size.update(++this->m_size);
 		this->m_elem_operating--;
 
 		if (old_pos >= this->m_capacity - 1)
@@ -123,7 +129,7 @@ public:
 
 		T old_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -141,7 +147,7 @@ public:
 		} 
 		while (!this->m_data[index].compare_exchange_strong(old_elem, value));
 
-		this->m_size++;
+		this->m_peak_size.update(++this->m_size);
 		this->m_elem_operating--;
 
 		return true;
@@ -152,7 +158,7 @@ public:
         T old_elem{};
 		bool wait_for_inserting(false);
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		
 		assert(index >= 0);
 
@@ -164,6 +170,7 @@ public:
 
 		do
 		{
+			wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 			do
 			{
 				old_elem = this->m_data[index];
@@ -176,7 +183,9 @@ public:
 				wait_for_inserting = old_elem == this->m_inserting_value;
 				if (wait_for_inserting)
 				{
+					spin.tick();
 					std::this_thread::yield();
+					this->m_stats.add(wait_free_stat::spin_wait);
 				}
 			} 
 			while (wait_for_inserting);
@@ -197,9 +206,9 @@ public:
 	//ԪزΪfree,inserting,Ԫֵ,size
 	bool store(int64_t index, T value) noexcept
 	{
-		T old_elem();
+		T old_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -225,10 +234,10 @@ public:
 
 	bool load(int64_t index, T& elem) const noexcept
 	{
-		T old_elem();
+		T old_elem{};
 		bool wait_for_inserting(false);
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
 		if (index >= this->m_cur_pos)
 		{
@@ -236,6 +245,7 @@ public:
 			return false;
 		}
 
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 		do
 		{
 			old_elem = this->m_data[index];
@@ -248,7 +258,9 @@ public:
 			wait_for_inserting = old_elem == this->m_inserting_value;
 			if (wait_for_inserting)
 			{
+				spin.tick();
 				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
 			}
 		} 
 		while (wait_for_inserting);
@@ -263,7 +275,7 @@ public:
 	{
 		wait_free_elem_state ret;
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
 		if (index >= this->m_cur_pos)
 		{
@@ -298,7 +310,7 @@ public:
 		assert(compare_value != this->m_inserting_value &&
 			compare_value != this->m_free_value);
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos) 
 		{
 			this->m_elem_operating--;
@@ -320,14 +332,14 @@ public:
 		assert(compare_value != this->m_inserting_value &&
 			compare_value != this->m_free_value);
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
 			return false;
 		}
 
-		exchanged = this->m_data[index].compare_and_exchange_weak(compare_value, exchange_value);
+		exchanged = this->m_data[index].compare_exchange_weak(compare_value, exchange_value);
 
 		this->m_elem_operating--;
 
@@ -336,15 +348,15 @@ public:
 
 	void clear() noexcept
 	{
-		mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+		mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
 		std::for_each(this->m_data, this->m_data + this->m_cur_pos,
-		[=](std::atomic<T> &elem)
+		[this](wait_free_atomic<T> &elem)
 		{
 			assert(elem != this->m_inserting_value);
 			if (elem != this->m_free_value)
 			{
-				elem.~atomic<T>();
+				std::destroy_at(&elem);
 				elem.store(this->m_inserting_value);
 			}
 		});
@@ -364,7 +376,7 @@ public:
 			increase_capacity((new_cur_pos + 1) * 1.5);
 		}
 
-		mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+		mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
 		if (new_cur_pos > this->m_cur_pos) 
 		{
@@ -373,11 +385,11 @@ public:
 		else 
 		{
 			std::for_each(this->m_data + new_cur_pos, this->m_data + this->m_cur_pos + 1, 
-			[=](std::atomic<T>& elem) 
+			[this](wait_free_atomic<T>& elem) 
 			{
 				if (elem == this->m_free_value) 
 				{
-					elem.~atomic<T>();
+					std::destroy_at(&elem);
 				}
 				elem = this->m_inserting_value;
 			});
@@ -403,6 +415,34 @@ public:
 		return this->m_capacity;
 	}
 
+	//grows to capacity and prepares the pages up front, so neither a resize nor first touch faults land on the hot path
+	//meant for startup, before other threads use the buffer, false when a requested lock failed
+	bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+	{
+		wait_free_set_reserve_options(this->m_allocator, options);
+		if (capacity > this->m_capacity)
+		{
+			increase_capacity(capacity);
+		}
+
+		return wait_free_prepare_storage(this->m_allocator, this->m_data, this->m_capacity * sizeof(wait_free_atomic<T>), options);
+	}
+
+	//removed slots below cur_pos are the free list, insert() refills them
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t slot_size = static_cast<int64_t>(sizeof(wait_free_atomic<T>));
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_capacity * slot_size;
+		ret.live_bytes = this->m_size * slot_size;
+		ret.free_list_length = (std::max)(this->m_cur_pos - this->m_size, static_cast<int64_t>(0));
+		ret.peak_live_bytes = this->m_peak_size.get() * slot_size;
+		ret.growth_count = this->m_growth_count;
+
+		return ret;
+	}
+
 	const T& inserting_value() const noexcept
 	{
 		return m_inserting_value;
@@ -413,9 +453,14 @@ public:
 		return m_free_value;
 	}
 
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
 protected:
-	std::atomic<T>*						m_data;
-	TAllocator<std::atomic<T>>			m_allocator;
+	wait_free_atomic<T>*						m_data;
+	TAllocator<wait_free_atomic<T>>			m_allocator;
 	const T								m_inserting_value;
 	const T								m_free_value;
 	std::atomic<int64_t>				m_cur_pos;
@@ -423,10 +468,13 @@ protected:
 	std::atomic<int64_t>				m_capacity;
 	mutable std::atomic<int64_t>		m_elem_operating;
 	mutable std::atomic<int64_t>		m_buffer_operating;
+	std::atomic<int64_t>				m_growth_count;
+	wait_free_high_water				m_peak_size;
+	wait_free_registration				m_registration{ this, "wait_free_buffer" };
 
 	void increase_capacity(int64_t new_capacity)
 	{
-		mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+		mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
 		if (new_capacity < m_capacity) 
 		{
@@ -434,7 +482,12 @@ protected:
 			return;
 		}
 
-		std::atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
+		wait_free_stats::stall_timer stall_timer(this->m_stats);
+		wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+		this->m_stats.add(wait_free_stat::resize);
+		this->m_growth_count++;
+
+		wait_free_atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
 		assert(new_data);
 		std::fill_n(new_data, new_capacity, this->m_inserting_value);
 
@@ -458,7 +511,7 @@ class wait_free_buffer_object : public wait_free_buffer_base<T, TAllocator>
 	using base = wait_free_buffer_base<T, TAllocator>;
 
 public:
-    explicit wait_free_buffer_object(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_buffer_object(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		base(inserting, free, capacity, allocator)
 	{
 	}
@@ -474,7 +527,7 @@ class wait_free_buffer_integer : public wait_free_buffer_base<T, TAllocator>
 	using base = wait_free_buffer_base<T, TAllocator>;
 
 public:
-    explicit wait_free_buffer_integer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_buffer_integer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		base(inserting, free, capacity, allocator)
 	{
 	}
@@ -485,10 +538,10 @@ public:
 	
 	bool fetch_add(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating, this->m_resizing);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -517,10 +570,10 @@ public:
 
 	bool fetch_and(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating, this->m_resizing);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -548,10 +601,10 @@ public:
 
 	bool fetch_or(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating, this->m_resizing);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -580,10 +633,10 @@ public:
 
 	bool fetch_sub(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating, this->m_resizing);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -605,17 +658,17 @@ public:
 
 		result = old_elem;
 
-		this->m_setting--;
+		this->m_elem_operating--;
 
 		return true;
 	}
 
 	bool fetch_xor(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating, this->m_resizing);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -637,7 +690,7 @@ public:
 
 		result = old_elem;
 
-		this->m_setting--;
+		this->m_elem_operating--;
 
 		return true;
 	}
@@ -649,7 +702,7 @@ class wait_free_buffer_pointer : public wait_free_buffer_base<T, TAllocator>
 	using base = wait_free_buffer_base<T, TAllocator>;
 
 public:
-    explicit wait_free_buffer_pointer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_buffer_pointer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		base(inserting, free, capacity, allocator)
 	{
 	}
@@ -660,10 +713,10 @@ public:
 
 	bool fetch_add(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
 			this->m_elem_operating--;
@@ -684,20 +737,20 @@ public:
 
 		result = old_elem;
 
-		this->m_setting--;
+		this->m_elem_operating--;
 
 		return true;
 	}
 
 	bool fetch_sub(int64_t index, T operand, T& result) noexcept
 	{
-		T old_elem();
-		T new_elem();
+		T old_elem{};
+		T new_elem{};
 
-		mutex_check_weak(this->m_setting, this->m_buffer_operating);
+		mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 		if (index >= this->m_cur_pos)
 		{
-			this->m_setting--;
+			this->m_elem_operating--;
 			return false;
 		}
 
@@ -707,7 +760,7 @@ public:
 			if (old_elem == this->m_free_value ||
 				old_elem == this->m_inserting_value)
 			{
-				this->m_setting--;
+				this->m_elem_operating--;
 				return false;
 			}
 			new_elem = old_elem - operand;
@@ -716,7 +769,7 @@ public:
 
 		result = old_elem;
 
-		this->m_setting--;
+		this->m_elem_operating--;
 
 		return true;
 	}
@@ -732,7 +785,7 @@ class wait_free_buffer : public wait_free_buffer_base_t<T, TAllocator>
 	using base = wait_free_buffer_base_t<T, TAllocator>;
 
 public:
-    explicit wait_free_buffer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_buffer(const T& inserting, const T& free, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		base(inserting, free, capacity, allocator)
 	{
 	}
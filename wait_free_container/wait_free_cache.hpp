@@ -0,0 +1,549 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#include "wait_free_events.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_sharded_counter.hpp"
+#include "wait_free_stats.hpp"
+
+struct wait_free_cache_stats
+{
+	int64_t		hits{ 0 };
+	int64_t		misses{ 0 };
+	int64_t		evictions{ 0 };
+	//inserts dropped because every entry of their index bucket was taken
+	int64_t		rejected{ 0 };
+
+	double hit_rate() const noexcept
+	{
+		return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+	}
+};
+
+//fixed size key / value cache with clock (second chance) eviction, e.g. in front of an expensive computation
+//entries live in slots of a wait_free_memory_pool, all taken at construction so the storage never moves and a lookup
+//doesn't need the pool gate; the clock hand walks the slots and hands out the first one whose reference bit is clear
+//the index is a fixed set associative table, a bucket is one cache line of 8 entries of (hash tag, slot offset),
+//an insert whose bucket is full is dropped, the table has 4 entries per slot so that is rare
+//an insert of a cached key rewrites its slot in place, a new key first claims a free entry with a pending mark and only
+//then takes a slot from the hand; inserts and erases wait while an entry of the same tag is pending or its slot is being
+//written, since it may hold their key, so a key is indexed at most once
+//a slot is a seqlock over atomic words: a lookup copies it, checks the version didn't move and the key matches,
+//so a hit writes nothing but the slot's reference bit, once, and its thread's shard of the hit counter
+//K and V are copied bytewise and compared with ==, both have to be trivially copyable
+template<typename K, typename V, typename THash = std::hash<K>, template<typename U> typename TAllocator = std::allocator>
+class wait_free_cache : private wait_free_stats_base
+{
+	static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "wait_free_cache key and value must be trivially copyable");
+
+	static constexpr int64_t KEY_WORDS = (static_cast<int64_t>(sizeof(K)) + 7) / 8;
+	static constexpr int64_t VALUE_WORDS = (static_cast<int64_t>(sizeof(V)) + 7) / 8;
+	static constexpr int64_t BUCKET_WAYS = 8;
+	static constexpr int64_t ENTRIES_PER_SLOT = 4;
+	static constexpr uint64_t OFFSET_MASK = (1ull << 48) - 1;
+	static constexpr int64_t BUSY = -2;
+
+	enum counter : int64_t
+	{
+		hit_counter = 0,
+		miss_counter,
+		eviction_counter,
+		rejected_counter,
+		counter_count
+	};
+
+	//version is odd while a writer owns the slot, occupied when an index entry points at it
+	struct slot
+	{
+		using wait_free_trivially_relocatable = std::true_type;
+
+		std::atomic<uint64_t>		version;
+		std::atomic<uint32_t>		referenced;
+		std::atomic<uint32_t>		occupied;
+		std::atomic<uint64_t>		hash;
+		std::atomic<uint64_t>		words[KEY_WORDS + VALUE_WORDS];
+	};
+
+	//an entry is tag << 48 | (offset + 1), 0 is empty, an offset field of all ones is an insert that has no slot yet
+	struct alignas(64) bucket
+	{
+		std::atomic<uint64_t>		entries[BUCKET_WAYS];
+	};
+
+	using pool_type = wait_free_memory_pool<slot, TAllocator>;
+
+public:
+	//bytes one entry takes, slot plus its share of the index
+	static constexpr int64_t entry_bytes() noexcept
+	{
+		return static_cast<int64_t>(sizeof(slot)) + ENTRIES_PER_SLOT * static_cast<int64_t>(sizeof(uint64_t));
+	}
+
+	//entries that fit in bytes of memory
+	static constexpr int64_t capacity_for_bytes(int64_t bytes) noexcept
+	{
+		return bytes / entry_bytes();
+	}
+
+	//capacity entries, it has to be larger than the number of threads inserting at once
+	explicit wait_free_cache(int64_t capacity, const TAllocator<slot>& allocator = TAllocator<slot>()) :
+		m_pool(capacity, allocator),
+		m_slots(nullptr),
+		m_capacity(capacity),
+		m_buckets(nullptr),
+		m_bucket_mask(0),
+		m_hand(0),
+		m_size(0),
+		m_counters(counter_count)
+	{
+		assert(capacity > 0);
+
+		for (int64_t i = 0; i < capacity; i++)
+		{
+			int64_t offset = static_cast<int64_t>(this->m_pool.allocate().offset());
+			assert(offset == i);
+			(void)offset;
+		}
+
+		this->m_slots = this->m_pool.get_base();
+		for (int64_t i = 0; i < capacity; i++)
+		{
+			slot& s = this->m_slots[i];
+			s.version.store(0, std::memory_order_relaxed);
+			s.referenced.store(0, std::memory_order_relaxed);
+			s.occupied.store(0, std::memory_order_relaxed);
+			s.hash.store(0, std::memory_order_relaxed);
+		}
+
+		int64_t bucket_count(1);
+		while (bucket_count * BUCKET_WAYS < capacity * ENTRIES_PER_SLOT)
+		{
+			bucket_count <<= 1;
+		}
+
+		this->m_buckets.reset(new bucket[bucket_count]);
+		this->m_bucket_mask = bucket_count - 1;
+		for (int64_t i = 0; i < bucket_count; i++)
+		{
+			for (int64_t way = 0; way < BUCKET_WAYS; way++)
+			{
+				this->m_buckets[i].entries[way].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		this->m_registration.add();
+	}
+
+	wait_free_cache(const wait_free_cache&) = delete;
+	wait_free_cache& operator=(const wait_free_cache&) = delete;
+
+	bool find(const K& key, V& value) noexcept
+	{
+		uint64_t hash = hash_of(key);
+		bucket& b = bucket_of(hash);
+
+		for (int64_t way = 0; way < BUCKET_WAYS; way++)
+		{
+			uint64_t entry = b.entries[way].load(std::memory_order_acquire);
+			if (entry == 0 || tag_of(entry) != tag_of_hash(hash) || is_pending(entry))
+			{
+				continue;
+			}
+
+			slot& s = this->m_slots[offset_of(entry)];
+			if (read(s, key, &value) == 0)
+			{
+				continue;
+			}
+
+			if (s.referenced.load(std::memory_order_relaxed) == 0)
+			{
+				s.referenced.store(1, std::memory_order_relaxed);
+			}
+
+			this->m_counters.increment(hit_counter);
+			return true;
+		}
+
+		this->m_counters.increment(miss_counter);
+		return false;
+	}
+
+	bool contains(const K& key) noexcept
+	{
+		V value{};
+		return find(key, value);
+	}
+
+	//replaces the value cached for key, false when its bucket is full and the value isn't cached
+	bool insert(const K& key, const V& value) noexcept
+	{
+		uint64_t hash = hash_of(key);
+		bucket& b = bucket_of(hash);
+
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
+		while (true)
+		{
+			uint64_t entry(0);
+			uint64_t version(0);
+			int64_t empty_way(-1);
+			int64_t way = locate(b, hash, key, entry, version, empty_way, -1);
+			if (way == BUSY)
+			{
+				spin.tick();
+				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
+				continue;
+			}
+
+			if (way >= 0)
+			{
+				slot& s = this->m_slots[offset_of(entry)];
+				if (!this->m_stats.count_cas(s.version.compare_exchange_strong(version, version + 1, std::memory_order_acq_rel)))
+				{
+					continue;
+				}
+
+				write(s, hash, key, value);
+				s.version.store(version + 2, std::memory_order_release);
+				return true;
+			}
+
+			if (empty_way == -1)
+			{
+				this->m_counters.increment(rejected_counter);
+				return false;
+			}
+
+			uint64_t expected(0);
+			if (!this->m_stats.count_cas(b.entries[empty_way].compare_exchange_strong(expected, make_pending(hash), std::memory_order_seq_cst)))
+			{
+				continue;
+			}
+
+			//an insert of the same key may have claimed another entry meanwhile, the claims and the scans are seq_cst so at
+			//least one of the two sees the other, and whoever does backs off and waits for the other to finish
+			int64_t other_empty_way(-1);
+			if (locate(b, hash, key, entry, version, other_empty_way, empty_way) != -1)
+			{
+				b.entries[empty_way].store(0, std::memory_order_release);
+				continue;
+			}
+
+			int64_t offset = evict(version);
+			slot& s = this->m_slots[offset];
+			write(s, hash, key, value);
+
+			//indexed before the slot is published, a lookup that finds the entry early sees an odd version and moves on
+			b.entries[empty_way].store(make_entry(hash, offset), std::memory_order_release);
+			this->m_size.fetch_add(1, std::memory_order_relaxed);
+			s.version.store(version + 2, std::memory_order_release);
+
+			return true;
+		}
+	}
+
+	bool erase(const K& key) noexcept
+	{
+		uint64_t hash = hash_of(key);
+		bucket& b = bucket_of(hash);
+
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
+		while (true)
+		{
+			uint64_t entry(0);
+			uint64_t version(0);
+			int64_t empty_way(-1);
+			int64_t way = locate(b, hash, key, entry, version, empty_way, -1);
+			if (way == BUSY)
+			{
+				spin.tick();
+				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
+				continue;
+			}
+
+			if (way == -1)
+			{
+				return false;
+			}
+
+			//claimed by an eviction or a rewrite meanwhile, look again
+			slot& s = this->m_slots[offset_of(entry)];
+			if (!this->m_stats.count_cas(s.version.compare_exchange_strong(version, version + 1, std::memory_order_acq_rel)))
+			{
+				continue;
+			}
+
+			if (this->m_stats.count_cas(b.entries[way].compare_exchange_strong(entry, 0, std::memory_order_acq_rel)))
+			{
+				this->m_size.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			s.occupied.store(0, std::memory_order_relaxed);
+			s.referenced.store(0, std::memory_order_relaxed);
+			s.version.store(version + 2, std::memory_order_release);
+
+			return true;
+		}
+	}
+
+	//indexed entries
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>((std::max)(this->m_size.load(std::memory_order_relaxed), static_cast<int64_t>(0)));
+	}
+
+	size_t capacity() const noexcept
+	{
+		return static_cast<size_t>(this->m_capacity);
+	}
+
+	wait_free_cache_stats cache_stats() const noexcept
+	{
+		wait_free_cache_stats ret;
+		ret.hits = this->m_counters.load(hit_counter);
+		ret.misses = this->m_counters.load(miss_counter);
+		ret.evictions = this->m_counters.load(eviction_counter);
+		ret.rejected = this->m_counters.load(rejected_counter);
+
+		return ret;
+	}
+
+	//slot pool, index and counters; every slot is taken from the pool up front, live_bytes counts the cached entries
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret = this->m_pool.memory_usage();
+		ret += this->m_counters.memory_usage();
+		ret.reserved_bytes += (this->m_bucket_mask + 1) * static_cast<int64_t>(sizeof(bucket));
+		ret.live_bytes = static_cast<int64_t>(size()) * entry_bytes();
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret = this->m_stats.snapshot();
+		ret += this->m_pool.stats();
+
+		return ret;
+	}
+
+private:
+	pool_type											m_pool;
+	slot*												m_slots;
+	int64_t												m_capacity;
+	std::unique_ptr<bucket[]>							m_buckets;
+	int64_t												m_bucket_mask;
+	alignas(64) std::atomic<uint64_t>					m_hand;
+	alignas(64) std::atomic<int64_t>					m_size;
+	wait_free_sharded_counter_array<int64_t>			m_counters;
+	wait_free_registration								m_registration{ this, "wait_free_cache", false };
+
+	//integer std::hash is the identity, mixed so the tag and the bucket come from different bits
+	static uint64_t hash_of(const K& key) noexcept
+	{
+		uint64_t h = static_cast<uint64_t>(THash()(key));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+
+		return h;
+	}
+
+	bucket& bucket_of(uint64_t hash) const noexcept
+	{
+		return this->m_buckets[static_cast<int64_t>(hash) & this->m_bucket_mask];
+	}
+
+	static uint64_t tag_of_hash(uint64_t hash) noexcept
+	{
+		return hash >> 48;
+	}
+
+	static uint64_t tag_of(uint64_t entry) noexcept
+	{
+		return entry >> 48;
+	}
+
+	static int64_t offset_of(uint64_t entry) noexcept
+	{
+		return static_cast<int64_t>(entry & OFFSET_MASK) - 1;
+	}
+
+	static uint64_t make_entry(uint64_t hash, int64_t offset) noexcept
+	{
+		return (tag_of_hash(hash) << 48) | static_cast<uint64_t>(offset + 1);
+	}
+
+	static uint64_t make_pending(uint64_t hash) noexcept
+	{
+		return (tag_of_hash(hash) << 48) | OFFSET_MASK;
+	}
+
+	static bool is_pending(uint64_t entry) noexcept
+	{
+		return (entry & OFFSET_MASK) == OFFSET_MASK;
+	}
+
+	//way of the entry whose published slot holds key, entry and the slot's even version with it, -1 when the bucket
+	//doesn't hold key, BUSY when an entry of the same tag is pending or its slot is being written, skip_way aside
+	//empty_way gets the first free way seen
+	int64_t locate(bucket& b, uint64_t hash, const K& key, uint64_t& entry, uint64_t& version, int64_t& empty_way, int64_t skip_way) const noexcept
+	{
+		for (int64_t way = 0; way < BUCKET_WAYS; way++)
+		{
+			if (way == skip_way)
+			{
+				continue;
+			}
+
+			uint64_t other = b.entries[way].load(std::memory_order_seq_cst);
+			if (other == 0)
+			{
+				empty_way = empty_way == -1 ? way : empty_way;
+				continue;
+			}
+
+			if (tag_of(other) != tag_of_hash(hash))
+			{
+				continue;
+			}
+
+			if (is_pending(other))
+			{
+				return BUSY;
+			}
+
+			const slot& s = this->m_slots[offset_of(other)];
+			uint64_t other_version = read(s, key, nullptr);
+			if (other_version != 0)
+			{
+				entry = other;
+				version = other_version - 1;
+				return way;
+			}
+
+			if ((s.version.load(std::memory_order_acquire) & 1) != 0)
+			{
+				return BUSY;
+			}
+		}
+
+		return -1;
+	}
+
+	//copy of a published slot holding key, its version + 1 (never 0) or 0 when it is being written or holds another key
+	uint64_t read(const slot& s, const K& key, V* value) const noexcept
+	{
+		uint64_t words[KEY_WORDS + VALUE_WORDS];
+		uint64_t version = s.version.load(std::memory_order_acquire);
+		if ((version & 1) != 0 || s.occupied.load(std::memory_order_relaxed) == 0)
+		{
+			return 0;
+		}
+
+		int64_t count = value != nullptr ? KEY_WORDS + VALUE_WORDS : KEY_WORDS;
+		for (int64_t i = 0; i < count; i++)
+		{
+			words[i] = s.words[i].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s.version.load(std::memory_order_relaxed) != version)
+		{
+			return 0;
+		}
+
+		K k;
+		memcpy(&k, words, sizeof(K));
+		if (!(k == key))
+		{
+			return 0;
+		}
+
+		if (value != nullptr)
+		{
+			memcpy(value, words + KEY_WORDS, sizeof(V));
+		}
+
+		return version + 1;
+	}
+
+	//the caller owns s, its version is odd
+	static void write(slot& s, uint64_t hash, const K& key, const V& value) noexcept
+	{
+		uint64_t words[KEY_WORDS + VALUE_WORDS] = {};
+		memcpy(words, &key, sizeof(K));
+		memcpy(words + KEY_WORDS, &value, sizeof(V));
+
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int64_t i = 0; i < KEY_WORDS + VALUE_WORDS; i++)
+		{
+			s.words[i].store(words[i], std::memory_order_relaxed);
+		}
+
+		s.hash.store(hash, std::memory_order_relaxed);
+		s.referenced.store(0, std::memory_order_relaxed);
+		s.occupied.store(1, std::memory_order_relaxed);
+	}
+
+	//clock sweep: a set reference bit buys the slot one more lap, the first clear one is claimed, its entry unindexed
+	//returns the claimed slot, version gets its even version from before the claim
+	int64_t evict(uint64_t& version) noexcept
+	{
+		while (true)
+		{
+			int64_t offset = static_cast<int64_t>(this->m_hand.fetch_add(1, std::memory_order_relaxed) % static_cast<uint64_t>(this->m_capacity));
+			slot& s = this->m_slots[offset];
+
+			version = s.version.load(std::memory_order_acquire);
+			if ((version & 1) != 0)
+			{
+				continue;
+			}
+
+			if (s.referenced.load(std::memory_order_relaxed) != 0)
+			{
+				s.referenced.store(0, std::memory_order_relaxed);
+				continue;
+			}
+
+			if (!this->m_stats.count_cas(s.version.compare_exchange_strong(version, version + 1, std::memory_order_acq_rel)))
+			{
+				continue;
+			}
+
+			if (s.occupied.load(std::memory_order_relaxed) != 0)
+			{
+				uint64_t hash = s.hash.load(std::memory_order_relaxed);
+				bucket& b = bucket_of(hash);
+				for (int64_t way = 0; way < BUCKET_WAYS; way++)
+				{
+					uint64_t entry = make_entry(hash, offset);
+					if (this->m_stats.count_cas(b.entries[way].compare_exchange_strong(entry, 0, std::memory_order_acq_rel)))
+					{
+						this->m_size.fetch_sub(1, std::memory_order_relaxed);
+						this->m_counters.increment(eviction_counter);
+						break;
+					}
+				}
+			}
+
+			return offset;
+		}
+	}
+};
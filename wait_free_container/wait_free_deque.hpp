@@ -0,0 +1,242 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "template_util.hpp"
+#include "wait_free_atomic.hpp"
+#include "wait_free_memory.hpp"
+
+//chase-lev work-stealing deque, the owner thread push_bottom/pop_bottom (lifo), other threads steal (fifo)
+//the circular array grows by publishing a new array, old arrays are retired but kept alive until the deque destructs,
+//so thieves that still hold an old array read a valid slot and never block the owner
+template<typename T, template<typename U> typename TAllocator = std::allocator>
+class wait_free_deque : private wait_free_stats_base
+{
+	static_assert(wait_free_atomic_lock_free_v<T>, "wait_free_deque element is not lock free as an atomic, define WAIT_FREE_ALLOW_LOCKING_ATOMICS=1 to accept a locking slot");
+
+	struct circular_array
+	{
+		wait_free_atomic<T>*		data;
+		int64_t				capacity;
+		circular_array*		retired;
+	};
+
+public:
+	explicit wait_free_deque(int64_t capacity = 16, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
+		m_top(0),
+		m_bottom(0),
+		m_array(nullptr),
+		m_allocator(allocator),
+		m_array_allocator(),
+		m_reserved_bytes(0),
+		m_growth_count(0)
+	{
+		assert(capacity > 0);
+
+		int64_t pow2_capacity(1);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		this->m_array = allocate_array(pow2_capacity);
+	}
+
+	~wait_free_deque()
+	{
+		this->m_registration.remove();
+
+		circular_array* array = this->m_array.load();
+		while (array)
+		{
+			circular_array* retired = array->retired;
+			deallocate_array(array);
+			array = retired;
+		}
+	}
+
+	wait_free_deque(const wait_free_deque&) = delete;
+	wait_free_deque& operator=(const wait_free_deque&) = delete;
+
+	//owner thread only
+	void push_bottom(const T& value)
+	{
+		int64_t bottom = this->m_bottom.load(std::memory_order_relaxed);
+		int64_t top = this->m_top.load(std::memory_order_acquire);
+		circular_array* array = this->m_array.load(std::memory_order_relaxed);
+
+		if (bottom - top > array->capacity - 1)
+		{
+			array = grow(array, top, bottom);
+		}
+
+		array->data[bottom & (array->capacity - 1)].store(value, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		this->m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		this->m_peak_size.update(bottom + 1 - top);
+	}
+
+	//owner thread only
+	bool pop_bottom(T& elem) noexcept
+	{
+		int64_t bottom = this->m_bottom.load(std::memory_order_relaxed) - 1;
+		circular_array* array = this->m_array.load(std::memory_order_relaxed);
+		this->m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = this->m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			this->m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		T value = array->data[bottom & (array->capacity - 1)].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			//last element, race with thieves through top
+			bool won = this->m_stats.count_cas(this->m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed));
+			this->m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			if (!won)
+			{
+				return false;
+			}
+		}
+
+		elem = value;
+
+		return true;
+	}
+
+	//any thread, false when empty or lost the race to another thief / the owner
+	bool steal(T& elem) noexcept
+	{
+		int64_t top = this->m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = this->m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+		{
+			return false;
+		}
+
+		circular_array* array = this->m_array.load(std::memory_order_acquire);
+		T value = array->data[top & (array->capacity - 1)].load(std::memory_order_relaxed);
+		if (!this->m_stats.count_cas(this->m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)))
+		{
+			return false;
+		}
+
+		elem = value;
+
+		return true;
+	}
+
+	size_t size() const noexcept
+	{
+		int64_t bottom = this->m_bottom.load(std::memory_order_relaxed);
+		int64_t top = this->m_top.load(std::memory_order_relaxed);
+
+		return static_cast<size_t>((std::max)(bottom - top, static_cast<int64_t>(0)));
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	size_t capacity() const noexcept
+	{
+		return this->m_array.load(std::memory_order_relaxed)->capacity;
+	}
+
+	//retired arrays stay allocated until the deque destructs and count as reserved
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t slot_size = static_cast<int64_t>(sizeof(wait_free_atomic<T>));
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_reserved_bytes.load(std::memory_order_relaxed);
+		ret.live_bytes = static_cast<int64_t>(size()) * slot_size;
+		ret.peak_live_bytes = this->m_peak_size.get() * slot_size;
+		ret.growth_count = this->m_growth_count.load(std::memory_order_relaxed);
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+
+	alignas(64) std::atomic<int64_t>		m_top;
+	alignas(64) std::atomic<int64_t>		m_bottom;
+	alignas(64) std::atomic<circular_array*>	m_array;
+	TAllocator<wait_free_atomic<T>>				m_allocator;
+	TAllocator<circular_array>				m_array_allocator;
+	std::atomic<int64_t>					m_reserved_bytes;
+	std::atomic<int64_t>					m_growth_count;
+	wait_free_high_water					m_peak_size;
+	wait_free_registration					m_registration{ this, "wait_free_deque" };
+
+	circular_array* allocate_array(int64_t capacity)
+	{
+		circular_array* array = this->m_array_allocator.allocate(1);
+		assert(array);
+
+		array->data = this->m_allocator.allocate(capacity);
+		assert(array->data);
+		std::for_each(array->data, array->data + capacity,
+		[](wait_free_atomic<T>& elem)
+		{
+			new (&elem) wait_free_atomic<T>();
+		});
+
+		array->capacity = capacity;
+		array->retired = nullptr;
+		this->m_reserved_bytes.fetch_add(static_cast<int64_t>(sizeof(circular_array) + capacity * sizeof(wait_free_atomic<T>)), std::memory_order_relaxed);
+
+		return array;
+	}
+
+	void deallocate_array(circular_array* array) noexcept
+	{
+		std::for_each(array->data, array->data + array->capacity,
+		[](wait_free_atomic<T>& elem)
+		{
+			std::destroy_at(&elem);
+		});
+
+		this->m_allocator.deallocate(array->data, array->capacity);
+		this->m_array_allocator.deallocate(array, 1);
+	}
+
+	//owner thread only, thieves keep reading the old array until they see the new pointer
+	circular_array* grow(circular_array* old_array, int64_t top, int64_t bottom)
+	{
+		wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+		this->m_stats.add(wait_free_stat::resize);
+		this->m_growth_count.fetch_add(1, std::memory_order_relaxed);
+
+		circular_array* new_array = allocate_array(old_array->capacity * 2);
+		for (int64_t i = top; i < bottom; i++)
+		{
+			new_array->data[i & (new_array->capacity - 1)].store(
+				old_array->data[i & (old_array->capacity - 1)].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		new_array->retired = old_array;
+		this->m_array.store(new_array, std::memory_order_release);
+
+		return new_array;
+	}
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <ostream>
+#include <string>
+
+#include "wait_free_stats.hpp"
+
+//compile with WAIT_FREE_ENABLE_EVENTS=1 to record gate waits, capacity changes and long slot spins on a timeline
+//disabled, scope and wait are empty classes and every call is an empty inline function
+#ifndef WAIT_FREE_ENABLE_EVENTS
+#define WAIT_FREE_ENABLE_EVENTS 0
+#endif
+
+//slot spins shorter than this are not recorded, gate waits and capacity changes always are
+#ifndef WAIT_FREE_EVENT_SPIN_NS
+#define WAIT_FREE_EVENT_SPIN_NS 10000
+#endif
+
+//events kept per thread, a full buffer drops new events and counts them
+#ifndef WAIT_FREE_EVENT_BUFFER_SIZE
+#define WAIT_FREE_EVENT_BUFFER_SIZE 65536
+#endif
+
+enum class wait_free_event : int32_t
+{
+	gate_wait = 0,
+	capacity_change,
+	slot_spin,
+	count
+};
+
+inline const char* wait_free_event_name(wait_free_event event) noexcept
+{
+	static const char* names[static_cast<int32_t>(wait_free_event::count)] = { "gate_wait", "capacity_change", "slot_spin" };
+	return names[static_cast<int32_t>(event)];
+}
+
+template<bool enabled>
+class wait_free_event_policy;
+
+template<>
+class wait_free_event_policy<false>
+{
+public:
+	class scope
+	{
+	public:
+		explicit scope(wait_free_event, const void* = nullptr) noexcept
+		{
+		}
+	};
+
+	class wait
+	{
+	public:
+		explicit wait(wait_free_event, const void* = nullptr, int64_t = 0) noexcept
+		{
+		}
+
+		void tick() noexcept
+		{
+		}
+	};
+
+	static void write_chrome_trace(std::ostream& out)
+	{
+		out << "{\"traceEvents\":[]}\n";
+	}
+
+	static bool write_chrome_trace(const std::string& path)
+	{
+		std::ofstream out(path);
+		write_chrome_trace(out);
+		return static_cast<bool>(out);
+	}
+
+	static int64_t dropped() noexcept
+	{
+		return 0;
+	}
+
+	static void clear() noexcept
+	{
+	}
+};
+
+//each thread appends complete begin/end pairs to its own buffer, only that thread writes it
+//buffers are linked into a process wide list on first use and live until exit, so events of finished threads can still be exported
+template<>
+class wait_free_event_policy<true>
+{
+	struct record
+	{
+		int64_t				begin_ns;
+		int64_t				end_ns;
+		const void*			object;
+		wait_free_event		event;
+	};
+
+	struct thread_buffer
+	{
+		record					records[WAIT_FREE_EVENT_BUFFER_SIZE];
+		std::atomic<int64_t>	count{ 0 };
+		std::atomic<int64_t>	dropped{ 0 };
+		int64_t					thread{ 0 };
+		thread_buffer*			next{ nullptr };
+	};
+
+public:
+	//an event from construction to destruction
+	class scope
+	{
+	public:
+		explicit scope(wait_free_event event, const void* object = nullptr) noexcept :
+			m_event(event),
+			m_object(object),
+			m_begin(now())
+		{
+		}
+
+		~scope()
+		{
+			append(this->m_event, this->m_object, this->m_begin, now());
+		}
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	private:
+		wait_free_event		m_event;
+		const void*			m_object;
+		int64_t				m_begin;
+	};
+
+	//a retry loop, call tick() on every failed check before backing off
+	//the event spans the first failed check to the end of the scope and is dropped when that is shorter than min_ns
+	class wait
+	{
+	public:
+		explicit wait(wait_free_event event, const void* object = nullptr, int64_t min_ns = 0) noexcept :
+			m_event(event),
+			m_object(object),
+			m_min_ns(min_ns),
+			m_begin(-1)
+		{
+		}
+
+		~wait()
+		{
+			if (this->m_begin == -1)
+			{
+				return;
+			}
+
+			int64_t end = now();
+			if (end - this->m_begin >= this->m_min_ns)
+			{
+				append(this->m_event, this->m_object, this->m_begin, end);
+			}
+		}
+
+		wait(const wait&) = delete;
+		wait& operator=(const wait&) = delete;
+
+		void tick() noexcept
+		{
+			if (this->m_begin == -1)
+			{
+				this->m_begin = now();
+			}
+		}
+
+	private:
+		wait_free_event		m_event;
+		const void*			m_object;
+		int64_t				m_min_ns;
+		int64_t				m_begin;
+	};
+
+	//chrome trace-event json, open it in perfetto or chrome://tracing
+	//reads every buffer without stopping the writers, events appended meanwhile may or may not be included
+	static void write_chrome_trace(std::ostream& out)
+	{
+		int64_t origin(INT64_MAX);
+		for (thread_buffer* b = head().load(std::memory_order_acquire); b != nullptr; b = b->next)
+		{
+			int64_t count = b->count.load(std::memory_order_acquire);
+			for (int64_t i = 0; i < count; i++)
+			{
+				origin = (std::min)(origin, b->records[i].begin_ns);
+			}
+		}
+
+		out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+		bool first = true;
+		auto separator = [&]() -> std::ostream&
+		{
+			out << (first ? "\n" : ",\n");
+			first = false;
+			return out;
+		};
+
+		for (thread_buffer* b = head().load(std::memory_order_acquire); b != nullptr; b = b->next)
+		{
+			separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->thread
+				<< ",\"args\":{\"name\":\"thread " << b->thread << "\"}}";
+
+			int64_t count = b->count.load(std::memory_order_acquire);
+			for (int64_t i = 0; i < count; i++)
+			{
+				const record& r = b->records[i];
+				const char* name = wait_free_event_name(r.event);
+
+				separator() << "{\"name\":\"" << name << "\",\"cat\":\"wait_free\",\"ph\":\"B\",\"pid\":1,\"tid\":" << b->thread
+					<< ",\"ts\":" << to_us(r.begin_ns - origin) << ",\"args\":{\"object\":\"" << r.object << "\"}}";
+				separator() << "{\"name\":\"" << name << "\",\"cat\":\"wait_free\",\"ph\":\"E\",\"pid\":1,\"tid\":" << b->thread
+					<< ",\"ts\":" << to_us(r.end_ns - origin) << "}";
+			}
+		}
+
+		out << "\n]}\n";
+	}
+
+	static bool write_chrome_trace(const std::string& path)
+	{
+		std::ofstream out(path);
+		write_chrome_trace(out);
+		return static_cast<bool>(out);
+	}
+
+	//events lost to full buffers since the last clear
+	static int64_t dropped() noexcept
+	{
+		int64_t ret(0);
+		for (thread_buffer* b = head().load(std::memory_order_acquire); b != nullptr; b = b->next)
+		{
+			ret += b->dropped.load(std::memory_order_relaxed);
+		}
+
+		return ret;
+	}
+
+	//only while no thread is recording, buffers are emptied, not freed
+	static void clear() noexcept
+	{
+		for (thread_buffer* b = head().load(std::memory_order_acquire); b != nullptr; b = b->next)
+		{
+			b->count.store(0, std::memory_order_release);
+			b->dropped.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	static std::atomic<thread_buffer*>& head() noexcept
+	{
+		static std::atomic<thread_buffer*> ret(nullptr);
+		return ret;
+	}
+
+	static int64_t now() noexcept
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//microseconds with the nanoseconds kept as decimals, the unit chrome traces use
+	static std::string to_us(int64_t ns)
+	{
+		std::string ret = std::to_string(ns / 1000) + ".000";
+		int64_t fraction = ns % 1000;
+		for (size_t i = ret.size() - 1; fraction != 0; i--, fraction /= 10)
+		{
+			ret[i] = static_cast<char>('0' + fraction % 10);
+		}
+
+		return ret;
+	}
+
+	static thread_buffer* local_buffer() noexcept
+	{
+		static thread_local thread_buffer* buffer = nullptr;
+		if (buffer == nullptr)
+		{
+			buffer = new (std::nothrow) thread_buffer();
+			if (buffer == nullptr)
+			{
+				return nullptr;
+			}
+
+			buffer->thread = wait_free_thread_index();
+			std::atomic<thread_buffer*>& list = head();
+			buffer->next = list.load(std::memory_order_relaxed);
+			while (!list.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		return buffer;
+	}
+
+	static void append(wait_free_event event, const void* object, int64_t begin_ns, int64_t end_ns) noexcept
+	{
+		thread_buffer* buffer = local_buffer();
+		if (buffer == nullptr)
+		{
+			return;
+		}
+
+		int64_t count = buffer->count.load(std::memory_order_relaxed);
+		if (count >= WAIT_FREE_EVENT_BUFFER_SIZE)
+		{
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		buffer->records[count] = { begin_ns, end_ns, object, event };
+		buffer->count.store(count + 1, std::memory_order_release);
+	}
+};
+
+using wait_free_events = wait_free_event_policy<WAIT_FREE_ENABLE_EVENTS != 0>;
@@ -10,6 +10,8 @@
 #include "wait_free_memory_pool.hpp"
 #include "wait_free_queue.hpp"
 #include "template_util.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory.hpp"
 
 
 //replace wait_free_queue<iterator> to  wait_free_queue<int64_t>, serious error;
@@ -38,6 +40,8 @@ public:
 
     int64_t enqueue(const T& value)
     {
+        wait_free_latency::scope latency_scope(m_latency, wait_free_op::enqueue);
+
         iterator it = m_memory_pool.allocate();
         T* elem = it.lock();
         assert(elem != nullptr);
@@ -69,6 +73,8 @@ public:
 
     int64_t dequeue(T& elem) noexcept
     {
+        wait_free_latency::scope latency_scope(m_latency, wait_free_op::dequeue);
+
         int64_t offset{};
         int64_t ret = m_queue.dequeue(offset);
         if (ret != -1)
@@ -154,10 +160,49 @@ public:
         return m_queue.capacity();
     }
 
+    //see wait_free_queue::reserve
+    bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+    {
+        bool ret = m_memory_pool.reserve(capacity, options);
+        ret &= m_queue.reserve(capacity, options);
+
+        return ret;
+    }
+
+    //the pool holds the elements, m_queue only their offsets
+    wait_free_memory_usage memory_usage() const noexcept
+    {
+        wait_free_memory_usage ret = m_memory_pool.memory_usage();
+        ret += m_queue.memory_usage();
+
+        return ret;
+    }
+
+    wait_free_stats_snapshot stats() const noexcept
+    {
+        wait_free_stats_snapshot ret = m_memory_pool.stats();
+        ret += m_queue.stats();
+
+        return ret;
+    }
+
+    //end to end latency of the generic operations, the inner pool and container keep their own
+    wait_free_latency_histogram latency(wait_free_op op) const
+    {
+        return m_latency.histogram(op);
+    }
+
+    void set_latency_sample_rate(int64_t every_n) noexcept
+    {
+        m_latency.set_sample_rate(every_n);
+    }
+
 private:
 
     wait_free_memory_pool<T, TAllocator>    m_memory_pool;
     wait_free_queue<int64_t, TAllocator>    m_queue;
+    wait_free_latency                       m_latency;
+    wait_free_registration                  m_registration{ this, "wait_free_generic_queue" };
 };
 
 
@@ -11,6 +11,8 @@
 #include "wait_free_memory_pool.hpp"
 #include "wait_free_vector.hpp"
 #include "template_util.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory.hpp"
 
 template<typename T, template<typename U> typename TAllocator = std::allocator>
 class wait_free_generic_vecotor 
@@ -23,7 +25,7 @@ public:
         const TAllocator<T>& memory_pool_allocator = TAllocator<T>(),
         const TAllocator<std::atomic<int64_t>>& vector_offset_allocator = TAllocator<std::atomic<int64_t>>()) :
         m_memory_pool(capacity, memory_pool_allocator),
-        m_vector(0, capacity, vector_offset_allocator)
+        m_vector(-1, capacity, vector_offset_allocator)
     {
 
     }
@@ -37,6 +39,8 @@ public:
 
     void push_back(const T& value)
     {
+        wait_free_latency::scope latency_scope(m_latency, wait_free_op::push_back);
+
         iterator it = m_memory_pool.allocate();
         T* elem = it.lock();
         assert(elem);
@@ -93,6 +97,8 @@ public:
 
     bool get(int64_t index, T& elem)
     {
+        wait_free_latency::scope latency_scope(m_latency, wait_free_op::get);
+
         int64_t offset{};
         if (m_vector.get(index, offset)) 
         {
@@ -120,9 +126,48 @@ public:
     {
         return m_vector.size();
     }
+
+    //see wait_free_queue::reserve
+    bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+    {
+        bool ret = m_memory_pool.reserve(capacity, options);
+        ret &= m_vector.reserve(capacity, options);
+
+        return ret;
+    }
+
+    //the pool holds the elements, m_vector only their offsets
+    wait_free_memory_usage memory_usage() const noexcept
+    {
+        wait_free_memory_usage ret = m_memory_pool.memory_usage();
+        ret += m_vector.memory_usage();
+
+        return ret;
+    }
+
+    wait_free_stats_snapshot stats() const noexcept
+    {
+        wait_free_stats_snapshot ret = m_memory_pool.stats();
+        ret += m_vector.stats();
+
+        return ret;
+    }
+
+    //end to end latency of the generic operations, the inner pool and container keep their own
+    wait_free_latency_histogram latency(wait_free_op op) const
+    {
+        return m_latency.histogram(op);
+    }
+
+    void set_latency_sample_rate(int64_t every_n) noexcept
+    {
+        m_latency.set_sample_rate(every_n);
+    }
     
 private:
 
     wait_free_memory_pool<T, TAllocator>    m_memory_pool;
     wait_free_vector<int64_t, TAllocator>   m_vector;
+    wait_free_latency                       m_latency;
+    wait_free_registration                  m_registration{ this, "wait_free_generic_vecotor" };
 };
@@ -0,0 +1,725 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#include "template_util.hpp"
+#include "wait_free_bitset.hpp"
+#include "wait_free_memory.hpp"
+
+//open addressing hash map over atomic key and value slots, the wait_free_buffer slot model with the states split in two:
+//a key slot is empty_key until claimed and then never changes, a value slot is free_value when absent or erased (a tombstone)
+//and moved_value once the table is being migrated
+//find never waits, except on a slot whose copy is in flight
+//a full table gets a twice as large successor, writers that meet it migrate fixed size chunks until every chunk is claimed,
+//then go over the chunks other helpers have claimed but not finished, readers follow moved slots to the successor meanwhile
+//every slot, empty ones included, is frozen to moved_value before the successor takes over, so a write into the old table
+//either lands before its slot is copied or fails and retries in the new one
+//the thread whose freeze lands copies the slot, so a thread stalled between the two blocks readers of that one key and the
+//switch to the successor, which waits for the last copy: migration is not lock free, only the slot copies are shared out
+//a replaced table is freed two epoch steps after it left the root, when no operation that could still see it is running,
+//the skiplist's scheme; erased keys keep their slot as a tombstone until a rebuild, which drops them and, when they were
+//what filled the table, keeps its size
+template<typename K, typename V, typename THash = std::hash<K>, template<typename U> typename TAllocator = std::allocator>
+class wait_free_hash_map : private wait_free_stats_base
+{
+	static_assert(std::atomic<K>::is_always_lock_free && std::atomic<V>::is_always_lock_free, "wait_free_hash_map key and value must be lock free atomics");
+
+	static constexpr int64_t MIN_CAPACITY = 16;
+	static constexpr int64_t MIGRATE_CHUNK = 1024;
+	static constexpr int64_t MAX_THREADS = WAIT_FREE_MAX_THREADS;
+	static constexpr int64_t IDLE = -1;
+
+	struct table
+	{
+		std::atomic<K>*				keys;
+		std::atomic<V>*				values;
+		//set once a frozen slot's value is in the successor
+		std::atomic<uint8_t>*		copied;
+		int64_t						capacity;
+		int64_t						mask;
+		int64_t						chunk_count;
+
+		//key slots taken, tombstones included, the table is full at 3/4
+		alignas(64) std::atomic<int64_t>	claimed{ 0 };
+		alignas(64) std::atomic<table*>		next{ nullptr };
+		std::atomic<int64_t>				migrate_cursor{ 0 };
+		//slots copied, the one copy that completes the table switches the root
+		std::atomic<int64_t>				migrated{ 0 };
+		table*								retired{ nullptr };
+		int64_t								retire_epoch{ 0 };
+	};
+
+	struct alignas(64) thread_state
+	{
+		std::atomic<int64_t>	epoch{ IDLE };
+		int32_t					depth{ 0 };
+	};
+
+	//epoch announcement for the duration of one operation
+	class guard
+	{
+	public:
+		explicit guard(const wait_free_hash_map& map) noexcept :
+			m_state(map.local_state())
+		{
+			if (this->m_state.depth++ == 0)
+			{
+				int64_t epoch = map.m_epoch.load(std::memory_order_acquire);
+				while (true)
+				{
+					this->m_state.epoch.store(epoch, std::memory_order_seq_cst);
+					int64_t now = map.m_epoch.load(std::memory_order_seq_cst);
+					if (now == epoch)
+					{
+						break;
+					}
+					epoch = now;
+				}
+			}
+		}
+
+		~guard()
+		{
+			if (--this->m_state.depth == 0)
+			{
+				this->m_state.epoch.store(IDLE, std::memory_order_release);
+			}
+		}
+
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+	private:
+		thread_state&		m_state;
+	};
+
+public:
+	explicit wait_free_hash_map(
+		const K& empty_key,
+		const V& free_value,
+		const V& moved_value,
+		int64_t capacity = MIN_CAPACITY,
+		const TAllocator<std::atomic<K>>& key_allocator = TAllocator<std::atomic<K>>(),
+		const TAllocator<std::atomic<V>>& value_allocator = TAllocator<std::atomic<V>>()) :
+		m_key_allocator(key_allocator),
+		m_value_allocator(value_allocator),
+		m_copied_allocator(key_allocator),
+		m_empty_key(empty_key),
+		m_free_value(free_value),
+		m_moved_value(moved_value),
+		m_table(nullptr),
+		m_retired(nullptr),
+		m_retired_bytes(0),
+		m_retired_limit(0),
+		m_states(new std::atomic<thread_state*>[MAX_THREADS]),
+		m_epoch(0),
+		m_size(0),
+		m_growth_count(0)
+	{
+		assert(free_value != moved_value);
+
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			this->m_states[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		this->m_table = allocate_table(capacity);
+		this->m_retired_limit = 2 * table_bytes(this->m_table);
+		this->m_registration.add();
+	}
+
+	~wait_free_hash_map()
+	{
+		this->m_registration.remove();
+
+		table* t = this->m_table.load();
+		while (t != nullptr)
+		{
+			table* next = t->next.load();
+			deallocate_table(t);
+			t = next;
+		}
+
+		t = this->m_retired;
+		while (t != nullptr)
+		{
+			table* retired = t->retired;
+			deallocate_table(t);
+			t = retired;
+		}
+
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			delete this->m_states[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	wait_free_hash_map(const wait_free_hash_map&) = delete;
+	wait_free_hash_map& operator=(const wait_free_hash_map&) = delete;
+
+	bool find(const K& key, V& value) const noexcept
+	{
+		assert(key != this->m_empty_key);
+
+		guard g(*this);
+		uint64_t hash = hash_of(key);
+		table* t = this->m_table.load(std::memory_order_acquire);
+		while (t != nullptr)
+		{
+			bool found(false);
+			int64_t index = probe(t, key, hash, found);
+			if (index == -1)
+			{
+				t = t->next.load(std::memory_order_acquire);
+				continue;
+			}
+
+			V v = load_value(t, index);
+			if (v == this->m_moved_value)
+			{
+				t = t->next.load(std::memory_order_acquire);
+				continue;
+			}
+
+			if (!found || v == this->m_free_value)
+			{
+				return false;
+			}
+
+			value = v;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool contains(const K& key) const noexcept
+	{
+		V value{};
+		return find(key, value);
+	}
+
+	//false when the key is already present
+	bool insert(const K& key, const V& value)
+	{
+		assert(value != this->m_free_value && value != this->m_moved_value);
+
+		return write(key, true, [&](const V& old_value, V& new_value)
+		{
+			if (old_value != this->m_free_value)
+			{
+				return false;
+			}
+
+			new_value = value;
+			return true;
+		}) == 1;
+	}
+
+	//false when the key is absent
+	bool update(const K& key, const V& value)
+	{
+		assert(value != this->m_free_value && value != this->m_moved_value);
+
+		return write(key, false, [&](const V& old_value, V& new_value)
+		{
+			if (old_value == this->m_free_value)
+			{
+				return false;
+			}
+
+			new_value = value;
+			return true;
+		}) == 0;
+	}
+
+	//false when the key is absent, the erased value goes to value if given
+	bool erase(const K& key, V* value = nullptr)
+	{
+		V erased{};
+		bool ret = write(key, false, [&](const V& old_value, V& new_value)
+		{
+			if (old_value == this->m_free_value)
+			{
+				return false;
+			}
+
+			erased = old_value;
+			new_value = this->m_free_value;
+			return true;
+		}) == -1;
+
+		if (ret && value)
+		{
+			*value = erased;
+		}
+
+		return ret;
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>((std::max)(this->m_size.load(std::memory_order_relaxed), static_cast<int64_t>(0)));
+	}
+
+	size_t capacity() const noexcept
+	{
+		guard g(*this);
+		return this->m_table.load(std::memory_order_acquire)->capacity;
+	}
+
+	//live and migrating tables plus the retired ones not freed yet, tombstones are what claimed slots don't hold a value
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t slot_size = static_cast<int64_t>(sizeof(std::atomic<K>) + sizeof(std::atomic<V>));
+		guard g(*this);
+		table* root = this->m_table.load(std::memory_order_acquire);
+
+		wait_free_memory_usage ret;
+		for (table* t = root; t != nullptr; t = t->next.load(std::memory_order_acquire))
+		{
+			ret.reserved_bytes += table_bytes(t);
+		}
+		ret.reserved_bytes += this->m_retired_bytes.load(std::memory_order_relaxed);
+
+		ret.live_bytes = static_cast<int64_t>(size()) * slot_size;
+		ret.free_list_length = (std::max)(root->claimed.load(std::memory_order_relaxed) - static_cast<int64_t>(size()), static_cast<int64_t>(0));
+		ret.peak_live_bytes = this->m_peak_size.get() * slot_size;
+		ret.growth_count = this->m_growth_count;
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+	TAllocator<std::atomic<K>>			m_key_allocator;
+	TAllocator<std::atomic<V>>			m_value_allocator;
+	TAllocator<std::atomic<uint8_t>>	m_copied_allocator;
+	const K								m_empty_key;
+	const V								m_free_value;
+	const V								m_moved_value;
+
+	alignas(64) std::atomic<table*>		m_table;
+	std::atomic<table*>					m_retired;
+	std::atomic<int64_t>				m_retired_bytes;
+	std::atomic<int64_t>				m_retired_limit;
+	std::unique_ptr<std::atomic<thread_state*>[]>	m_states;
+	alignas(64) std::atomic<int64_t>	m_epoch;
+	alignas(64) std::atomic<int64_t>	m_size;
+	wait_free_high_water				m_peak_size;
+	std::atomic<int64_t>				m_growth_count;
+	wait_free_registration				m_registration{ this, "wait_free_hash_map", false };
+
+	//integer std::hash is the identity, mixed so that linear probing doesn't cluster on sequential ids
+	static uint64_t hash_of(const K& key) noexcept
+	{
+		uint64_t h = static_cast<uint64_t>(THash()(key));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+
+		return h;
+	}
+
+	table* allocate_table(int64_t capacity)
+	{
+		int64_t pow2_capacity(MIN_CAPACITY);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		table* t = new table();
+		t->capacity = pow2_capacity;
+		t->mask = pow2_capacity - 1;
+		t->chunk_count = (pow2_capacity + MIGRATE_CHUNK - 1) / MIGRATE_CHUNK;
+
+		t->keys = this->m_key_allocator.allocate(pow2_capacity);
+		t->values = this->m_value_allocator.allocate(pow2_capacity);
+		t->copied = this->m_copied_allocator.allocate(pow2_capacity);
+		assert(t->keys && t->values && t->copied);
+		for (int64_t i = 0; i < pow2_capacity; i++)
+		{
+			new (&t->keys[i]) std::atomic<K>(this->m_empty_key);
+			new (&t->values[i]) std::atomic<V>(this->m_free_value);
+			new (&t->copied[i]) std::atomic<uint8_t>(0);
+		}
+
+		return t;
+	}
+
+	static int64_t table_bytes(const table* t) noexcept
+	{
+		const int64_t slot_size = static_cast<int64_t>(sizeof(std::atomic<K>) + sizeof(std::atomic<V>) + sizeof(std::atomic<uint8_t>));
+		return t->capacity * slot_size + static_cast<int64_t>(sizeof(table));
+	}
+
+	void deallocate_table(table* t) noexcept
+	{
+		this->m_key_allocator.deallocate(t->keys, t->capacity);
+		this->m_value_allocator.deallocate(t->values, t->capacity);
+		this->m_copied_allocator.deallocate(t->copied, t->capacity);
+		delete t;
+	}
+
+	//slot holding key, or the empty slot where the chain ends, -1 when every slot holds another key
+	int64_t probe(table* t, const K& key, uint64_t hash, bool& found) const noexcept
+	{
+		int64_t index = static_cast<int64_t>(hash) & t->mask;
+		for (int64_t i = 0; i < t->capacity; i++, index = (index + 1) & t->mask)
+		{
+			K k = t->keys[index].load(std::memory_order_acquire);
+			if (k == key || k == this->m_empty_key)
+			{
+				found = k == key;
+				return index;
+			}
+		}
+
+		found = false;
+		return -1;
+	}
+
+	//probe that claims the empty slot for key, -1 when the table is full
+	int64_t claim(table* t, const K& key, uint64_t hash) noexcept
+	{
+		int64_t index = static_cast<int64_t>(hash) & t->mask;
+		for (int64_t i = 0; i < t->capacity; i++, index = (index + 1) & t->mask)
+		{
+			K k = t->keys[index].load(std::memory_order_acquire);
+			if (k == key)
+			{
+				return index;
+			}
+
+			if (k == this->m_empty_key)
+			{
+				if (t->claimed.load(std::memory_order_relaxed) >= t->capacity / 4 * 3)
+				{
+					return -1;
+				}
+
+				if (this->m_stats.count_cas(t->keys[index].compare_exchange_strong(k, key, std::memory_order_acq_rel)))
+				{
+					t->claimed.fetch_add(1, std::memory_order_relaxed);
+					return index;
+				}
+
+				if (k == key)
+				{
+					return index;
+				}
+			}
+		}
+
+		return -1;
+	}
+
+	//moved_value whose copy isn't in the successor yet is a copy in flight, wait for the thread that froze it
+	V load_value(table* t, int64_t index) const noexcept
+	{
+		V v = t->values[index].load(std::memory_order_acquire);
+		if (v != this->m_moved_value || t->copied[index].load(std::memory_order_acquire) != 0)
+		{
+			return v;
+		}
+
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
+		while (t->copied[index].load(std::memory_order_acquire) == 0)
+		{
+			spin.tick();
+			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::spin_wait);
+		}
+
+		return v;
+	}
+
+	thread_state& local_state() const noexcept
+	{
+		int64_t slot = wait_free_thread_slot();
+		thread_state* ret = this->m_states[slot].load(std::memory_order_relaxed);
+		if (ret == nullptr)
+		{
+			//only the thread owning the slot creates its state
+			ret = new thread_state();
+			this->m_states[slot].store(ret, std::memory_order_release);
+		}
+
+		return *ret;
+	}
+
+	//func(old_value, new_value) decides whether to store new_value, returns +1 when a value was added, -1 removed,
+	//0 replaced, 2 when func declined
+	template<typename TFunc>
+	int32_t write(const K& key, bool add, TFunc&& func)
+	{
+		assert(key != this->m_empty_key);
+
+		//tombstone rebuilds can retire tables faster than a stalled operation lets the epoch move, writers hold off until
+		//the retired ones are back under twice the root's size; outside the guard, so this thread never holds the epoch
+		if (this->m_retired_bytes.load(std::memory_order_relaxed) > this->m_retired_limit.load(std::memory_order_relaxed))
+		{
+			wait_free_events::wait gate(wait_free_event::gate_wait, this);
+			while (this->m_retired_bytes.load(std::memory_order_relaxed) > this->m_retired_limit.load(std::memory_order_relaxed))
+			{
+				reclaim();
+				gate.tick();
+				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::yield);
+			}
+		}
+
+		guard g(*this);
+		uint64_t hash = hash_of(key);
+		while (true)
+		{
+			table* t = this->m_table.load(std::memory_order_acquire);
+			if (t->next.load(std::memory_order_acquire) != nullptr)
+			{
+				help_migrate(t);
+				continue;
+			}
+
+			int64_t index(-1);
+			if (add)
+			{
+				index = claim(t, key, hash);
+				if (index == -1)
+				{
+					start_migrate(t);
+					continue;
+				}
+			}
+			else
+			{
+				bool found(false);
+				index = probe(t, key, hash, found);
+				if (index == -1 || !found)
+				{
+					//an empty slot frozen by a migration may hide the key in the successor
+					if (index != -1 && t->values[index].load(std::memory_order_acquire) == this->m_moved_value)
+					{
+						continue;
+					}
+
+					return 2;
+				}
+			}
+
+			V old_value = load_value(t, index);
+			while (old_value != this->m_moved_value)
+			{
+				V new_value{};
+				if (!func(old_value, new_value))
+				{
+					return 2;
+				}
+
+				if (this->m_stats.count_cas(t->values[index].compare_exchange_weak(old_value, new_value, std::memory_order_acq_rel)))
+				{
+					if (old_value == this->m_free_value)
+					{
+						this->m_peak_size.update(this->m_size.fetch_add(1, std::memory_order_relaxed) + 1);
+						return 1;
+					}
+
+					if (new_value == this->m_free_value)
+					{
+						this->m_size.fetch_sub(1, std::memory_order_relaxed);
+						return -1;
+					}
+
+					return 0;
+				}
+			}
+		}
+	}
+
+	//doubles unless tombstones filled the table, which is then rebuilt at its own size, never below twice the live elements
+	void start_migrate(table* t)
+	{
+		if (t->next.load(std::memory_order_acquire) == nullptr)
+		{
+			int64_t live = this->m_size.load(std::memory_order_relaxed);
+			table* next = allocate_table((std::max)(live * 2, t->capacity / 4 * 3 <= live * 2 ? t->capacity * 2 : t->capacity));
+
+			table* expected(nullptr);
+			if (!this->m_stats.count_cas(t->next.compare_exchange_strong(expected, next, std::memory_order_acq_rel)))
+			{
+				deallocate_table(next);
+			}
+		}
+
+		help_migrate(t);
+	}
+
+	//claims chunks until there are none left, then helps with the claimed ones still being copied, a slot already frozen
+	//costs one load, and at last waits for the copies in flight and the successor to become the root
+	void help_migrate(table* t)
+	{
+		table* next = t->next.load(std::memory_order_acquire);
+
+		int64_t chunk(0);
+		while ((chunk = t->migrate_cursor.fetch_add(1, std::memory_order_relaxed)) < t->chunk_count)
+		{
+			migrate_chunk(t, next, chunk);
+		}
+
+		for (chunk = 0; chunk < t->chunk_count && this->m_table.load(std::memory_order_acquire) == t; chunk++)
+		{
+			migrate_chunk(t, next, chunk);
+		}
+
+		wait_free_events::wait gate(wait_free_event::gate_wait, this);
+		while (this->m_table.load(std::memory_order_acquire) == t)
+		{
+			gate.tick();
+			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::yield);
+		}
+	}
+
+	void migrate_chunk(table* t, table* next, int64_t chunk)
+	{
+		int64_t end = (std::min)((chunk + 1) * MIGRATE_CHUNK, t->capacity);
+		for (int64_t index = chunk * MIGRATE_CHUNK; index < end; index++)
+		{
+			migrate_slot(t, next, index);
+		}
+	}
+
+	//any number of helpers may run this on a slot, the one whose freeze lands copies it: nothing else writes the
+	//successor until it is the root, and each key has one slot, so the copy is a plain store
+	//tombstones and empty slots are frozen without a copy
+	void migrate_slot(table* t, table* next, int64_t index)
+	{
+		V v = t->values[index].load(std::memory_order_acquire);
+		while (v != this->m_moved_value)
+		{
+			if (!this->m_stats.count_cas(t->values[index].compare_exchange_weak(v, this->m_moved_value, std::memory_order_acq_rel)))
+			{
+				continue;
+			}
+
+			if (v != this->m_free_value)
+			{
+				K k = t->keys[index].load(std::memory_order_acquire);
+				next->values[claim_for_migration(next, k)].store(v, std::memory_order_release);
+			}
+
+			t->copied[index].store(1, std::memory_order_release);
+			if (t->migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == t->capacity)
+			{
+				wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+				this->m_stats.add(wait_free_stat::resize);
+
+				this->m_growth_count++;
+				this->m_retired_limit.store(2 * table_bytes(next), std::memory_order_relaxed);
+				this->m_table.store(next, std::memory_order_seq_cst);
+				retire(t);
+			}
+
+			return;
+		}
+	}
+
+	//runs inside the guard of the write that switched the root away from t
+	void retire(table* t) noexcept
+	{
+		t->retire_epoch = this->m_epoch.load(std::memory_order_seq_cst);
+		this->m_retired_bytes.fetch_add(table_bytes(t), std::memory_order_relaxed);
+		push_retired(t, t);
+		reclaim();
+	}
+
+	void reclaim() noexcept
+	{
+		//the epoch steps once every running operation has seen the current one
+		int64_t epoch = this->m_epoch.load(std::memory_order_seq_cst);
+		bool advance(true);
+		for (int64_t i = 0; i < MAX_THREADS && advance; i++)
+		{
+			thread_state* other = this->m_states[i].load(std::memory_order_acquire);
+			if (other != nullptr)
+			{
+				int64_t announced = other->epoch.load(std::memory_order_seq_cst);
+				advance = announced == IDLE || announced == epoch;
+			}
+		}
+
+		if (advance)
+		{
+			this->m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+		}
+
+		//retired two steps ago: every operation running then has ended; the list is taken whole, so a concurrent
+		//retire only ever pushes, and what isn't freed yet goes back
+		int64_t safe = this->m_epoch.load(std::memory_order_acquire) - 2;
+		table* kept_head(nullptr);
+		table* kept_tail(nullptr);
+		table* r = this->m_retired.exchange(nullptr, std::memory_order_acq_rel);
+		while (r != nullptr)
+		{
+			table* retired = r->retired;
+			if (r->retire_epoch <= safe)
+			{
+				this->m_retired_bytes.fetch_sub(table_bytes(r), std::memory_order_relaxed);
+				deallocate_table(r);
+			}
+			else
+			{
+				r->retired = kept_head;
+				kept_tail = kept_head == nullptr ? r : kept_tail;
+				kept_head = r;
+			}
+			r = retired;
+		}
+
+		if (kept_head != nullptr)
+		{
+			push_retired(kept_head, kept_tail);
+		}
+	}
+
+	void push_retired(table* head, table* tail) noexcept
+	{
+		table* top = this->m_retired.load(std::memory_order_relaxed);
+		do
+		{
+			tail->retired = top;
+		} while (!this->m_retired.compare_exchange_weak(top, head, std::memory_order_acq_rel, std::memory_order_relaxed));
+	}
+
+	//the successor holds at most the old table's keys and is at least as large, so there is always a slot
+	int64_t claim_for_migration(table* next, const K& key) noexcept
+	{
+		int64_t index = static_cast<int64_t>(hash_of(key)) & next->mask;
+		while (true)
+		{
+			K k = this->m_empty_key;
+			if (next->keys[index].compare_exchange_strong(k, key, std::memory_order_acq_rel) || k == key)
+			{
+				next->claimed.fetch_add(k == key ? 0 : 1, std::memory_order_relaxed);
+				return index;
+			}
+
+			index = (index + 1) & next->mask;
+		}
+	}
+};
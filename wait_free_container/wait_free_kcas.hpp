@@ -0,0 +1,481 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <new>
+
+#include "wait_free_bitset.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_stats.hpp"
+
+struct wait_free_kcas_entry
+{
+	int64_t		index;
+	int64_t		expected;
+	int64_t		desired;
+};
+
+//fixed array of 62 bit integers supporting an atomic compare and exchange over up to MAX_WORDS of them at once
+//harris style mcas: a word taking part in an operation holds a reference to its descriptor until the outcome is decided,
+//installing it goes through rdcss so it only lands while the operation is undecided
+//whoever meets a reference, reader or writer, finishes that operation instead of waiting for its owner
+//descriptors are not allocated per operation, every thread reuses its own: a reference carries the descriptor's sequence,
+//a helper copies the descriptor and drops the copy if the sequence moved on since, the operation being over by then
+//at most WAIT_FREE_MAX_THREADS threads may use multi word operations at the same time
+template<template<typename U> typename TAllocator = std::allocator>
+class wait_free_kcas_array : private wait_free_stats_base
+{
+public:
+	static constexpr int32_t MAX_WORDS = 8;
+	static constexpr int64_t MAX_VALUE = (static_cast<int64_t>(1) << 61) - 1;
+	static constexpr int64_t MIN_VALUE = -MAX_VALUE - 1;
+
+private:
+	static constexpr int64_t MAX_THREADS = WAIT_FREE_MAX_THREADS;
+	static_assert(MAX_THREADS <= 0x10000, "a descriptor reference has 16 bits for the thread");
+
+	//low two bits of a word: value, rdcss reference or mcas reference; a reference is sequence << 18 | thread << 2 | tag
+	static constexpr uint64_t TAG_MASK = 3;
+	static constexpr uint64_t TAG_RDCSS = 1;
+	static constexpr uint64_t TAG_MCAS = 2;
+
+	//mcas status is sequence << 2 | state
+	static constexpr uint64_t UNDECIDED = 0;
+	static constexpr uint64_t SUCCEEDED = 1;
+	static constexpr uint64_t FAILED = 2;
+
+	struct alignas(64) descriptor
+	{
+		std::atomic<uint64_t>		status{ 0 };
+		std::atomic<int32_t>		count{ 0 };
+		std::atomic<int64_t>		index[MAX_WORDS]{};
+		std::atomic<uint64_t>		expected[MAX_WORDS]{};
+		std::atomic<uint64_t>		desired[MAX_WORDS]{};
+
+		//one rdcss in flight per thread at most, it is completed before the thread moves on
+		std::atomic<uint64_t>		rdcss_sequence{ 0 };
+		std::atomic<int64_t>		rdcss_index{ 0 };
+		std::atomic<uint64_t>		rdcss_expected{ 0 };
+		std::atomic<uint64_t>		rdcss_mcas{ 0 };
+	};
+
+	struct mcas_copy
+	{
+		uint64_t		ref;
+		int32_t			count;
+		int64_t			index[MAX_WORDS];
+		uint64_t		expected[MAX_WORDS];
+		uint64_t		desired[MAX_WORDS];
+	};
+
+	struct rdcss_copy
+	{
+		uint64_t		ref;
+		int64_t			index;
+		uint64_t		expected;
+		uint64_t		mcas;
+	};
+
+public:
+	explicit wait_free_kcas_array(int64_t size, int64_t value = 0, const TAllocator<std::atomic<uint64_t>>& allocator = TAllocator<std::atomic<uint64_t>>()) :
+		m_data(nullptr),
+		m_allocator(allocator),
+		m_size(size),
+		m_descriptors(new std::atomic<descriptor*>[MAX_THREADS])
+	{
+		assert(size > 0);
+
+		this->m_data = this->m_allocator.allocate(size);
+		assert(this->m_data);
+		for (int64_t i = 0; i < size; i++)
+		{
+			new (&this->m_data[i]) std::atomic<uint64_t>(encode(value));
+		}
+
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			this->m_descriptors[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		this->m_registration.add();
+	}
+
+	~wait_free_kcas_array()
+	{
+		this->m_registration.remove();
+
+		for (int64_t i = 0; i < this->m_size; i++)
+		{
+			this->m_data[i].~atomic<uint64_t>();
+		}
+		this->m_allocator.deallocate(this->m_data, this->m_size);
+
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			delete this->m_descriptors[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	wait_free_kcas_array(const wait_free_kcas_array&) = delete;
+	wait_free_kcas_array& operator=(const wait_free_kcas_array&) = delete;
+
+	int64_t load(int64_t index) const noexcept
+	{
+		assert(index >= 0 && index < this->m_size);
+
+		while (true)
+		{
+			uint64_t word = this->m_data[index].load(std::memory_order_acquire);
+			if (!help(word))
+			{
+				return decode(word);
+			}
+		}
+	}
+
+	void store(int64_t index, int64_t value) noexcept
+	{
+		assert(index >= 0 && index < this->m_size);
+
+		uint64_t word = this->m_data[index].load(std::memory_order_acquire);
+		while (true)
+		{
+			if (help(word))
+			{
+				word = this->m_data[index].load(std::memory_order_acquire);
+				continue;
+			}
+
+			if (this->m_stats.count_cas(this->m_data[index].compare_exchange_weak(word, encode(value), std::memory_order_acq_rel)))
+			{
+				return;
+			}
+		}
+	}
+
+	//single word, compare_value gets the current value when it differs, same shape as wait_free_buffer's
+	bool compare_and_exchange_strong(int64_t index, bool& exchanged, int64_t& compare_value, int64_t exchange_value) noexcept
+	{
+		if (index < 0 || index >= this->m_size)
+		{
+			return false;
+		}
+
+		uint64_t expected = encode(compare_value);
+		while (true)
+		{
+			uint64_t word = expected;
+			if (this->m_stats.count_cas(this->m_data[index].compare_exchange_strong(word, encode(exchange_value), std::memory_order_acq_rel)))
+			{
+				exchanged = true;
+				return true;
+			}
+
+			if (!help(word))
+			{
+				compare_value = decode(word);
+				exchanged = false;
+				return true;
+			}
+		}
+	}
+
+	//every entry's word changes to desired, or none does when any of them differs from expected
+	//indices must be distinct and in range, the order of the entries does not matter
+	bool compare_and_exchange_strong(const wait_free_kcas_entry* entries, int32_t count) noexcept
+	{
+		assert(count > 0 && count <= MAX_WORDS);
+
+		if (count == 1)
+		{
+			bool exchanged(false);
+			int64_t expected = entries[0].expected;
+			return compare_and_exchange_strong(entries[0].index, exchanged, expected, entries[0].desired) && exchanged;
+		}
+
+		//sorted by index, so two operations sharing words meet in the same order and one helps the other through
+		mcas_copy op;
+		op.count = count;
+		for (int32_t i = 0; i < count; i++)
+		{
+			int32_t j = i;
+			while (j > 0 && op.index[j - 1] > entries[i].index)
+			{
+				op.index[j] = op.index[j - 1];
+				op.expected[j] = op.expected[j - 1];
+				op.desired[j] = op.desired[j - 1];
+				j--;
+			}
+
+			assert(entries[i].index >= 0 && entries[i].index < this->m_size);
+			assert(j == 0 || op.index[j - 1] != entries[i].index);
+			op.index[j] = entries[i].index;
+			op.expected[j] = encode(entries[i].expected);
+			op.desired[j] = encode(entries[i].desired);
+		}
+
+		int64_t thread = wait_free_thread_slot();
+		descriptor& d = local_descriptor(thread);
+		uint64_t sequence = (d.status.load(std::memory_order_relaxed) >> 2) + 1;
+
+		//the new sequence goes out before the fields, a helper holding an older reference then fails its check
+		d.status.store(sequence << 2 | UNDECIDED, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		d.count.store(count, std::memory_order_relaxed);
+		for (int32_t i = 0; i < count; i++)
+		{
+			d.index[i].store(op.index[i], std::memory_order_relaxed);
+			d.expected[i].store(op.expected[i], std::memory_order_relaxed);
+			d.desired[i].store(op.desired[i], std::memory_order_relaxed);
+		}
+
+		op.ref = make_ref(thread, sequence, TAG_MCAS);
+		return mcas(op);
+	}
+
+	bool compare_and_exchange_strong(std::initializer_list<wait_free_kcas_entry> entries) noexcept
+	{
+		return compare_and_exchange_strong(entries.begin(), static_cast<int32_t>(entries.size()));
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>(this->m_size);
+	}
+
+	//descriptors are one per thread that ever ran a multi word cas on this array
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		int64_t descriptors(0);
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			descriptors += this->m_descriptors[i].load(std::memory_order_relaxed) != nullptr ? 1 : 0;
+		}
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_size * static_cast<int64_t>(sizeof(std::atomic<uint64_t>)) +
+			MAX_THREADS * static_cast<int64_t>(sizeof(std::atomic<descriptor*>)) + descriptors * static_cast<int64_t>(sizeof(descriptor));
+		ret.live_bytes = ret.reserved_bytes;
+		ret.peak_live_bytes = ret.reserved_bytes;
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+	std::atomic<uint64_t>*						m_data;
+	TAllocator<std::atomic<uint64_t>>			m_allocator;
+	const int64_t								m_size;
+	std::unique_ptr<std::atomic<descriptor*>[]>	m_descriptors;
+	wait_free_registration						m_registration{ this, "wait_free_kcas_array", false };
+
+	static uint64_t encode(int64_t value) noexcept
+	{
+		assert(value >= MIN_VALUE && value <= MAX_VALUE);
+		return static_cast<uint64_t>(value) << 2;
+	}
+
+	static int64_t decode(uint64_t word) noexcept
+	{
+		return static_cast<int64_t>(word) >> 2;
+	}
+
+	static uint64_t make_ref(int64_t thread, uint64_t sequence, uint64_t tag) noexcept
+	{
+		return sequence << 18 | static_cast<uint64_t>(thread) << 2 | tag;
+	}
+
+	static int64_t ref_thread(uint64_t ref) noexcept
+	{
+		return static_cast<int64_t>((ref >> 2) & 0xffff);
+	}
+
+	static uint64_t ref_sequence(uint64_t ref) noexcept
+	{
+		return ref >> 18;
+	}
+
+	descriptor& local_descriptor(int64_t thread) const noexcept
+	{
+		descriptor* ret = this->m_descriptors[thread].load(std::memory_order_relaxed);
+		if (ret == nullptr)
+		{
+			//only the thread owning the slot creates its descriptor
+			ret = new descriptor();
+			this->m_descriptors[thread].store(ret, std::memory_order_release);
+		}
+
+		return *ret;
+	}
+
+	descriptor& descriptor_of(uint64_t ref) const noexcept
+	{
+		return *this->m_descriptors[ref_thread(ref)].load(std::memory_order_acquire);
+	}
+
+	//finishes whatever operation word refers to, false when word is a plain value
+	bool help(uint64_t word) const noexcept
+	{
+		if ((word & TAG_MASK) == TAG_RDCSS)
+		{
+			help_rdcss(word);
+			return true;
+		}
+
+		if ((word & TAG_MASK) == TAG_MCAS)
+		{
+			help_mcas(word);
+			return true;
+		}
+
+		return false;
+	}
+
+	void help_rdcss(uint64_t ref) const noexcept
+	{
+		const descriptor& d = descriptor_of(ref);
+
+		rdcss_copy copy;
+		copy.ref = ref;
+		copy.index = d.rdcss_index.load(std::memory_order_relaxed);
+		copy.expected = d.rdcss_expected.load(std::memory_order_relaxed);
+		copy.mcas = d.rdcss_mcas.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (d.rdcss_sequence.load(std::memory_order_relaxed) == ref_sequence(ref))
+		{
+			complete(copy);
+		}
+	}
+
+	void help_mcas(uint64_t ref) const noexcept
+	{
+		const descriptor& d = descriptor_of(ref);
+
+		mcas_copy copy;
+		copy.ref = ref;
+		copy.count = d.count.load(std::memory_order_relaxed);
+		if (copy.count < 2 || copy.count > MAX_WORDS)
+		{
+			return;
+		}
+
+		for (int32_t i = 0; i < copy.count; i++)
+		{
+			copy.index[i] = d.index[i].load(std::memory_order_relaxed);
+			copy.expected[i] = d.expected[i].load(std::memory_order_relaxed);
+			copy.desired[i] = d.desired[i].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if ((d.status.load(std::memory_order_relaxed) >> 2) == ref_sequence(ref))
+		{
+			mcas(copy);
+		}
+	}
+
+	//the rdcss reference becomes the mcas reference if the operation is still undecided, otherwise the old value again
+	void complete(const rdcss_copy& copy) const noexcept
+	{
+		const descriptor& owner = descriptor_of(copy.mcas);
+		uint64_t undecided = ref_sequence(copy.mcas) << 2 | UNDECIDED;
+		uint64_t next = owner.status.load(std::memory_order_acquire) == undecided ? copy.mcas : copy.expected;
+
+		uint64_t ref = copy.ref;
+		this->m_stats.count_cas(this->m_data[copy.index].compare_exchange_strong(ref, next, std::memory_order_acq_rel));
+	}
+
+	//puts op's reference into word i if it holds the expected value and op is undecided, returns what the word held
+	uint64_t rdcss(const mcas_copy& op, int32_t i) const noexcept
+	{
+		int64_t thread = wait_free_thread_slot();
+		descriptor& d = local_descriptor(thread);
+		uint64_t sequence = d.rdcss_sequence.load(std::memory_order_relaxed) + 1;
+
+		d.rdcss_sequence.store(sequence, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		d.rdcss_index.store(op.index[i], std::memory_order_relaxed);
+		d.rdcss_expected.store(op.expected[i], std::memory_order_relaxed);
+		d.rdcss_mcas.store(op.ref, std::memory_order_relaxed);
+
+		rdcss_copy copy{ make_ref(thread, sequence, TAG_RDCSS), op.index[i], op.expected[i], op.ref };
+		while (true)
+		{
+			uint64_t word = copy.expected;
+			if (this->m_stats.count_cas(this->m_data[copy.index].compare_exchange_strong(word, copy.ref, std::memory_order_acq_rel)))
+			{
+				complete(copy);
+				return copy.expected;
+			}
+
+			if ((word & TAG_MASK) != TAG_RDCSS)
+			{
+				return word;
+			}
+
+			help_rdcss(word);
+		}
+	}
+
+	bool mcas(const mcas_copy& op) const noexcept
+	{
+		descriptor& d = descriptor_of(op.ref);
+		uint64_t sequence = ref_sequence(op.ref);
+		uint64_t undecided = sequence << 2 | UNDECIDED;
+
+		uint64_t status = d.status.load(std::memory_order_acquire);
+		if (status == undecided)
+		{
+			uint64_t result = SUCCEEDED;
+			for (int32_t i = 0; i < op.count && result == SUCCEEDED; i++)
+			{
+				while (true)
+				{
+					uint64_t word = rdcss(op, i);
+					if ((word & TAG_MASK) == TAG_MCAS)
+					{
+						if (word == op.ref)
+						{
+							break;
+						}
+
+						help_mcas(word);
+						continue;
+					}
+
+					if (word != op.expected[i])
+					{
+						result = FAILED;
+					}
+					break;
+				}
+			}
+
+			d.status.compare_exchange_strong(undecided, sequence << 2 | result, std::memory_order_acq_rel);
+			status = d.status.load(std::memory_order_acquire);
+		}
+
+		//the descriptor was reused, the operation finished long ago and its words are clean
+		if ((status >> 2) != sequence)
+		{
+			return false;
+		}
+
+		bool succeeded = (status & TAG_MASK) == SUCCEEDED;
+		for (int32_t i = 0; i < op.count; i++)
+		{
+			uint64_t ref = op.ref;
+			this->m_stats.count_cas(this->m_data[op.index[i]].compare_exchange_strong(ref, succeeded ? op.desired[i] : op.expected[i], std::memory_order_acq_rel));
+		}
+
+		return succeeded;
+	}
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(WAIT_FREE_LATENCY_USE_RDTSC)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "wait_free_stats.hpp"
+
+//compile with WAIT_FREE_ENABLE_LATENCY=1 to sample per operation latency inside the containers
+//WAIT_FREE_LATENCY_USE_RDTSC=1 reads the time stamp counter instead of steady_clock (x86, invariant tsc only)
+//disabled, the recorder is an empty class and the timing scopes compile to nothing
+#ifndef WAIT_FREE_ENABLE_LATENCY
+#define WAIT_FREE_ENABLE_LATENCY 0
+#endif
+
+//default 1 sample every N operations, per container it can be changed with set_latency_sample_rate
+#ifndef WAIT_FREE_LATENCY_SAMPLE_RATE
+#define WAIT_FREE_LATENCY_SAMPLE_RATE 1
+#endif
+
+enum class wait_free_op : int32_t
+{
+	enqueue = 0,
+	dequeue,
+	push_back,
+	get,
+	allocate,
+	deallocate,
+	count
+};
+
+struct wait_free_latency_clock
+{
+	static int64_t now() noexcept
+	{
+#if defined(WAIT_FREE_LATENCY_USE_RDTSC)
+		return static_cast<int64_t>(__rdtsc());
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	//measured once on first use, only export pays for it
+	static double ticks_per_ns() noexcept
+	{
+#if defined(WAIT_FREE_LATENCY_USE_RDTSC)
+		static const double ratio = []()
+		{
+			auto start_time = std::chrono::steady_clock::now();
+			int64_t start_ticks = now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			int64_t elapsed_ticks = now() - start_ticks;
+			auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+			return elapsed_ns > 0 ? static_cast<double>(elapsed_ticks) / elapsed_ns : 1.0;
+		}();
+
+		return ratio;
+#else
+		return 1.0;
+#endif
+	}
+};
+
+struct wait_free_latency_summary
+{
+	int64_t		count{ 0 };
+	int64_t		p50_ns{ 0 };
+	int64_t		p99_ns{ 0 };
+	int64_t		p999_ns{ 0 };
+	int64_t		max_ns{ 0 };
+};
+
+//log-linear buckets in the HdrHistogram layout, 16 linear sub-buckets per power of two, values below 32 are exact
+//relative error stays under 1/16 over the whole int64_t range with 976 buckets
+class wait_free_latency_histogram
+{
+public:
+	static constexpr int32_t SUB_BUCKET_BITS = 5;
+	static constexpr int64_t SUB_BUCKET_COUNT = static_cast<int64_t>(1) << SUB_BUCKET_BITS;
+	static constexpr int64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+	static constexpr int64_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+	wait_free_latency_histogram() :
+		m_counts(BUCKET_COUNT, 0),
+		m_max(0)
+	{
+	}
+
+	static int64_t bucket_index(int64_t value) noexcept
+	{
+		uint64_t v = value < 0 ? 0 : static_cast<uint64_t>(value);
+		if (v < static_cast<uint64_t>(SUB_BUCKET_COUNT))
+		{
+			return static_cast<int64_t>(v);
+		}
+
+		int32_t shift = highest_bit(v) - (SUB_BUCKET_BITS - 1);
+
+		return (shift + 1) * SUB_BUCKET_HALF + static_cast<int64_t>(v >> shift) - SUB_BUCKET_HALF;
+	}
+
+	//highest value that lands in the bucket
+	static int64_t bucket_upper_value(int64_t index) noexcept
+	{
+		if (index < SUB_BUCKET_COUNT)
+		{
+			return index;
+		}
+
+		int32_t shift = static_cast<int32_t>(index / SUB_BUCKET_HALF) - 1;
+		uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKET_HALF + SUB_BUCKET_HALF);
+
+		return static_cast<int64_t>((((sub + 1) << shift) - 1) & static_cast<uint64_t>(INT64_MAX));
+	}
+
+	void record(int64_t value, int64_t count = 1) noexcept
+	{
+		this->m_counts[bucket_index(value)] += count;
+		this->m_max = (std::max)(this->m_max, value);
+	}
+
+	void add_bucket(int64_t index, int64_t count) noexcept
+	{
+		this->m_counts[index] += count;
+	}
+
+	void merge(const wait_free_latency_histogram& rhd) noexcept
+	{
+		for (int64_t i = 0; i < BUCKET_COUNT; i++)
+		{
+			this->m_counts[i] += rhd.m_counts[i];
+		}
+		this->m_max = (std::max)(this->m_max, rhd.m_max);
+	}
+
+	int64_t count() const noexcept
+	{
+		int64_t ret(0);
+		for (int64_t count : this->m_counts)
+		{
+			ret += count;
+		}
+
+		return ret;
+	}
+
+	int64_t max() const noexcept
+	{
+		return this->m_max;
+	}
+
+	void set_max(int64_t value) noexcept
+	{
+		this->m_max = (std::max)(this->m_max, value);
+	}
+
+	//in recorded ticks, percentile in [0, 100]
+	int64_t value_at_percentile(double percentile) const noexcept
+	{
+		int64_t total = count();
+		if (total == 0)
+		{
+			return 0;
+		}
+
+		int64_t rank = static_cast<int64_t>(percentile / 100.0 * total + 0.5);
+		rank = (std::min)((std::max)(rank, static_cast<int64_t>(1)), total);
+
+		int64_t seen(0);
+		for (int64_t i = 0; i < BUCKET_COUNT; i++)
+		{
+			seen += this->m_counts[i];
+			if (seen >= rank)
+			{
+				return (std::min)(bucket_upper_value(i), this->m_max);
+			}
+		}
+
+		return this->m_max;
+	}
+
+	wait_free_latency_summary summary() const noexcept
+	{
+		double ticks_per_ns = wait_free_latency_clock::ticks_per_ns();
+		auto to_ns = [=](int64_t ticks) { return static_cast<int64_t>(ticks / ticks_per_ns); };
+
+		wait_free_latency_summary ret;
+		ret.count = count();
+		ret.p50_ns = to_ns(value_at_percentile(50.0));
+		ret.p99_ns = to_ns(value_at_percentile(99.0));
+		ret.p999_ns = to_ns(value_at_percentile(99.9));
+		ret.max_ns = to_ns(this->m_max);
+
+		return ret;
+	}
+
+private:
+	std::vector<int64_t>	m_counts;
+	int64_t					m_max;
+
+	static int32_t highest_bit(uint64_t v) noexcept
+	{
+		int32_t ret(0);
+		while (v >>= 1)
+		{
+			ret++;
+		}
+
+		return ret;
+	}
+};
+
+template<bool enabled>
+class wait_free_latency_policy;
+
+template<>
+class wait_free_latency_policy<false>
+{
+public:
+	class scope
+	{
+	public:
+		scope(const wait_free_latency_policy&, wait_free_op) noexcept
+		{
+		}
+	};
+
+	void set_sample_rate(int64_t) noexcept
+	{
+	}
+
+	int64_t sample_rate() const noexcept
+	{
+		return 0;
+	}
+
+	wait_free_latency_histogram histogram(wait_free_op) const
+	{
+		return {};
+	}
+
+	void reset() noexcept
+	{
+	}
+};
+
+//per thread shards of atomic buckets, allocated on the first sample a shard takes for an operation
+//recording is one relaxed fetch_add, export merges every shard into a plain histogram
+template<>
+class wait_free_latency_policy<true>
+{
+	static const int64_t SHARD_COUNT = 64;
+	static const int32_t OP_COUNT = static_cast<int32_t>(wait_free_op::count);
+
+	struct shard
+	{
+		std::atomic<int64_t>	counts[wait_free_latency_histogram::BUCKET_COUNT];
+		std::atomic<int64_t>	max;
+
+		shard() noexcept
+		{
+			for (auto& count : this->counts)
+			{
+				count.store(0, std::memory_order_relaxed);
+			}
+			this->max.store(0, std::memory_order_relaxed);
+		}
+	};
+
+public:
+	class scope
+	{
+	public:
+		scope(const wait_free_latency_policy& latency, wait_free_op op) noexcept :
+			m_latency(latency),
+			m_op(op),
+			m_start(latency.sampled() ? wait_free_latency_clock::now() : -1)
+		{
+		}
+
+		~scope()
+		{
+			if (this->m_start >= 0)
+			{
+				this->m_latency.record(this->m_op, wait_free_latency_clock::now() - this->m_start);
+			}
+		}
+
+	private:
+		const wait_free_latency_policy&		m_latency;
+		wait_free_op						m_op;
+		int64_t								m_start;
+	};
+
+	wait_free_latency_policy() noexcept :
+		m_sample_rate(WAIT_FREE_LATENCY_SAMPLE_RATE)
+	{
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			for (int32_t j = 0; j < OP_COUNT; j++)
+			{
+				this->m_shards[i][j].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	~wait_free_latency_policy()
+	{
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			for (int32_t j = 0; j < OP_COUNT; j++)
+			{
+				delete this->m_shards[i][j].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	wait_free_latency_policy(const wait_free_latency_policy&) = delete;
+	wait_free_latency_policy& operator=(const wait_free_latency_policy&) = delete;
+
+	//sample 1 of every_n operations per thread, 0 turns sampling off
+	void set_sample_rate(int64_t every_n) noexcept
+	{
+		this->m_sample_rate.store((std::max)(every_n, static_cast<int64_t>(0)), std::memory_order_relaxed);
+	}
+
+	int64_t sample_rate() const noexcept
+	{
+		return this->m_sample_rate.load(std::memory_order_relaxed);
+	}
+
+	wait_free_latency_histogram histogram(wait_free_op op) const
+	{
+		wait_free_latency_histogram ret;
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			shard* s = this->m_shards[i][static_cast<int32_t>(op)].load(std::memory_order_acquire);
+			if (s == nullptr)
+			{
+				continue;
+			}
+
+			for (int64_t j = 0; j < wait_free_latency_histogram::BUCKET_COUNT; j++)
+			{
+				ret.add_bucket(j, s->counts[j].load(std::memory_order_relaxed));
+			}
+			ret.set_max(s->max.load(std::memory_order_relaxed));
+		}
+
+		return ret;
+	}
+
+	//racing recorders may land a sample on either side of the reset
+	void reset() noexcept
+	{
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			for (int32_t j = 0; j < OP_COUNT; j++)
+			{
+				shard* s = this->m_shards[i][j].load(std::memory_order_acquire);
+				if (s == nullptr)
+				{
+					continue;
+				}
+
+				for (auto& count : s->counts)
+				{
+					count.store(0, std::memory_order_relaxed);
+				}
+				s->max.store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	mutable std::atomic<shard*>		m_shards[SHARD_COUNT][OP_COUNT];
+	std::atomic<int64_t>			m_sample_rate;
+
+	//per thread xorshift, independent of which container or operation asks so alternating operations don't alias
+	bool sampled() const noexcept
+	{
+		int64_t rate = this->m_sample_rate.load(std::memory_order_relaxed);
+		if (rate <= 1)
+		{
+			return rate == 1;
+		}
+
+		static thread_local uint64_t state = 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(wait_free_thread_index() + 1);
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		return state % static_cast<uint64_t>(rate) == 0;
+	}
+
+	void record(wait_free_op op, int64_t ticks) const noexcept
+	{
+		std::atomic<shard*>& slot = this->m_shards[wait_free_thread_index() % SHARD_COUNT][static_cast<int32_t>(op)];
+		shard* s = slot.load(std::memory_order_acquire);
+		if (s == nullptr)
+		{
+			shard* new_shard = new (std::nothrow) shard();
+			if (new_shard == nullptr)
+			{
+				return;
+			}
+
+			if (slot.compare_exchange_strong(s, new_shard, std::memory_order_acq_rel))
+			{
+				s = new_shard;
+			}
+			else
+			{
+				delete new_shard;
+			}
+		}
+
+		s->counts[wait_free_latency_histogram::bucket_index(ticks)].fetch_add(1, std::memory_order_relaxed);
+
+		int64_t old_max = s->max.load(std::memory_order_relaxed);
+		while (ticks > old_max && !s->max.compare_exchange_weak(old_max, ticks, std::memory_order_relaxed));
+	}
+};
+
+using wait_free_latency = wait_free_latency_policy<WAIT_FREE_ENABLE_LATENCY != 0>;
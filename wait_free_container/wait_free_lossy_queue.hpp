@@ -0,0 +1,241 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#include "template_util.hpp"
+#include "wait_free_memory.hpp"
+
+//fixed capacity mpmc ring that overwrites the oldest element when full, for telemetry that would rather lose samples than wait
+//a producer is one fetch_add and a slot write whatever the consumers do, the ring never grows
+//consumers share one cursor, a consumer that finds it a lap behind moves it to the oldest element still in the ring
+//and counts what was skipped
+//elements are copied out and validated against the slot sequence, so T has to be trivially copyable
+template<typename T, template<typename U> typename TAllocator = std::allocator>
+class wait_free_lossy_queue : private wait_free_stats_base
+{
+	static_assert(std::is_trivially_copyable_v<T>, "wait_free_lossy_queue element must be trivially copyable");
+
+	static constexpr int64_t WRITING = (std::numeric_limits<int64_t>::min)();
+
+public:
+	explicit wait_free_lossy_queue(
+		int64_t capacity = 1024,
+		const TAllocator<T>& allocator = TAllocator<T>(),
+		const TAllocator<std::atomic<int64_t>>& sequence_allocator = TAllocator<std::atomic<int64_t>>()) :
+		m_data(nullptr),
+		m_published(nullptr),
+		m_allocator(allocator),
+		m_sequence_allocator(sequence_allocator),
+		m_capacity(0),
+		m_mask(0),
+		m_claim(0),
+		m_cursor(0),
+		m_lost(0)
+	{
+		assert(capacity > 0);
+
+		int64_t pow2_capacity(1);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		this->m_capacity = pow2_capacity;
+		this->m_mask = pow2_capacity - 1;
+
+		this->m_data = this->m_allocator.allocate(pow2_capacity);
+		assert(this->m_data);
+		std::uninitialized_fill_n(this->m_data, pow2_capacity, T());
+
+		//slot i is initially "published" for sequence i - capacity, i.e. not readable yet
+		this->m_published = this->m_sequence_allocator.allocate(pow2_capacity);
+		assert(this->m_published);
+		for (int64_t i = 0; i < pow2_capacity; i++)
+		{
+			new (&this->m_published[i]) std::atomic<int64_t>(i - pow2_capacity);
+		}
+
+		this->m_registration.add();
+	}
+
+	~wait_free_lossy_queue()
+	{
+		this->m_registration.remove();
+
+		this->m_allocator.deallocate(this->m_data, this->m_capacity);
+
+		std::for_each(this->m_published, this->m_published + this->m_capacity,
+		[](std::atomic<int64_t>& elem)
+		{
+			elem.~atomic<int64_t>();
+		});
+		this->m_sequence_allocator.deallocate(this->m_published, this->m_capacity);
+	}
+
+	wait_free_lossy_queue(const wait_free_lossy_queue&) = delete;
+	wait_free_lossy_queue& operator=(const wait_free_lossy_queue&) = delete;
+
+	//returns the element's sequence, never fails, the element a lap older is overwritten if nobody took it yet
+	int64_t enqueue(const T& value)
+	{
+		int64_t sequence = this->m_claim.fetch_add(1);
+		write(sequence, value);
+
+		return sequence;
+	}
+
+	//returns the element's sequence, -1 when empty or when the oldest element is still being written
+	int64_t dequeue(T& elem) noexcept
+	{
+		int64_t lost(0);
+		return dequeue(elem, lost);
+	}
+
+	//lost is what this call skipped because producers overwrote it before any consumer got to it
+	int64_t dequeue(T& elem, int64_t& lost) noexcept
+	{
+		lost = 0;
+
+		int64_t cursor = this->m_cursor.load(std::memory_order_acquire);
+		while (true)
+		{
+			int64_t oldest = this->m_claim.load(std::memory_order_acquire) - this->m_capacity;
+			if (cursor < oldest)
+			{
+				if (this->m_stats.count_cas(this->m_cursor.compare_exchange_weak(cursor, oldest, std::memory_order_acq_rel)))
+				{
+					lost += oldest - cursor;
+					this->m_lost.fetch_add(oldest - cursor, std::memory_order_relaxed);
+					cursor = oldest;
+				}
+				continue;
+			}
+
+			std::atomic<int64_t>& published = this->m_published[cursor & this->m_mask];
+			int64_t sequence = published.load(std::memory_order_acquire);
+			if (sequence != cursor)
+			{
+				//a newer lap means the claim moved on, recheck oldest, otherwise the slot isn't published yet
+				if (sequence > cursor)
+				{
+					cursor = this->m_cursor.load(std::memory_order_acquire);
+					continue;
+				}
+
+				return -1;
+			}
+
+			T value(this->m_data[cursor & this->m_mask]);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (published.load(std::memory_order_relaxed) != cursor)
+			{
+				cursor = this->m_cursor.load(std::memory_order_acquire);
+				continue;
+			}
+
+			if (this->m_stats.count_cas(this->m_cursor.compare_exchange_weak(cursor, cursor + 1, std::memory_order_acq_rel)))
+			{
+				elem = value;
+				return cursor;
+			}
+		}
+	}
+
+	//elements overwritten before any consumer took them, since construction
+	int64_t lost() const noexcept
+	{
+		return this->m_lost.load(std::memory_order_relaxed);
+	}
+
+	int64_t claimed() const noexcept
+	{
+		return this->m_claim.load(std::memory_order_relaxed);
+	}
+
+	size_t size() const noexcept
+	{
+		int64_t cursor = this->m_cursor.load(std::memory_order_acquire);
+		int64_t claim = this->m_claim.load(std::memory_order_acquire);
+
+		return static_cast<size_t>((std::min)((std::max)(claim - cursor, static_cast<int64_t>(0)), this->m_capacity));
+	}
+
+	size_t capacity() const noexcept
+	{
+		return this->m_capacity;
+	}
+
+	//fixed storage, peak is every slot written so far
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t elem_size = static_cast<int64_t>(sizeof(T));
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_capacity * static_cast<int64_t>(sizeof(T) + sizeof(std::atomic<int64_t>));
+		ret.live_bytes = static_cast<int64_t>(size()) * elem_size;
+		ret.peak_live_bytes = (std::min)(this->m_claim.load(std::memory_order_acquire), this->m_capacity) * elem_size;
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+
+	T*										m_data;
+	std::atomic<int64_t>*					m_published;
+	TAllocator<T>							m_allocator;
+	TAllocator<std::atomic<int64_t>>		m_sequence_allocator;
+	int64_t									m_capacity;
+	int64_t									m_mask;
+
+	alignas(64) std::atomic<int64_t>		m_claim;
+	alignas(64) std::atomic<int64_t>		m_cursor;
+	alignas(64) std::atomic<int64_t>		m_lost;
+	wait_free_registration					m_registration{ this, "wait_free_lossy_queue", false };
+
+	//producers a lap apart can hit the same slot, mark it WRITING so the older one never publishes over the newer
+	void write(int64_t sequence, const T& value)
+	{
+		std::atomic<int64_t>& published = this->m_published[sequence & this->m_mask];
+		int64_t old_sequence(0);
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
+		while (true)
+		{
+			old_sequence = published.load(std::memory_order_relaxed);
+			if (old_sequence == WRITING)
+			{
+				spin.tick();
+				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
+				continue;
+			}
+
+			if (old_sequence > sequence)
+			{
+				return;
+			}
+
+			if (this->m_stats.count_cas(published.compare_exchange_weak(old_sequence, WRITING, std::memory_order_acquire)))
+			{
+				break;
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_release);
+		this->m_data[sequence & this->m_mask] = value;
+		published.store(sequence, std::memory_order_release);
+	}
+};
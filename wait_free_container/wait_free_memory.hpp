@@ -0,0 +1,290 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+//compile with WAIT_FREE_ENABLE_REGISTRY=1 to list every live container in wait_free_registry
+//disabled, registrations are empty and construction / destruction never touch the registry lock
+#ifndef WAIT_FREE_ENABLE_REGISTRY
+#define WAIT_FREE_ENABLE_REGISTRY 0
+#endif
+
+//what a container holds, nested containers (a pool's buffer and free list, a generic queue's pool...) are summed in
+//reserved_bytes		storage allocated, including retired arrays still kept alive
+//live_bytes			storage holding elements right now
+//free_list_length		released slots waiting to be reused
+//peak_live_bytes		highest live_bytes seen, per container before summing
+//growth_count			capacity increases since construction
+struct wait_free_memory_usage
+{
+	int64_t		reserved_bytes{ 0 };
+	int64_t		live_bytes{ 0 };
+	int64_t		free_list_length{ 0 };
+	int64_t		peak_live_bytes{ 0 };
+	int64_t		growth_count{ 0 };
+
+	wait_free_memory_usage& operator+=(const wait_free_memory_usage& rhd) noexcept
+	{
+		this->reserved_bytes += rhd.reserved_bytes;
+		this->live_bytes += rhd.live_bytes;
+		this->free_list_length += rhd.free_list_length;
+		this->peak_live_bytes += rhd.peak_live_bytes;
+		this->growth_count += rhd.growth_count;
+
+		return *this;
+	}
+};
+
+//running maximum written by many threads, once the peak is reached an update is a single relaxed load
+class wait_free_high_water
+{
+public:
+	void update(int64_t value) noexcept
+	{
+		int64_t old_value = this->m_value.load(std::memory_order_relaxed);
+		while (value > old_value && !this->m_value.compare_exchange_weak(old_value, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	int64_t get() const noexcept
+	{
+		return this->m_value.load(std::memory_order_relaxed);
+	}
+
+	void reset() noexcept
+	{
+		this->m_value.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int64_t>	m_value{ 0 };
+};
+
+template<bool enabled>
+class wait_free_registration_policy;
+
+//every live container, for a diagnostics endpoint, always empty unless WAIT_FREE_ENABLE_REGISTRY is on
+//enumeration holds the registry lock, a container being destroyed meanwhile waits for it in remove()
+class wait_free_registry
+{
+	friend class wait_free_registration_policy<true>;
+
+public:
+	struct entry
+	{
+		const char*					type;
+		const void*					object;
+		//inside another registered container, its usage is already part of the owner's
+		bool						nested;
+		wait_free_memory_usage		usage;
+	};
+
+	static wait_free_registry& instance()
+	{
+		static wait_free_registry ret;
+		return ret;
+	}
+
+	std::vector<entry> entries(bool include_nested = false) const;
+
+	//top level containers only, the nested ones are already summed into their owners
+	wait_free_memory_usage total() const
+	{
+		wait_free_memory_usage ret;
+		for (auto& e : entries())
+		{
+			ret += e.usage;
+		}
+
+		return ret;
+	}
+
+	void write_json(std::ostream& out, bool include_nested = false) const
+	{
+		out << "[";
+
+		bool first = true;
+		for (auto& e : entries(include_nested))
+		{
+			out << (first ? "\n" : ",\n") << "{\"type\":\"" << e.type << "\",\"object\":\"" << e.object << "\",\"nested\":" << (e.nested ? "true" : "false")
+				<< ",\"reserved_bytes\":" << e.usage.reserved_bytes << ",\"live_bytes\":" << e.usage.live_bytes
+				<< ",\"free_list_length\":" << e.usage.free_list_length << ",\"peak_live_bytes\":" << e.usage.peak_live_bytes
+				<< ",\"growth_count\":" << e.usage.growth_count << "}";
+			first = false;
+		}
+
+		out << "\n]\n";
+	}
+
+private:
+	using registration = wait_free_registration_policy<true>;
+
+	mutable std::mutex				m_mutex;
+	registration*					m_head{ nullptr };
+
+	wait_free_registry() = default;
+
+	void add(registration* r);
+	void remove(registration* r);
+};
+
+template<>
+class wait_free_registration_policy<false>
+{
+public:
+	template<typename TContainer>
+	wait_free_registration_policy(const TContainer*, const char*, bool = true) noexcept
+	{
+	}
+
+	wait_free_registration_policy(const wait_free_registration_policy&) = delete;
+	wait_free_registration_policy& operator=(const wait_free_registration_policy&) = delete;
+
+	void add() noexcept
+	{
+	}
+
+	void remove() noexcept
+	{
+	}
+};
+
+//declared as the last member of a container so it registers once the other members are constructed
+//a container whose destructor or detach frees what memory_usage() reads calls remove() first, enumeration holds the
+//registry lock while it reports, so once remove() returns no report is running and none will start
+//a container whose memory_usage() needs its constructor body passes registered false and calls add() at the end of it,
+//the others can be reported before the body ran, so they only read members set in the initializer list
+template<>
+class wait_free_registration_policy<true>
+{
+	friend class wait_free_registry;
+
+public:
+	//registered false leaves it out until add(), for containers that attach their storage later
+	template<typename TContainer>
+	wait_free_registration_policy(const TContainer* container, const char* type, bool registered = true) :
+		m_type(type),
+		m_object(container),
+		m_size(sizeof(TContainer)),
+		m_report([](const void* object) { return static_cast<const TContainer*>(object)->memory_usage(); })
+	{
+		if (registered)
+		{
+			add();
+		}
+	}
+
+	~wait_free_registration_policy()
+	{
+		remove();
+	}
+
+	wait_free_registration_policy(const wait_free_registration_policy&) = delete;
+	wait_free_registration_policy& operator=(const wait_free_registration_policy&) = delete;
+
+	//add and remove are called by the owning container only, both do nothing when already in that state
+	void add()
+	{
+		if (!this->m_registered)
+		{
+			wait_free_registry::instance().add(this);
+			this->m_registered = true;
+		}
+	}
+
+	void remove()
+	{
+		if (this->m_registered)
+		{
+			wait_free_registry::instance().remove(this);
+			this->m_registered = false;
+		}
+	}
+
+private:
+	const char*						m_type;
+	const void*						m_object;
+	size_t							m_size;
+	wait_free_memory_usage			(*m_report)(const void*);
+	wait_free_registration_policy*	m_prev{ nullptr };
+	wait_free_registration_policy*	m_next{ nullptr };
+	bool							m_registered{ false };
+};
+
+using wait_free_registration = wait_free_registration_policy<WAIT_FREE_ENABLE_REGISTRY != 0>;
+
+inline void wait_free_registry::add(registration* r)
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	r->m_next = this->m_head;
+	if (this->m_head != nullptr)
+	{
+		this->m_head->m_prev = r;
+	}
+	this->m_head = r;
+}
+
+inline void wait_free_registry::remove(registration* r)
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	if (r->m_prev != nullptr)
+	{
+		r->m_prev->m_next = r->m_next;
+	}
+	else
+	{
+		this->m_head = r->m_next;
+	}
+
+	if (r->m_next != nullptr)
+	{
+		r->m_next->m_prev = r->m_prev;
+	}
+}
+
+//a container is nested when its object lies inside another registered one, members are found by address
+inline std::vector<wait_free_registry::entry> wait_free_registry::entries(bool include_nested) const
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+
+	std::vector<const registration*> registrations;
+	for (const registration* r = this->m_head; r != nullptr; r = r->m_next)
+	{
+		registrations.push_back(r);
+	}
+
+	//by address, owners before the members they contain
+	std::sort(registrations.begin(), registrations.end(), [](const registration* a, const registration* b)
+	{
+		auto a_begin = reinterpret_cast<uintptr_t>(a->m_object);
+		auto b_begin = reinterpret_cast<uintptr_t>(b->m_object);
+		return a_begin != b_begin ? a_begin < b_begin : a->m_size > b->m_size;
+	});
+
+	std::vector<entry> ret;
+	uintptr_t owner_end(0);
+	for (const registration* r : registrations)
+	{
+		uintptr_t begin = reinterpret_cast<uintptr_t>(r->m_object);
+		bool nested = begin < owner_end;
+		if (!nested)
+		{
+			owner_end = begin + r->m_size;
+		}
+
+		if (nested && !include_nested)
+		{
+			continue;
+		}
+
+		ret.push_back({ r->m_type, r->m_object, nested, r->m_report(r->m_object) });
+	}
+
+	return ret;
+}
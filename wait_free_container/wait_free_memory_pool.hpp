@@ -1,12 +1,17 @@
 #pragma once
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 #include <memory>
 
 #include "template_util.hpp"
 #include "wait_free_buffer.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_pages.hpp"
 #include "wait_free_queue.hpp"
 
 enum class memory_pool_elem_state : int64_t
@@ -19,8 +24,9 @@ enum class memory_pool_elem_state : int64_t
 //wait_free_memory_pool will stuck when itorator dosen't release the lock, beacuse the iterator stuck increase_capacity function
 //implement a manual resize wait_free_buffer, when wait_free_buffer fulled, allocate return nullptr, meantime memory_pool call the increase_capacity
 template<typename T, template <typename U> typename TAllocator = std::allocator>
-class wait_free_memory_pool
+class wait_free_memory_pool : private wait_free_stats_base
 {
+	static_assert(wait_free_is_trivially_relocatable_v<T>, "wait_free_memory_pool element must be trivially relocatable, increase_capacity moves it with memcpy");
 
 public:
 
@@ -28,10 +34,10 @@ public:
 
 private:
 
-	static const int64_t BUFFER_VALID = 0;
-	static const int64_t BUFFER_FREE = -1;
-	static const int64_t BUFFER_INSERTING = -2;
-	static const int64_t QUEUE_FREE = -1;
+	static constexpr int64_t BUFFER_VALID = 0;
+	static constexpr int64_t BUFFER_FREE = -1;
+	static constexpr int64_t BUFFER_INSERTING = -2;
+	static constexpr int64_t QUEUE_FREE = -1;
 
 public:
 
@@ -40,9 +46,10 @@ public:
         m_capacity(0),
         m_elem_ref_count(0),
         m_capacity_changing(0),
-        m_buffer(BUFFER_INSERTING, BUFFER_FREE, capacity),
-        m_queue(QUEUE_FREE, capacity),
-        m_allocator(allocator)
+        m_buffer(BUFFER_INSERTING, BUFFER_FREE, capacity, TAllocator<std::atomic<int64_t>>(allocator)),
+        m_queue(QUEUE_FREE, capacity, TAllocator<std::atomic<int64_t>>(allocator)),
+        m_allocator(allocator),
+        m_growth_count(0)
 	{
 		this->m_data = this->m_allocator.allocate(capacity);
 		assert(this->m_data);
@@ -52,15 +59,24 @@ public:
 	// to fix...
 	~wait_free_memory_pool()
 	{
+		this->m_registration.remove();
+
 		this->m_allocator.deallocate(this->m_data, this->m_capacity);
 	}
 
 	iterator allocate()
 	{
+		wait_free_latency::scope latency_scope(this->m_latency, wait_free_op::allocate);
+
 		int64_t offset(0);
 
 		if (this->m_queue.dequeue(offset) != -1)
 		{
+			//a recycled slot is live again, otherwise its next deallocate would not find it and drop it
+			bool inserted = this->m_buffer.insert(offset, BUFFER_VALID);
+			assert(inserted);
+			(void)inserted;
+
 			return { this, offset };
 		}
 		else
@@ -83,6 +99,7 @@ public:
 		{
 			int64_t count = this->m_queue.enqueue(offset);
 			assert(count != -1);
+			(void)count;
 
 			return true;
 		}
@@ -132,6 +149,60 @@ public:
 		return this->m_capacity;
 	}
 
+	//element storage, slot state buffer and free list all sized for capacity elements, see wait_free_queue::reserve
+	bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+	{
+		wait_free_set_reserve_options(this->m_allocator, options);
+		if (capacity > this->m_capacity)
+		{
+			increase_capacity(capacity);
+		}
+
+		bool ret = wait_free_prepare_storage(this->m_allocator, this->m_data, this->m_capacity * sizeof(T), options);
+		ret &= this->m_buffer.reserve(capacity, options);
+		ret &= this->m_queue.reserve(capacity, options);
+
+		return ret;
+	}
+
+	//element storage plus the slot state buffer and the free list queue
+	//released offsets wait in the queue, the same slots show up as holes in the buffer, so they are counted once
+	//free slots are reused before the buffer grows, cur_pos is how many elements were ever live at once
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret = this->m_buffer.memory_usage();
+		ret += this->m_queue.memory_usage();
+
+		ret.reserved_bytes += this->m_capacity * static_cast<int64_t>(sizeof(T));
+		ret.live_bytes += static_cast<int64_t>(this->m_buffer.elem_count() * sizeof(T));
+		ret.free_list_length = static_cast<int64_t>(this->m_queue.size());
+		ret.peak_live_bytes += static_cast<int64_t>(this->m_buffer.cur_pos() * sizeof(T));
+		ret.growth_count += this->m_growth_count;
+
+		return ret;
+	}
+
+	//pool gate plus the inner buffer and free list
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret = this->m_stats.snapshot();
+		ret += this->m_buffer.stats();
+		ret += this->m_queue.stats();
+
+		return ret;
+	}
+
+	//merge of every thread's samples for op, summary() gives p50/p99/p999/max in ns
+	wait_free_latency_histogram latency(wait_free_op op) const
+	{
+		return this->m_latency.histogram(op);
+	}
+
+	void set_latency_sample_rate(int64_t every_n) noexcept
+	{
+		this->m_latency.set_sample_rate(every_n);
+	}
+
 private:
 
 	T*									m_data;
@@ -139,28 +210,37 @@ private:
 	mutable std::atomic<int64_t>		m_elem_ref_count;
 	mutable std::atomic<int64_t>		m_capacity_changing;
 
-	mutable wait_free_buffer<int64_t>	m_buffer;
-	wait_free_queue<int64_t>			m_queue;
+	//slot states and the free list come from the same allocator as the elements, so they share their placement
+	mutable wait_free_buffer<int64_t, TAllocator>	m_buffer;
+	wait_free_queue<int64_t, TAllocator>			m_queue;
 	TAllocator<T>						m_allocator;
+	std::atomic<int64_t>				m_growth_count;
+	wait_free_latency					m_latency;
+	wait_free_registration				m_registration{ this, "wait_free_memory_pool" };
 
     int64_t increase_ref_count() const noexcept
 	{
-        return mutex_check_weak(this->m_elem_ref_count, this->m_capacity_changing);
+        return mutex_check_weak(this->m_stats, this->m_elem_ref_count, this->m_capacity_changing);
 	}
 
 	void increase_capacity(int64_t new_capacity)
 	{
-		mutex_check_cas_lock_strong(this->m_capacity_changing, this->m_elem_ref_count);
+		mutex_check_cas_lock_strong(this->m_stats, this->m_capacity_changing, this->m_elem_ref_count);
 		
 		if (new_capacity < this->m_capacity) 
 		{
 			this->m_capacity_changing = false;
 			return;
 		}
+
+		wait_free_stats::stall_timer stall_timer(this->m_stats);
+		wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+		this->m_stats.add(wait_free_stat::resize);
+		this->m_growth_count++;
 		
 		T* new_data = this->m_allocator.allocate(new_capacity);
 		assert(new_data);
-        ::memcpy(new_data, this->m_data, this->m_capacity * sizeof(T));
+        ::memcpy(static_cast<void*>(new_data), static_cast<const void*>(this->m_data), this->m_capacity * sizeof(T));
 
         this->m_allocator.deallocate(this->m_data, this->m_capacity);
         this->m_data = new_data;
@@ -177,9 +257,9 @@ private:
 		do 
 		{
 			old_count = this->m_elem_ref_count;
-			new_count = std::max(old_count - count, 0ll);
+			new_count = std::max(old_count - count, static_cast<int64_t>(0));
 		} 
-		while (!this->m_elem_ref_count.compare_exchange_strong(old_count, new_count));
+		while (!this->m_stats.count_cas(this->m_elem_ref_count.compare_exchange_strong(old_count, new_count)));
 
 		return old_count;
 	}
@@ -206,6 +286,7 @@ private:
 
         default:
             assert(0);
+            abort();
         }
     }
 
@@ -291,6 +372,7 @@ public:
 
 			default:
 				assert(0);
+				abort();
 			}
 		}
 
@@ -309,7 +391,7 @@ public:
 			do
 			{
 				old_count = this->m_lock_count;
-				new_count = std::max(old_count - 1, 0ll);
+				new_count = std::max(old_count - 1, static_cast<int64_t>(0));
 			} while (!this->m_lock_count.compare_exchange_strong(old_count, new_count));
 
 			if (old_count > new_count)
@@ -323,6 +405,11 @@ public:
 			return this->m_offset;
 		}
 
+		wait_free_memory_pool* pool() const noexcept
+		{
+			return this->m_mempry_pool;
+		}
+
 		memory_pool_elem_state state() const noexcept
 		{
 			assert(this->m_mempry_pool != nullptr);
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "wait_free_memory.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_pages.hpp"
+#include "wait_free_queue.hpp"
+#include "wait_free_stats.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//numa nodes and the node a thread runs on, read from sysfs, libnuma is not needed
+//a simulated topology splits threads over n nodes by thread index so the node local paths run on a single node machine,
+//set it with simulate() or the WAIT_FREE_NUMA_NODES environment variable, memory is not bound while simulating
+class wait_free_numa_topology
+{
+public:
+	static wait_free_numa_topology& instance()
+	{
+		static wait_free_numa_topology ret;
+		return ret;
+	}
+
+	int32_t node_count() const noexcept
+	{
+		int32_t simulated = this->m_simulated_nodes.load(std::memory_order_relaxed);
+		return simulated > 0 ? simulated : this->m_node_count;
+	}
+
+	bool simulated() const noexcept
+	{
+		return this->m_simulated_nodes.load(std::memory_order_relaxed) > 0;
+	}
+
+	//setup time only, 0 goes back to the real topology
+	void simulate(int32_t nodes) noexcept
+	{
+		this->m_simulated_nodes.store((std::max)(nodes, 0), std::memory_order_relaxed);
+	}
+
+	//node of the calling thread, a thread that may migrate between nodes gets the node it is on right now
+	int32_t current_node() const noexcept
+	{
+		int32_t count = node_count();
+		int32_t pinned = thread_node();
+		if (pinned >= 0)
+		{
+			return pinned % count;
+		}
+
+		if (simulated())
+		{
+			return static_cast<int32_t>(wait_free_thread_index() % count);
+		}
+
+#if defined(__linux__)
+		int cpu = ::sched_getcpu();
+		if (cpu >= 0 && cpu < static_cast<int>(this->m_cpu_node.size()))
+		{
+			return this->m_cpu_node[cpu];
+		}
+#endif
+
+		return 0;
+	}
+
+	//for threads pinned by the caller, skips the cpu lookup and fixes the node in simulated runs, -1 clears it
+	static void set_thread_node(int32_t node) noexcept
+	{
+		thread_node() = node;
+	}
+
+private:
+	int32_t					m_node_count;
+	std::vector<int32_t>	m_cpu_node;
+	std::atomic<int32_t>	m_simulated_nodes;
+
+	wait_free_numa_topology() :
+		m_node_count(1),
+		m_simulated_nodes(0)
+	{
+#if defined(__linux__)
+		for (int32_t node = 0; ; node++)
+		{
+			std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string cpulist;
+			if (!std::getline(in, cpulist))
+			{
+				this->m_node_count = (std::max)(node, 1);
+				break;
+			}
+
+			//ranges like 0-7,16-23
+			size_t pos(0);
+			while (pos < cpulist.size())
+			{
+				size_t end = cpulist.find(',', pos);
+				std::string range = cpulist.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+				size_t dash = range.find('-');
+				int32_t first = std::atoi(range.c_str());
+				int32_t last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+
+				if (last >= static_cast<int32_t>(this->m_cpu_node.size()))
+				{
+					this->m_cpu_node.resize(last + 1, 0);
+				}
+				for (int32_t cpu = first; cpu <= last; cpu++)
+				{
+					this->m_cpu_node[cpu] = node;
+				}
+
+				pos = end == std::string::npos ? cpulist.size() : end + 1;
+			}
+		}
+#endif
+
+		const char* nodes = ::getenv("WAIT_FREE_NUMA_NODES");
+		if (nodes != nullptr)
+		{
+			simulate(std::atoi(nodes));
+		}
+	}
+
+	static int32_t& thread_node() noexcept
+	{
+		static thread_local int32_t ret = -1;
+		return ret;
+	}
+};
+
+//TAllocator that maps its storage with an mbind policy for one node, before any page is touched
+//the default node is the one the allocating thread runs on, so a container constructed there stays there when it grows
+//with a simulated topology, or when binding fails, the storage is ordinary first touch memory
+template<typename T>
+class wait_free_numa_allocator
+{
+	template<typename U>
+	friend class wait_free_numa_allocator;
+
+public:
+	using value_type = T;
+
+	wait_free_numa_allocator() noexcept = default;
+
+	explicit wait_free_numa_allocator(int32_t node) noexcept :
+		m_node(node)
+	{
+	}
+
+	template<typename U>
+	wait_free_numa_allocator(const wait_free_numa_allocator<U>& rhd) noexcept :
+		m_node(rhd.m_node)
+	{
+	}
+
+	//-1 for the node of the allocating thread
+	int32_t node() const noexcept
+	{
+		return this->m_node;
+	}
+
+	T* allocate(size_t n)
+	{
+#if defined(__linux__)
+		size_t length = mapping_length(n);
+		void* data = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
+		{
+			throw std::bad_alloc();
+		}
+
+		wait_free_numa_topology& topology = wait_free_numa_topology::instance();
+		if (!topology.simulated())
+		{
+			int32_t node = this->m_node >= 0 ? this->m_node : topology.current_node();
+
+			//MPOL_BIND, <numaif.h> ships with libnuma so the constants are spelled out
+			const int mpol_bind = 2;
+			unsigned long mask[16] = {};
+			if (node < static_cast<int32_t>(sizeof(mask) * 8))
+			{
+				mask[node / (sizeof(unsigned long) * 8)] = 1ul << (node % (sizeof(unsigned long) * 8));
+				::syscall(SYS_mbind, data, length, mpol_bind, mask, sizeof(mask) * 8 + 1, 0);
+			}
+		}
+
+		return static_cast<T*>(data);
+#else
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+#endif
+	}
+
+	void deallocate(T* data, size_t n) noexcept
+	{
+		if (data == nullptr)
+		{
+			return;
+		}
+
+#if defined(__linux__)
+		::munmap(data, mapping_length(n));
+#else
+		(void)n;
+		::operator delete(data);
+#endif
+	}
+
+	template<typename U>
+	bool operator==(const wait_free_numa_allocator<U>& rhd) const noexcept
+	{
+		return this->m_node == rhd.m_node;
+	}
+
+	template<typename U>
+	bool operator!=(const wait_free_numa_allocator<U>& rhd) const noexcept
+	{
+		return !(*this == rhd);
+	}
+
+private:
+	int32_t		m_node{ -1 };
+
+	static size_t mapping_length(size_t n) noexcept
+	{
+		size_t page = wait_free_page_size();
+		size_t bytes = (std::max)(n * sizeof(T), static_cast<size_t>(1));
+
+		return (bytes + page - 1) / page * page;
+	}
+};
+
+//one memory pool per node, allocate() serves from the caller's node and deallocate() returns to the owning pool
+//elements never move between nodes, an iterator stays valid whichever thread releases it
+template<typename T>
+class wait_free_numa_pool
+{
+public:
+	using pool_type = wait_free_memory_pool<T, wait_free_numa_allocator>;
+	using iterator = typename pool_type::iterator;
+
+	explicit wait_free_numa_pool(int64_t capacity_per_node = 10)
+	{
+		int32_t count = wait_free_numa_topology::instance().node_count();
+		for (int32_t node = 0; node < count; node++)
+		{
+			this->m_pools.emplace_back(std::make_unique<pool_type>(capacity_per_node, wait_free_numa_allocator<T>(node)));
+		}
+	}
+
+	iterator allocate()
+	{
+		return this->m_pools[local_node()]->allocate();
+	}
+
+	bool deallocate(const iterator& it) noexcept
+	{
+		int32_t node = node_of(it);
+		return node != -1 && this->m_pools[node]->deallocate(it);
+	}
+
+	//-1 when it belongs to none of the pools
+	int32_t node_of(const iterator& it) const noexcept
+	{
+		for (size_t i = 0; i < this->m_pools.size(); i++)
+		{
+			if (it.pool() == this->m_pools[i].get())
+			{
+				return static_cast<int32_t>(i);
+			}
+		}
+
+		return -1;
+	}
+
+	pool_type& node_pool(int32_t node) noexcept
+	{
+		return *this->m_pools[node];
+	}
+
+	int32_t node_count() const noexcept
+	{
+		return static_cast<int32_t>(this->m_pools.size());
+	}
+
+	size_t elem_count() const noexcept
+	{
+		size_t ret(0);
+		for (auto& pool : this->m_pools)
+		{
+			ret += pool->elem_count();
+		}
+
+		return ret;
+	}
+
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret;
+		for (auto& pool : this->m_pools)
+		{
+			ret += pool->memory_usage();
+		}
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret;
+		for (auto& pool : this->m_pools)
+		{
+			ret += pool->stats();
+		}
+
+		return ret;
+	}
+
+private:
+	std::vector<std::unique_ptr<pool_type>>		m_pools;
+
+	//the topology may be simulated with more nodes after construction
+	int32_t local_node() const noexcept
+	{
+		return wait_free_numa_topology::instance().current_node() % static_cast<int32_t>(this->m_pools.size());
+	}
+};
+
+//one queue shard per node, enqueue() goes to the caller's shard and dequeue() drains the local shard before stealing
+//from the others, nearest first in node order
+//order is fifo per shard only, an element enqueued on another node may be overtaken by later local ones
+template<typename T>
+class wait_free_numa_queue
+{
+public:
+	using shard_type = wait_free_queue<T, wait_free_numa_allocator>;
+
+	explicit wait_free_numa_queue(const T& free_value, int64_t capacity_per_node = 10)
+	{
+		int32_t count = wait_free_numa_topology::instance().node_count();
+		for (int32_t node = 0; node < count; node++)
+		{
+			this->m_shards.emplace_back(std::make_unique<shard_type>(free_value, capacity_per_node, wait_free_numa_allocator<wait_free_atomic<T>>(node)));
+		}
+	}
+
+	int64_t enqueue(const T& value)
+	{
+		return this->m_shards[local_node()]->enqueue(value);
+	}
+
+	//-1 when every shard is empty
+	int64_t dequeue(T& elem)
+	{
+		int32_t count = static_cast<int32_t>(this->m_shards.size());
+		int32_t local = local_node();
+		for (int32_t i = 0; i < count; i++)
+		{
+			int64_t ret = this->m_shards[(local + i) % count]->dequeue(elem);
+			if (ret != -1)
+			{
+				if (i != 0)
+				{
+					this->m_remote_dequeues.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				return ret;
+			}
+		}
+
+		return -1;
+	}
+
+	size_t size() const noexcept
+	{
+		size_t ret(0);
+		for (auto& shard : this->m_shards)
+		{
+			ret += shard->size();
+		}
+
+		return ret;
+	}
+
+	shard_type& shard(int32_t node) noexcept
+	{
+		return *this->m_shards[node];
+	}
+
+	int32_t node_count() const noexcept
+	{
+		return static_cast<int32_t>(this->m_shards.size());
+	}
+
+	//dequeues served by another node's shard, how often consumers ran dry locally
+	int64_t remote_dequeues() const noexcept
+	{
+		return this->m_remote_dequeues.load(std::memory_order_relaxed);
+	}
+
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret;
+		for (auto& shard : this->m_shards)
+		{
+			ret += shard->memory_usage();
+		}
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret;
+		for (auto& shard : this->m_shards)
+		{
+			ret += shard->stats();
+		}
+
+		return ret;
+	}
+
+private:
+	std::vector<std::unique_ptr<shard_type>>	m_shards;
+	std::atomic<int64_t>						m_remote_dequeues{ 0 };
+
+	int32_t local_node() const noexcept
+	{
+		return wait_free_numa_topology::instance().current_node() % static_cast<int32_t>(this->m_shards.size());
+	}
+};
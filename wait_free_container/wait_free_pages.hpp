@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+//page level control for reserve(), so growth and first touch faults happen at startup instead of on the hot path
+//populate		fault every page in when it is allocated
+//huge_pages	transparent asks the kernel for transparent huge pages (madvise), hugetlb maps explicit huge pages
+//				and falls back to transparent ones when none are available
+//lock			mlock the storage so it is never paged out, needs RLIMIT_MEMLOCK / SeLockMemoryPrivilege
+//				only wait_free_page_allocator storage is locked, its pages are unlocked with the mapping
+enum class wait_free_huge_pages : int32_t
+{
+	none = 0,
+	transparent,
+	hugetlb
+};
+
+struct wait_free_reserve_options
+{
+	bool					populate{ true };
+	wait_free_huge_pages	huge_pages{ wait_free_huge_pages::none };
+	bool					lock{ false };
+};
+
+static constexpr size_t WAIT_FREE_HUGE_PAGE_SIZE = static_cast<size_t>(2) << 20;
+
+inline size_t wait_free_page_size() noexcept
+{
+#if defined(__linux__)
+	static const size_t ret = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+	return ret;
+#else
+	return 4096;
+#endif
+}
+
+//applies options to storage that is already allocated, for allocators that know nothing about pages
+//huge pages only take effect on the aligned 2MB runs inside the range, touched pages are collapsed later by khugepaged
+//existing contents are kept, false when a requested lock failed
+//a lock stays until the range is unmapped or munlocked, containers lock through wait_free_prepare_storage only
+inline bool wait_free_prepare_pages(void* data, size_t bytes, const wait_free_reserve_options& options) noexcept
+{
+	if (data == nullptr || bytes == 0)
+	{
+		return true;
+	}
+
+	bool ret(true);
+
+#if defined(__linux__)
+	uintptr_t page = wait_free_page_size();
+	uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+	size_t length = reinterpret_cast<uintptr_t>(data) + bytes - begin;
+
+#if defined(MADV_HUGEPAGE)
+	if (options.huge_pages != wait_free_huge_pages::none)
+	{
+		::madvise(reinterpret_cast<void*>(begin), length, MADV_HUGEPAGE);
+	}
+#endif
+
+	if (options.populate)
+	{
+#if defined(MADV_POPULATE_WRITE)
+		if (::madvise(reinterpret_cast<void*>(begin), length, MADV_POPULATE_WRITE) != 0)
+#endif
+		{
+			//older kernels, rewrite one byte per page to fault it in writable
+			volatile char* bytes_begin = static_cast<volatile char*>(data);
+			for (size_t i = 0; i < bytes; i += page)
+			{
+				bytes_begin[i] = bytes_begin[i];
+			}
+		}
+	}
+
+	if (options.lock)
+	{
+		ret = ::mlock(reinterpret_cast<void*>(begin), length) == 0;
+	}
+#elif defined(_WIN32)
+	if (options.populate)
+	{
+		volatile char* bytes_begin = static_cast<volatile char*>(data);
+		for (size_t i = 0; i < bytes; i += wait_free_page_size())
+		{
+			bytes_begin[i] = bytes_begin[i];
+		}
+	}
+
+	if (options.lock)
+	{
+		ret = ::VirtualLock(data, bytes) != 0;
+	}
+#else
+	(void)options;
+#endif
+
+	return ret;
+}
+
+//TAllocator that maps every allocation straight from the os with the reserve options
+//allocations of 2MB and more are rounded to whole huge pages, so a mapping always has the same size whatever options it got
+template<typename T>
+class wait_free_page_allocator
+{
+	template<typename U>
+	friend class wait_free_page_allocator;
+
+public:
+	using value_type = T;
+
+	wait_free_page_allocator() noexcept = default;
+
+	explicit wait_free_page_allocator(const wait_free_reserve_options& options) noexcept :
+		m_options(options)
+	{
+	}
+
+	template<typename U>
+	wait_free_page_allocator(const wait_free_page_allocator<U>& rhd) noexcept :
+		m_options(rhd.m_options)
+	{
+	}
+
+	//applies to the next allocations only
+	void set_options(const wait_free_reserve_options& options) noexcept
+	{
+		this->m_options = options;
+	}
+
+	const wait_free_reserve_options& options() const noexcept
+	{
+		return this->m_options;
+	}
+
+	T* allocate(size_t n)
+	{
+		size_t length = mapping_length(n);
+
+#if defined(__linux__)
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+		bool transparent = this->m_options.huge_pages != wait_free_huge_pages::none;
+		void* data = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+		if (this->m_options.huge_pages == wait_free_huge_pages::hugetlb && length % WAIT_FREE_HUGE_PAGE_SIZE == 0)
+		{
+			data = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB | (this->m_options.populate ? MAP_POPULATE : 0), -1, 0);
+			transparent = data == MAP_FAILED;
+		}
+#endif
+
+		if (data == MAP_FAILED)
+		{
+			//transparent huge pages have to be asked for before the first fault, so populate after madvise
+			data = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags | (this->m_options.populate && !transparent ? MAP_POPULATE : 0), -1, 0);
+			if (data == MAP_FAILED)
+			{
+				throw std::bad_alloc();
+			}
+
+			if (transparent)
+			{
+				wait_free_prepare_pages(data, length, { this->m_options.populate, wait_free_huge_pages::transparent, false });
+			}
+		}
+
+		if (this->m_options.lock)
+		{
+			::mlock(data, length);
+		}
+
+		return static_cast<T*>(data);
+#elif defined(_WIN32)
+		void* data(nullptr);
+		if (this->m_options.huge_pages == wait_free_huge_pages::hugetlb && length % WAIT_FREE_HUGE_PAGE_SIZE == 0)
+		{
+			data = ::VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		}
+
+		if (data == nullptr)
+		{
+			data = ::VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (data == nullptr)
+			{
+				throw std::bad_alloc();
+			}
+
+			wait_free_prepare_pages(data, length, { this->m_options.populate, wait_free_huge_pages::none, false });
+		}
+
+		if (this->m_options.lock)
+		{
+			::VirtualLock(data, length);
+		}
+
+		return static_cast<T*>(data);
+#else
+		return static_cast<T*>(::operator new(length));
+#endif
+	}
+
+	void deallocate(T* data, size_t n) noexcept
+	{
+		if (data == nullptr)
+		{
+			return;
+		}
+
+#if defined(__linux__)
+		::munmap(data, mapping_length(n));
+#elif defined(_WIN32)
+		(void)n;
+		::VirtualFree(data, 0, MEM_RELEASE);
+#else
+		(void)n;
+		::operator delete(data);
+#endif
+	}
+
+	template<typename U>
+	bool operator==(const wait_free_page_allocator<U>&) const noexcept
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const wait_free_page_allocator<U>&) const noexcept
+	{
+		return false;
+	}
+
+private:
+	wait_free_reserve_options	m_options;
+
+	static size_t mapping_length(size_t n) noexcept
+	{
+		size_t bytes = (std::max)(n * sizeof(T), static_cast<size_t>(1));
+		size_t granularity = bytes >= WAIT_FREE_HUGE_PAGE_SIZE ? WAIT_FREE_HUGE_PAGE_SIZE : wait_free_page_size();
+
+		return (bytes + granularity - 1) / granularity * granularity;
+	}
+};
+
+//reserve() hands its options to allocators that map pages themselves, any other allocator ignores them
+template<typename TAllocator>
+void wait_free_set_reserve_options(TAllocator&, const wait_free_reserve_options&) noexcept
+{
+}
+
+template<typename T>
+void wait_free_set_reserve_options(wait_free_page_allocator<T>& allocator, const wait_free_reserve_options& options) noexcept
+{
+	allocator.set_options(options);
+}
+
+//reserve() prepares its storage here, heap storage shares pages with other allocations and would stay locked after
+//it is freed, so only wait_free_page_allocator mappings are locked, a lock asked of any other allocator fails
+template<typename TAllocator>
+bool wait_free_prepare_storage(const TAllocator&, void* data, size_t bytes, const wait_free_reserve_options& options) noexcept
+{
+	wait_free_reserve_options unlocked(options);
+	unlocked.lock = false;
+	wait_free_prepare_pages(data, bytes, unlocked);
+
+	return !options.lock;
+}
+
+template<typename T>
+bool wait_free_prepare_storage(const wait_free_page_allocator<T>&, void* data, size_t bytes, const wait_free_reserve_options& options) noexcept
+{
+	return wait_free_prepare_pages(data, bytes, options);
+}
@@ -4,16 +4,23 @@
 
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <stdint.h>
 #include <type_traits>
 
 #include "template_util.hpp"
+#include "wait_free_atomic.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_pages.hpp"
 
 template<typename T, template<typename U> typename TAllocator = std::allocator>
-class wait_free_queue
+class wait_free_queue : private wait_free_stats_base
 {
+	static_assert(wait_free_atomic_lock_free_v<T>, "wait_free_queue element is not lock free as an atomic, define WAIT_FREE_ALLOW_LOCKING_ATOMICS=1 to accept a locking slot");
+
 public:
-    explicit wait_free_queue(const T &free_value, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_queue(const T &free_value, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
 		m_data(nullptr),
 		m_allocator(allocator),
 		m_free_value(free_value),
@@ -25,14 +32,15 @@ public:
 		m_dequeuing(0),
 		m_reszing(0),
 		m_stuck_enqueue(0),
-		m_offset(0)
+		m_offset(0),
+		m_growth_count(0)
 	{
 		assert(capacity > 0);
 
 		this->m_data = this->m_allocator.allocate(capacity);
 		assert(m_data);
 		std::for_each(this->m_data, this->m_data + capacity,
-		[=](std::atomic<T> &elem) 
+		[this](wait_free_atomic<T> &elem) 
 		{
 			elem.store(this->m_free_value);
 		});
@@ -43,10 +51,12 @@ public:
 	// to fix... add lock unlock function
 	~wait_free_queue() 
 	{
+		this->m_registration.remove();
+
 		std::for_each(this->m_data, this->m_data + this->m_capacity,
-		[=](std::atomic<T>& elem)
+		[](wait_free_atomic<T>& elem)
 		{
-			elem.~atomic<T>();
+			std::destroy_at(&elem);
 		});
 
 		this->m_allocator.deallocate(this->m_data, this->m_capacity);
@@ -54,11 +64,12 @@ public:
 
 	int64_t enqueue(const T& value) 
 	{
+		wait_free_latency::scope latency_scope(this->m_latency, wait_free_op::enqueue);
+
 		int64_t old_size(0);
 		int64_t new_size(0);
 		int64_t old_count(0);
 		int64_t en_pos(0);
-		T old_value();
 		bool full(false);
 		bool size_failed(false);
 
@@ -66,7 +77,7 @@ public:
 		{
 			do
 			{
-				mutex_check_weak(this->m_enqueuing, this->m_reszing, this->m_stuck_enqueue);
+				mutex_check_weak(this->m_stats, this->m_enqueuing, this->m_reszing, this->m_stuck_enqueue);
 
 				old_size = this->m_size;
 				new_size = (std::min)(old_size + 1, static_cast<int64_t>(this->m_capacity));
@@ -75,30 +86,36 @@ public:
 				{
 					this->m_enqueuing--;
 					std::this_thread::yield();
+					this->m_stats.add(wait_free_stat::yield);
 				}
 			}
 			while (full);
 
-			size_failed = !this->m_size.compare_exchange_strong(old_size, new_size);
+			size_failed = !this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size));
 			if (size_failed)
 			{
 				this->m_enqueuing--;
 				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::yield);
 			}
 		}
 		while (size_failed);
+		this->m_peak_size.update(new_size);
 
 		do
 		{
 			old_count = this->m_enqueue_count;
 			en_pos = (old_count + m_offset) % this->m_capacity;
-		} while (!this->m_enqueue_count.compare_exchange_strong(old_count, old_count + 1));
+		} while (!this->m_stats.count_cas(this->m_enqueue_count.compare_exchange_strong(old_count, old_count + 1)));
 
 		T free_value(m_free_value);
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 		while (!m_data[en_pos].compare_exchange_strong(free_value, value))
 		{	
 			free_value = this->m_free_value;
+			spin.tick();
 			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::spin_wait);
 		} 
 
 		m_enqueuing--;
@@ -130,7 +147,7 @@ public:
 		{
 			do
 			{
-				mutex_check_weak(this->m_enqueuing, this->m_reszing, this->m_stuck_enqueue);
+				mutex_check_weak(this->m_stats, this->m_enqueuing, this->m_reszing, this->m_stuck_enqueue);
 
 				old_size = m_size;
 				new_size = (std::min)(old_size + static_cast<int64_t>(count), static_cast<int64_t>(this->m_capacity));
@@ -139,17 +156,20 @@ public:
 				{
 					this->m_enqueuing--;
 					std::this_thread::yield();
+					this->m_stats.add(wait_free_stat::yield);
 				}
 			} while (full);
 
-			size_failed = !this->m_size.compare_exchange_strong(old_size, new_size);
+			size_failed = !this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size));
 			if (size_failed)
 			{
 				this->m_enqueuing--;
 				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::yield);
 			}
 
 		} while (size_failed);
+		this->m_peak_size.update(new_size);
 
 		if (new_size == this->m_capacity)
 		{
@@ -163,17 +183,20 @@ public:
 			old_count = this->m_enqueue_count;
 			en_pos = (old_count + m_offset) % this->m_capacity;
 		} 
-		while (!this->m_enqueue_count.compare_exchange_strong(old_count, old_count + fill_count));
+		while (!this->m_stats.count_cas(this->m_enqueue_count.compare_exchange_strong(old_count, old_count + fill_count)));
 
 		T free_value(this->m_free_value);
 		for (int64_t i = 0; i < fill_count; i++)
 		{
             T& value = *(it_start + i);
 
+			wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 			while (!this->m_data[en_pos].compare_exchange_strong(free_value, value))
 			{
 				free_value = this->m_free_value;
+				spin.tick();
 				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
 			}
 
 			en_pos = (en_pos + 1) % this->m_capacity;
@@ -197,6 +220,8 @@ public:
 
     int64_t dequeue(T& elem) noexcept
 	{
+		wait_free_latency::scope latency_scope(this->m_latency, wait_free_op::dequeue);
+
 		int64_t old_size(0);
 		int64_t new_size(0);
 		int64_t old_count(0);
@@ -208,33 +233,36 @@ public:
 			return -1;
 		}
 
-		mutex_check_weak(this->m_dequeuing, this->m_reszing);
+		mutex_check_weak(this->m_stats, this->m_dequeuing, this->m_reszing);
 
 		do
 		{
 			old_size = this->m_size;
-			new_size = (std::max)(old_size - 1, 0ll);
+			new_size = (std::max)(old_size - 1, static_cast<int64_t>(0));
 			if (new_size >= old_size)
 			{
 				this->m_dequeuing--;
 				return -1;
 			}
 		} 
-		while (!this->m_size.compare_exchange_strong(old_size, new_size));
+		while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
 		do
 		{
 			old_count = this->m_dequeue_count;
 			de_pos = (old_count + this->m_offset) % this->m_capacity;
 		} 
-		while (!this->m_dequeue_count.compare_exchange_strong(old_count, old_count + 1));
+		while (!this->m_stats.count_cas(this->m_dequeue_count.compare_exchange_strong(old_count, old_count + 1)));
 
+		wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 		while (true)
 		{
 			old_value = this->m_data[de_pos];
 			if (old_value == this->m_free_value)
 			{
+				spin.tick();
 				std::this_thread::yield();
+				this->m_stats.add(wait_free_stat::spin_wait);
 				continue;
 			}
 			else
@@ -265,31 +293,34 @@ public:
             return -1;
         }
 
-        mutex_check_weak(this->m_dequeuing, this->m_reszing);
+        mutex_check_weak(this->m_stats, this->m_dequeuing, this->m_reszing);
 
         do
         {
             old_size = this->m_size;
-            new_size = (std::max)(old_size - 1, 0ll);
+            new_size = (std::max)(old_size - 1, static_cast<int64_t>(0));
             if (new_size >= old_size)
             {
                 this->m_dequeuing--;
                 return -1;
             }
-        } while (!this->m_size.compare_exchange_strong(old_size, new_size));
+        } while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
         do
         {
             old_count = this->m_dequeue_count;
             de_pos = (old_count + this->m_offset) % this->m_capacity;
-        } while (!this->m_dequeue_count.compare_exchange_strong(old_count, old_count + 1));
+        } while (!this->m_stats.count_cas(this->m_dequeue_count.compare_exchange_strong(old_count, old_count + 1)));
 
+        wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
         while (true)
         {
             old_value = this->m_data[de_pos];
             if (old_value == this->m_free_value)
             {
+                spin.tick();
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::spin_wait);
                 continue;
             }
             else
@@ -321,19 +352,19 @@ public:
 			return -1;
 		}
 
-		mutex_check_weak(this->m_dequeuing, this->m_reszing);
+		mutex_check_weak(this->m_stats, this->m_dequeuing, this->m_reszing);
 
 		do
 		{
 			old_size = this->m_size;
-			new_size = (std::max)(old_size - count, 0ll);
+			new_size = (std::max)(old_size - count, static_cast<int64_t>(0));
 			if (new_size >= old_size)
 			{
 				this->m_dequeuing--;
 				return -1;
 			}
 		}
-        while (!this->m_size.compare_exchange_strong(old_size, new_size));
+        while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
 		count = old_size - new_size;
 
@@ -342,16 +373,19 @@ public:
 			old_count = this->m_dequeue_count;
 			de_pos = (old_count + this->m_offset) % this->m_capacity;
 		}
-		while (!this->m_dequeue_count.compare_exchange_strong(old_count, old_count + count));
+		while (!this->m_stats.count_cas(this->m_dequeue_count.compare_exchange_strong(old_count, old_count + count)));
 
 		for (int64_t i = 0; i < count; i++, start_it++)
 		{
+			wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
 			while (true)
 			{
 				old_value = this->m_data[de_pos];
 				if (old_value == this->m_free_value)
 				{
+					spin.tick();
 					std::this_thread::yield();
+					this->m_stats.add(wait_free_stat::spin_wait);
 					continue;
 				}
 				else
@@ -385,18 +419,18 @@ public:
             return -1;
         }
 
-        mutex_check_weak(this->m_dequeuing, this->m_reszing);
+        mutex_check_weak(this->m_stats, this->m_dequeuing, this->m_reszing);
 
         do
         {
             old_size = this->m_size;
-            new_size = (std::max)(old_size - count, 0ll);
+            new_size = (std::max)(old_size - count, static_cast<int64_t>(0));
             if (new_size >= old_size)
             {
                 this->m_dequeuing--;
                 return -1;
             }
-        } while (!this->m_size.compare_exchange_strong(old_size, new_size));
+        } while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
         count = old_size - new_size;
 
@@ -404,16 +438,19 @@ public:
         {
             old_count = this->m_dequeue_count;
             de_pos = (old_count + this->m_offset) % this->m_capacity;
-        } while (!this->m_dequeue_count.compare_exchange_strong(old_count, old_count + count));
+        } while (!this->m_stats.count_cas(this->m_dequeue_count.compare_exchange_strong(old_count, old_count + count)));
 
         for (int64_t i = 0; i < count; i++)
         {
+            wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
             while (true)
             {
                 old_value = this->m_data[de_pos];
                 if (old_value == this->m_free_value)
                 {
+                    spin.tick();
                     std::this_thread::yield();
+                    this->m_stats.add(wait_free_stat::spin_wait);
                     continue;
                 }
                 else
@@ -443,9 +480,51 @@ public:
 		return this->m_capacity;
 	}
 
+	//grows to capacity and prepares the pages up front, so neither a resize nor first touch faults land on the hot path
+	//meant for startup, before other threads use the queue, false when a requested lock failed
+	bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+	{
+		wait_free_set_reserve_options(this->m_allocator, options);
+		if (capacity > this->m_capacity)
+		{
+			resize(capacity);
+		}
+
+		return wait_free_prepare_storage(this->m_allocator, this->m_data, this->m_capacity * sizeof(wait_free_atomic<T>), options);
+	}
+
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		const int64_t slot_size = static_cast<int64_t>(sizeof(wait_free_atomic<T>));
+
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_capacity * slot_size;
+		ret.live_bytes = this->m_size * slot_size;
+		ret.peak_live_bytes = this->m_peak_size.get() * slot_size;
+		ret.growth_count = this->m_growth_count;
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+	//merge of every thread's samples for op, summary() gives p50/p99/p999/max in ns
+	wait_free_latency_histogram latency(wait_free_op op) const
+	{
+		return this->m_latency.histogram(op);
+	}
+
+	void set_latency_sample_rate(int64_t every_n) noexcept
+	{
+		this->m_latency.set_sample_rate(every_n);
+	}
+
 private:
-	std::atomic<T>*					m_data;
-	TAllocator<std::atomic<T>>		m_allocator;
+	wait_free_atomic<T>*					m_data;
+	TAllocator<wait_free_atomic<T>>		m_allocator;
 	const T							m_free_value;
 	std::atomic<int64_t>			m_enqueue_count;
 	std::atomic<int64_t>			m_dequeue_count;
@@ -457,27 +536,35 @@ private:
     mutable std::atomic<int64_t>	m_reszing;
     mutable std::atomic<int64_t>	m_stuck_enqueue;
 	std::atomic<int64_t>			m_offset;
+	std::atomic<int64_t>			m_growth_count;
+	wait_free_latency				m_latency;
+	wait_free_high_water			m_peak_size;
+	wait_free_registration			m_registration{ this, "wait_free_queue" };
 
 	int64_t resize(int64_t new_capacity) 
 	{
 		//󣬳ԪأԪأᵼresizeظãֻһ߳resize
-		int64_t old_value = mutex_check_strong(this->m_reszing, this->m_enqueuing, this->m_dequeuing);
+		int64_t old_value = mutex_check_strong(this->m_stats, this->m_reszing, this->m_enqueuing, this->m_dequeuing);
 		if (old_value != 0)
 		{
 			this->m_reszing--;
 			return 0;
 		}
 
-		std::atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
+		wait_free_stats::stall_timer stall_timer(this->m_stats);
+		wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+		this->m_stats.add(wait_free_stat::resize);
+		this->m_growth_count++;
+
+		wait_free_atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
 		assert(new_data);
 		std::for_each(new_data, new_data + new_capacity, 
-		[=](std::atomic<T> &elem) 
+		[this](wait_free_atomic<T> &elem) 
 		{
 			elem.store(this->m_free_value);
 		});
 
 		int64_t head_pos((this->m_dequeue_count + this->m_offset) % this->m_capacity);
-		int64_t tail_pos((this->m_enqueue_count + this->m_offset) % this->m_capacity);
 
 		for (int64_t i = 0; i < this->m_size; i++)
 		{
@@ -485,7 +572,7 @@ private:
 			head_pos = (head_pos + 1) % this->m_capacity;
 		}
 
-		assert(head_pos == tail_pos);
+		assert(head_pos == (this->m_enqueue_count + this->m_offset) % this->m_capacity);
 
 		this->m_allocator.deallocate(this->m_data, this->m_capacity);
 		this->m_data = new_data;
@@ -501,30 +588,34 @@ private:
 	int64_t resize(int64_t new_capacity, TIterator start_it, const TIterator &end_it)
 	{
 		//󣬳ԪأԪأᵼresizeظãֻһ߳resize
-		int64_t old_value = mutex_check_strong(this->m_reszing, this->m_enqueuing, this->m_dequeuing);
+		int64_t old_value = mutex_check_strong(this->m_stats, this->m_reszing, this->m_enqueuing, this->m_dequeuing);
 		if (old_value != 0)
 		{
 			this->m_reszing--;
 			return 0;
 		}
 
-		std::atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
+		wait_free_stats::stall_timer stall_timer(this->m_stats);
+		wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+		this->m_stats.add(wait_free_stat::resize);
+		this->m_growth_count++;
+
+		wait_free_atomic<T>* new_data = this->m_allocator.allocate(new_capacity);
 		assert(new_data);
 		std::for_each(new_data, new_data + new_capacity,
-		[=](std::atomic<T>& elem)
+		[this](wait_free_atomic<T>& elem)
 		{
 			elem.store(this->m_free_value);
 		});
 
 		int64_t head_pos((this->m_dequeue_count + this->m_offset) % this->m_capacity);
-		int64_t tail_pos((this->m_enqueue_count + this->m_offset) % this->m_capacity);
 
 		for (int64_t i = 0; i < this->m_size; i++)
 		{
 			new_data[i].store(this->m_data[head_pos]);
 			head_pos = (head_pos + 1) % this->m_capacity;
 		}
-		assert(head_pos == tail_pos);
+		assert(head_pos == (this->m_enqueue_count + this->m_offset) % this->m_capacity);
 		this->m_offset = new_capacity - (this->m_dequeue_count % new_capacity);
 
 		int64_t en_pos(0);
@@ -552,12 +643,14 @@ private:
 		while (this->m_stuck_enqueue.exchange(1))
 		{
 			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::yield);
 		}
 
 		this->m_enqueuing--;
 		while (this->m_enqueuing)
 		{
 			std::this_thread::yield();
+			this->m_stats.add(wait_free_stat::yield);
 		}
 	}
 };
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "wait_free_memory.hpp"
+#include "wait_free_stats.hpp"
+
+//mpmc ring of variable size binary records, written and read in place
+//a producer reserves a record, fills it and commits it; reservations may be committed in any order but a consumer only
+//gets past a record once it is committed, so order is the reservation order
+//a consumer claims records one by one, reads them where they lie and releases them, one at a time or in batches,
+//their bytes go back to producers once every record before them is released as well
+//a record never wraps: when it doesn't fit before the end of the ring the rest of the lap is claimed as padding
+//the ring can sit in memory it doesn't own, an mmap'd file or a shared memory region: everything in it is addressed by
+//position, and a zero filled region is an empty ring; a process dying with a record reserved or claimed stalls the ring
+class wait_free_record_ring_layout
+{
+protected:
+	static constexpr int64_t ALIGNMENT = 16;
+
+	struct ring_header
+	{
+		alignas(64) std::atomic<int64_t>	reserve_pos;
+		alignas(64) std::atomic<int64_t>	read_pos;
+		alignas(64) std::atomic<int64_t>	release_pos;
+	};
+
+	//sequence is position + 1 once committed and -(position + 1) once released, anything else means not committed yet
+	struct record_header
+	{
+		std::atomic<int64_t>	sequence;
+		std::atomic<int32_t>	size;
+		std::atomic<int32_t>	padding;
+	};
+
+	static_assert(sizeof(record_header) == ALIGNMENT, "record header has to keep payloads aligned");
+	static_assert(std::atomic<int64_t>::is_always_lock_free, "wait_free_record_ring needs address free 64 bit atomics");
+
+	static constexpr int64_t data_offset() noexcept
+	{
+		return (static_cast<int64_t>(sizeof(ring_header)) + 63) / 64 * 64;
+	}
+};
+
+template<template<typename U> typename TAllocator = std::allocator>
+class wait_free_record_ring : private wait_free_record_ring_layout, private wait_free_stats_base
+{
+public:
+	struct reservation
+	{
+		void*			data{ nullptr };
+		int64_t			size{ 0 };
+		int64_t			position{ -1 };
+	};
+
+	struct record
+	{
+		const void*		data{ nullptr };
+		int64_t			size{ 0 };
+		int64_t			position{ -1 };
+	};
+
+	//bytes a region must have to hold a ring of capacity bytes, capacity being a power of two
+	static constexpr int64_t region_size(int64_t capacity) noexcept
+	{
+		return data_offset() + capacity;
+	}
+
+	//owns its storage, capacity is rounded up to a power of two
+	explicit wait_free_record_ring(int64_t capacity, const TAllocator<uint8_t>& allocator = TAllocator<uint8_t>()) :
+		m_region(nullptr),
+		m_header(nullptr),
+		m_data(nullptr),
+		m_allocator(allocator),
+		m_allocated(0),
+		m_capacity(0),
+		m_mask(0)
+	{
+		assert(capacity >= ALIGNMENT);
+
+		int64_t pow2_capacity(ALIGNMENT);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		//one extra line to align the header whatever the allocator returns
+		this->m_allocated = region_size(pow2_capacity) + 64;
+		this->m_region = this->m_allocator.allocate(this->m_allocated);
+		assert(this->m_region);
+		memset(this->m_region, 0, this->m_allocated);
+
+		uintptr_t address = reinterpret_cast<uintptr_t>(this->m_region);
+		attach(this->m_region + (((address + 63) & ~static_cast<uintptr_t>(63)) - address), pow2_capacity);
+		this->m_registration.add();
+	}
+
+	//uses region_bytes of memory at region, 64 byte aligned, a fresh ring must be zero filled
+	//the capacity is the largest power of two that fits, so every process mapping the same size sees the same ring
+	wait_free_record_ring(void* region, int64_t region_bytes) :
+		m_region(nullptr),
+		m_header(nullptr),
+		m_data(nullptr),
+		m_allocator(),
+		m_allocated(0),
+		m_capacity(0),
+		m_mask(0)
+	{
+		assert(region && (reinterpret_cast<uintptr_t>(region) & 63) == 0);
+		assert(region_bytes >= region_size(ALIGNMENT));
+
+		int64_t pow2_capacity(ALIGNMENT);
+		while (region_size(pow2_capacity * 2) <= region_bytes)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		attach(static_cast<uint8_t*>(region), pow2_capacity);
+		this->m_registration.add();
+	}
+
+	~wait_free_record_ring()
+	{
+		this->m_registration.remove();
+
+		if (this->m_region != nullptr)
+		{
+			this->m_allocator.deallocate(this->m_region, this->m_allocated);
+		}
+	}
+
+	wait_free_record_ring(const wait_free_record_ring&) = delete;
+	wait_free_record_ring& operator=(const wait_free_record_ring&) = delete;
+
+	//false when the free space can't take size bytes right now or ever
+	bool reserve(int64_t size, reservation& res) noexcept
+	{
+		assert(size >= 0);
+
+		//padding is smaller than the record it makes room for, so both sizes fit the 32 bit header field
+		int64_t bytes = record_size(size);
+		if (bytes > this->m_capacity || size > INT32_MAX - 2 * ALIGNMENT)
+		{
+			return false;
+		}
+
+		int64_t pos = this->m_header->reserve_pos.load(std::memory_order_relaxed);
+		int64_t padding(0);
+		bool advanced(false);
+		while (true)
+		{
+			int64_t offset = pos & this->m_mask;
+			padding = offset + bytes > this->m_capacity ? this->m_capacity - offset : 0;
+
+			if (pos + padding + bytes - this->m_header->release_pos.load(std::memory_order_acquire) > this->m_capacity)
+			{
+				//a release racing the last advance may have left release_pos behind, move it before calling the ring full
+				if (advanced)
+				{
+					return false;
+				}
+
+				advance();
+				advanced = true;
+				pos = this->m_header->reserve_pos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (this->m_stats.count_cas(this->m_header->reserve_pos.compare_exchange_weak(pos, pos + padding + bytes, std::memory_order_acq_rel)))
+			{
+				break;
+			}
+		}
+
+		if (padding != 0)
+		{
+			record_header& pad = header_at(pos);
+			pad.size.store(static_cast<int32_t>(padding - static_cast<int64_t>(sizeof(record_header))), std::memory_order_relaxed);
+			pad.padding.store(1, std::memory_order_relaxed);
+			pad.sequence.store(pos + 1, std::memory_order_release);
+			pos += padding;
+		}
+
+		//advance() zeroed the bytes before handing them back, so the header reads as not committed from the moment
+		//reserve_pos covers it, whatever payload an earlier lap left there
+		record_header& header = header_at(pos);
+		header.size.store(static_cast<int32_t>(size), std::memory_order_relaxed);
+		header.padding.store(0, std::memory_order_relaxed);
+
+		res.data = &header + 1;
+		res.size = size;
+		res.position = pos;
+
+		return true;
+	}
+
+	void commit(const reservation& res) noexcept
+	{
+		assert(res.position >= 0);
+		header_at(res.position).sequence.store(res.position + 1, std::memory_order_release);
+	}
+
+	//reserve, copy and commit in one go
+	bool write(const void* data, int64_t size) noexcept
+	{
+		reservation res;
+		if (!reserve(size, res))
+		{
+			return false;
+		}
+
+		memcpy(res.data, data, size);
+		commit(res);
+
+		return true;
+	}
+
+	//claims the oldest record, false when there is none or it is not committed yet
+	bool read(record& rec) noexcept
+	{
+		int64_t pos = this->m_header->read_pos.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (pos == this->m_header->reserve_pos.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+
+			record_header& header = header_at(pos);
+			if (header.sequence.load(std::memory_order_acquire) != pos + 1)
+			{
+				//either not committed, or claimed by another consumer and already recycled, reload to tell which
+				int64_t current = this->m_header->read_pos.load(std::memory_order_acquire);
+				if (current == pos)
+				{
+					return false;
+				}
+
+				pos = current;
+				continue;
+			}
+
+			int64_t size = header.size.load(std::memory_order_relaxed);
+			bool padding = header.padding.load(std::memory_order_relaxed) != 0;
+			int64_t next = pos + record_size(size);
+
+			if (!this->m_stats.count_cas(this->m_header->read_pos.compare_exchange_weak(pos, next, std::memory_order_acq_rel)))
+			{
+				continue;
+			}
+
+			if (padding)
+			{
+				header.sequence.store(-(pos + 1), std::memory_order_seq_cst);
+				advance();
+				pos = next;
+				continue;
+			}
+
+			rec.data = &header + 1;
+			rec.size = size;
+			rec.position = pos;
+
+			return true;
+		}
+	}
+
+	//the record's bytes may be reused once every record before it is released too
+	void release(const record& rec) noexcept
+	{
+		release(&rec, 1);
+	}
+
+	void release(const record* recs, int64_t count) noexcept
+	{
+		//seq_cst against advance's loads: either this thread's advance sees release_pos reach the record or the thread
+		//that moved it there sees the mark, release_pos can't be left behind by both
+		for (int64_t i = 0; i < count; i++)
+		{
+			assert(recs[i].position >= 0);
+			header_at(recs[i].position).sequence.store(-(recs[i].position + 1), std::memory_order_seq_cst);
+		}
+
+		advance();
+	}
+
+	//bytes between the oldest unreleased record and the newest reservation, padding included
+	size_t size() const noexcept
+	{
+		int64_t release_pos = this->m_header->release_pos.load(std::memory_order_acquire);
+		int64_t reserve_pos = this->m_header->reserve_pos.load(std::memory_order_acquire);
+
+		return static_cast<size_t>(reserve_pos > release_pos ? reserve_pos - release_pos : 0);
+	}
+
+	bool empty() const noexcept
+	{
+		return this->m_header->read_pos.load(std::memory_order_acquire) == this->m_header->reserve_pos.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const noexcept
+	{
+		return static_cast<size_t>(this->m_capacity);
+	}
+
+	//an attached region is reported too, it is this ring's memory whoever mapped it
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = region_size(this->m_capacity);
+		ret.live_bytes = static_cast<int64_t>(size());
+		ret.peak_live_bytes = (std::min)(this->m_header->reserve_pos.load(std::memory_order_acquire), this->m_capacity);
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		return this->m_stats.snapshot();
+	}
+
+private:
+	uint8_t*							m_region;
+	ring_header*						m_header;
+	uint8_t*							m_data;
+	TAllocator<uint8_t>					m_allocator;
+	int64_t								m_allocated;
+	int64_t								m_capacity;
+	int64_t								m_mask;
+	wait_free_registration				m_registration{ this, "wait_free_record_ring", false };
+
+	void attach(uint8_t* base, int64_t capacity) noexcept
+	{
+		this->m_header = reinterpret_cast<ring_header*>(base);
+		this->m_data = base + data_offset();
+		this->m_capacity = capacity;
+		this->m_mask = capacity - 1;
+	}
+
+	static int64_t record_size(int64_t size) noexcept
+	{
+		return (static_cast<int64_t>(sizeof(record_header)) + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	record_header& header_at(int64_t pos) const noexcept
+	{
+		return *reinterpret_cast<record_header*>(this->m_data + (pos & this->m_mask));
+	}
+
+	//moves release_pos over every released record at its front, any thread may finish another's batch
+	//the thread taking the released mark off a record zeroes its bytes before moving release_pos over it, so free space
+	//is always zero filled and no later header can be read out of an old payload; only that thread moves release_pos
+	void advance() noexcept
+	{
+		int64_t pos = this->m_header->release_pos.load(std::memory_order_seq_cst);
+		while (pos != this->m_header->read_pos.load(std::memory_order_acquire))
+		{
+			record_header& header = header_at(pos);
+			int64_t released = -(pos + 1);
+			if (!this->m_stats.count_cas(header.sequence.compare_exchange_strong(released, 0, std::memory_order_seq_cst)))
+			{
+				return;
+			}
+
+			int64_t next = pos + record_size(header.size.load(std::memory_order_relaxed));
+			memset(reinterpret_cast<uint8_t*>(&header) + sizeof(record_header), 0, next - pos - sizeof(record_header));
+			header.size.store(0, std::memory_order_relaxed);
+			header.padding.store(0, std::memory_order_relaxed);
+
+			this->m_header->release_pos.store(next, std::memory_order_seq_cst);
+			pos = next;
+		}
+	}
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#include "wait_free_memory.hpp"
+#include "wait_free_stats.hpp"
+
+//fixed array of integer counters for hot spots many threads bump at once, per route request counts and the like
+//every counter is striped over shards, a thread always adds to the shard picked by its thread index,
+//so add() is one relaxed fetch_add on a line no other shard writes to, never a retry
+//load() sums the shards and is exact only while nobody adds; unlike wait_free_buffer_integer there is no free/inserting
+//value, no bounds gate and no growth, the counter count is fixed at construction
+template<typename T = int64_t, template<typename U> typename TAllocator = std::allocator>
+class wait_free_sharded_counter_array
+{
+	static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool>, "wait_free_sharded_counter_array counter must be an integer");
+
+	static constexpr int64_t LINE_SIZE = 64;
+	static constexpr int64_t CELLS_PER_LINE = LINE_SIZE / static_cast<int64_t>(sizeof(std::atomic<T>));
+
+public:
+	//shard_count 0 takes one shard per hardware thread, rounded up to a power of two
+	explicit wait_free_sharded_counter_array(int64_t counter_count, int64_t shard_count = 0, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+		m_cells(nullptr),
+		m_data(nullptr),
+		m_allocator(allocator),
+		m_counter_count(counter_count),
+		m_shard_count(1),
+		m_stride(0),
+		m_allocated(0)
+	{
+		assert(counter_count > 0);
+
+		if (shard_count <= 0)
+		{
+			shard_count = static_cast<int64_t>(std::thread::hardware_concurrency());
+		}
+
+		while (this->m_shard_count < shard_count)
+		{
+			this->m_shard_count <<= 1;
+		}
+
+		//a shard's row starts on its own cache line, the extra line lets the base be aligned whatever the allocator returns
+		this->m_stride = (counter_count + CELLS_PER_LINE - 1) / CELLS_PER_LINE * CELLS_PER_LINE;
+		this->m_allocated = this->m_stride * this->m_shard_count + CELLS_PER_LINE;
+
+		this->m_cells = this->m_allocator.allocate(this->m_allocated);
+		assert(this->m_cells);
+		for (int64_t i = 0; i < this->m_allocated; i++)
+		{
+			new (&this->m_cells[i]) std::atomic<T>(0);
+		}
+
+		uintptr_t address = reinterpret_cast<uintptr_t>(this->m_cells);
+		uintptr_t aligned = (address + LINE_SIZE - 1) & ~static_cast<uintptr_t>(LINE_SIZE - 1);
+		this->m_data = this->m_cells + (aligned - address) / sizeof(std::atomic<T>);
+		this->m_registration.add();
+	}
+
+	~wait_free_sharded_counter_array()
+	{
+		this->m_registration.remove();
+
+		for (int64_t i = 0; i < this->m_allocated; i++)
+		{
+			this->m_cells[i].~atomic<T>();
+		}
+		this->m_allocator.deallocate(this->m_cells, this->m_allocated);
+	}
+
+	wait_free_sharded_counter_array(const wait_free_sharded_counter_array&) = delete;
+	wait_free_sharded_counter_array& operator=(const wait_free_sharded_counter_array&) = delete;
+
+	void add(int64_t index, T operand) noexcept
+	{
+		assert(index >= 0 && index < this->m_counter_count);
+		cell(local_shard(), index).fetch_add(operand, std::memory_order_relaxed);
+	}
+
+	void sub(int64_t index, T operand) noexcept
+	{
+		assert(index >= 0 && index < this->m_counter_count);
+		cell(local_shard(), index).fetch_sub(operand, std::memory_order_relaxed);
+	}
+
+	void increment(int64_t index) noexcept
+	{
+		add(index, 1);
+	}
+
+	//sum of the shards, every add that happened before the call is in it
+	T load(int64_t index) const noexcept
+	{
+		assert(index >= 0 && index < this->m_counter_count);
+
+		T ret(0);
+		for (int64_t shard = 0; shard < this->m_shard_count; shard++)
+		{
+			ret += cell(shard, index).load(std::memory_order_relaxed);
+		}
+
+		return ret;
+	}
+
+	//takes the current sum out of the counter and returns it, adds running alongside land either in it or after it
+	T exchange_zero(int64_t index) noexcept
+	{
+		assert(index >= 0 && index < this->m_counter_count);
+
+		T ret(0);
+		for (int64_t shard = 0; shard < this->m_shard_count; shard++)
+		{
+			ret += cell(shard, index).exchange(0, std::memory_order_relaxed);
+		}
+
+		return ret;
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>(this->m_counter_count);
+	}
+
+	size_t shard_count() const noexcept
+	{
+		return static_cast<size_t>(this->m_shard_count);
+	}
+
+	//fixed storage, everything is reserved and live from construction
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret;
+		ret.reserved_bytes = this->m_allocated * static_cast<int64_t>(sizeof(std::atomic<T>));
+		ret.live_bytes = ret.reserved_bytes;
+		ret.peak_live_bytes = ret.reserved_bytes;
+
+		return ret;
+	}
+
+private:
+	std::atomic<T>*							m_cells;
+	std::atomic<T>*							m_data;
+	TAllocator<std::atomic<T>>				m_allocator;
+	const int64_t							m_counter_count;
+	int64_t									m_shard_count;
+	int64_t									m_stride;
+	int64_t									m_allocated;
+	wait_free_registration					m_registration{ this, "wait_free_sharded_counter_array", false };
+
+	int64_t local_shard() const noexcept
+	{
+		return wait_free_thread_index() & (this->m_shard_count - 1);
+	}
+
+	std::atomic<T>& cell(int64_t shard, int64_t index) const noexcept
+	{
+		return this->m_data[shard * this->m_stride + index];
+	}
+};
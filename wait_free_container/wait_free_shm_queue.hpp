@@ -0,0 +1,540 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "template_util.hpp"
+#include "wait_free_memory.hpp"
+
+//interprocess fixed capacity mpmc queue living in a shm_open/mmap region
+//the region holds the header and the ring, everything is addressed by offsets so every process can map it anywhere
+//a slot is claimed by cas-ing its sequence to a mark naming the participant, so when a process dies mid operation
+//recover() finds its slot: a half written element is skipped, a half read element is enqueued again
+template<typename T>
+class wait_free_shm_queue
+{
+	static_assert(std::is_trivially_copyable_v<T>, "wait_free_shm_queue element must be trivially copyable");
+	static_assert(std::atomic<int64_t>::is_always_lock_free, "wait_free_shm_queue needs address free 64 bit atomics");
+
+	static const uint64_t MAGIC = 0x77667368'6d717565ull;
+	static const uint32_t VERSION = 1;
+	static const int64_t MAX_PARTICIPANTS = 64;
+	static const int64_t NO_OPERATION = -1;
+
+	//slot sequences are >= 0, marks are negative: INT64_MIN + participant * 2 + role
+	static const int64_t PRODUCER_ROLE = 0;
+	static const int64_t CONSUMER_ROLE = 1;
+
+	struct alignas(64) participant
+	{
+		std::atomic<int32_t>	pid;
+		std::atomic<int64_t>	in_flight;
+	};
+
+	struct shm_slot
+	{
+		std::atomic<int64_t>	sequence;
+		std::atomic<int32_t>	skip;
+		T						value;
+	};
+
+	struct shm_header
+	{
+		uint64_t				magic;
+		uint32_t				version;
+		uint32_t				elem_size;
+		int64_t					capacity;
+		int64_t					region_size;
+		int64_t					slots_offset;
+		std::atomic<int32_t>	ready;
+
+		alignas(64) std::atomic<int64_t>	enqueue_pos;
+		alignas(64) std::atomic<int64_t>	dequeue_pos;
+		alignas(64) std::atomic<int64_t>	recovered;
+		std::atomic<int64_t>				lost;
+
+		participant				participants[MAX_PARTICIPANTS];
+	};
+
+public:
+	wait_free_shm_queue() noexcept :
+		m_base(nullptr),
+		m_header(nullptr),
+		m_slots(nullptr),
+		m_mask(0),
+		m_participant(-1)
+	{
+	}
+
+	~wait_free_shm_queue()
+	{
+		detach();
+	}
+
+	wait_free_shm_queue(const wait_free_shm_queue&) = delete;
+	wait_free_shm_queue& operator=(const wait_free_shm_queue&) = delete;
+
+	//capacity is rounded up to a power of two, fails if the region already exists
+	bool create(const char* name, int64_t capacity)
+	{
+		assert(this->m_base == nullptr && capacity > 0);
+
+		int64_t pow2_capacity(1);
+		while (pow2_capacity < capacity)
+		{
+			pow2_capacity <<= 1;
+		}
+
+		int64_t slots_offset = (sizeof(shm_header) + 63) / 64 * 64;
+		int64_t region_size = slots_offset + pow2_capacity * static_cast<int64_t>(sizeof(shm_slot));
+
+		int fd = ::shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd == -1)
+		{
+			return false;
+		}
+
+		if (::ftruncate(fd, region_size) != 0)
+		{
+			::close(fd);
+			::shm_unlink(name);
+			return false;
+		}
+
+		void* base = ::mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (base == MAP_FAILED)
+		{
+			::shm_unlink(name);
+			return false;
+		}
+
+		shm_header* header = new (base) shm_header();
+		header->magic = MAGIC;
+		header->version = VERSION;
+		header->elem_size = sizeof(T);
+		header->capacity = pow2_capacity;
+		header->region_size = region_size;
+		header->slots_offset = slots_offset;
+		header->enqueue_pos = 0;
+		header->dequeue_pos = 0;
+		header->recovered = 0;
+		header->lost = 0;
+
+		for (int64_t i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			header->participants[i].pid = 0;
+			header->participants[i].in_flight = NO_OPERATION;
+		}
+
+		shm_slot* slots = reinterpret_cast<shm_slot*>(static_cast<char*>(base) + slots_offset);
+		for (int64_t i = 0; i < pow2_capacity; i++)
+		{
+			shm_slot* slot = new (&slots[i]) shm_slot();
+			slot->sequence.store(i, std::memory_order_relaxed);
+			slot->skip.store(0, std::memory_order_relaxed);
+		}
+
+		header->ready.store(1, std::memory_order_release);
+
+		return map(base);
+	}
+
+	//maps an existing region, recovers the operations of dead participants on the way
+	//fails if the region isn't initialized within timeout, e.g. its creator died before finishing it
+	bool attach(const char* name, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+	{
+		assert(this->m_base == nullptr);
+
+		int fd = ::shm_open(name, O_RDWR, 0600);
+		if (fd == -1)
+		{
+			return false;
+		}
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(shm_header)))
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* base = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (base == MAP_FAILED)
+		{
+			return false;
+		}
+
+		shm_header* header = static_cast<shm_header*>(base);
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (header->ready.load(std::memory_order_acquire) == 0)
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				::munmap(base, st.st_size);
+				return false;
+			}
+			std::this_thread::yield();
+		}
+
+		if (header->magic != MAGIC || header->version != VERSION || header->elem_size != sizeof(T) ||
+			header->region_size != static_cast<int64_t>(st.st_size))
+		{
+			::munmap(base, st.st_size);
+			return false;
+		}
+
+		if (!map(base))
+		{
+			return false;
+		}
+
+		recover();
+
+		return true;
+	}
+
+	void detach() noexcept
+	{
+		this->m_registration.remove();
+
+		if (this->m_base == nullptr)
+		{
+			return;
+		}
+
+		if (this->m_participant != -1)
+		{
+			participant& me = this->m_header->participants[this->m_participant];
+			me.in_flight = NO_OPERATION;
+			me.pid = 0;
+		}
+
+		::munmap(this->m_base, this->m_header->region_size);
+		this->m_base = nullptr;
+		this->m_header = nullptr;
+		this->m_slots = nullptr;
+		this->m_participant = -1;
+	}
+
+	static bool remove(const char* name) noexcept
+	{
+		return ::shm_unlink(name) == 0;
+	}
+
+	//a handle is one participant, use one handle per thread
+	bool try_enqueue(const T& value) noexcept
+	{
+		assert(this->m_base != nullptr);
+
+		participant& me = this->m_header->participants[this->m_participant];
+		int64_t mark = make_mark(this->m_participant, PRODUCER_ROLE);
+		int64_t pos(0);
+		shm_slot* slot(nullptr);
+
+		while (true)
+		{
+			pos = this->m_header->enqueue_pos.load(std::memory_order_relaxed);
+			slot = &this->m_slots[pos & this->m_mask];
+			int64_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+			if (sequence == pos)
+			{
+				//publish the intent first so a crash right after the claim is always found by recover()
+				me.in_flight.store(pos);
+				if (slot->sequence.compare_exchange_strong(sequence, mark))
+				{
+					advance(this->m_header->enqueue_pos, pos);
+					break;
+				}
+			}
+			else if (is_mark(sequence, PRODUCER_ROLE))
+			{
+				//claimed for pos by a producer that did not advance yet
+				advance(this->m_header->enqueue_pos, pos);
+			}
+			else if (sequence < pos)
+			{
+				//previous lap not consumed yet
+				return false;
+			}
+		}
+
+		slot->value = value;
+		slot->skip.store(0, std::memory_order_relaxed);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+		me.in_flight.store(NO_OPERATION, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	bool try_dequeue(T& elem) noexcept
+	{
+		assert(this->m_base != nullptr);
+
+		participant& me = this->m_header->participants[this->m_participant];
+		int64_t mark = make_mark(this->m_participant, CONSUMER_ROLE);
+
+		while (true)
+		{
+			int64_t pos = this->m_header->dequeue_pos.load(std::memory_order_relaxed);
+			shm_slot* slot = &this->m_slots[pos & this->m_mask];
+			int64_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+			if (sequence == pos + 1)
+			{
+				me.in_flight.store(pos);
+				if (!slot->sequence.compare_exchange_strong(sequence, mark))
+				{
+					continue;
+				}
+
+				advance(this->m_header->dequeue_pos, pos);
+
+				bool skip = slot->skip.load(std::memory_order_relaxed) != 0;
+				if (!skip)
+				{
+					elem = slot->value;
+				}
+
+				slot->sequence.store(pos + this->m_header->capacity, std::memory_order_release);
+				me.in_flight.store(NO_OPERATION, std::memory_order_relaxed);
+
+				if (!skip)
+				{
+					return true;
+				}
+			}
+			else if (is_mark(sequence, CONSUMER_ROLE))
+			{
+				advance(this->m_header->dequeue_pos, pos);
+			}
+			else if (sequence < pos + 1)
+			{
+				//empty, or the producer is still writing
+				return false;
+			}
+		}
+	}
+
+	//completes the operations of participants whose process is gone, returns how many were repaired
+	int64_t recover() noexcept
+	{
+		assert(this->m_base != nullptr);
+
+		int64_t ret(0);
+		for (int64_t i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			participant& p = this->m_header->participants[i];
+			int32_t pid = p.pid;
+			if (pid == 0 || process_alive(pid))
+			{
+				continue;
+			}
+
+			int64_t pos = p.in_flight;
+			if (pos != NO_OPERATION)
+			{
+				ret += recover_slot(i, pos);
+			}
+
+			p.in_flight = NO_OPERATION;
+			p.pid.compare_exchange_strong(pid, 0);
+		}
+
+		return ret;
+	}
+
+	size_t size() const noexcept
+	{
+		int64_t size = this->m_header->enqueue_pos.load() - this->m_header->dequeue_pos.load();
+		return static_cast<size_t>(size < 0 ? 0 : size);
+	}
+
+	size_t capacity() const noexcept
+	{
+		return this->m_header->capacity;
+	}
+
+	//the mapped region, shared with the other processes and fixed in size, so no peak or growth is tracked
+	//zero once detached, don't detach while another thread reads it
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret;
+		if (!attached())
+		{
+			return ret;
+		}
+
+		ret.reserved_bytes = this->m_header->region_size;
+		ret.live_bytes = static_cast<int64_t>(size() * sizeof(shm_slot));
+
+		return ret;
+	}
+
+	//elements re-enqueued after a consumer died holding them
+	int64_t recovered() const noexcept
+	{
+		return this->m_header->recovered;
+	}
+
+	//elements a dead producer never finished plus recovered elements that found the ring full
+	int64_t lost() const noexcept
+	{
+		return this->m_header->lost;
+	}
+
+	bool attached() const noexcept
+	{
+		return this->m_base != nullptr;
+	}
+
+private:
+
+	void*			m_base;
+	shm_header*		m_header;
+	shm_slot*		m_slots;
+	int64_t			m_mask;
+	int64_t			m_participant;
+	//registered only while attached, memory_usage() reads the mapped header
+	wait_free_registration	m_registration{ this, "wait_free_shm_queue", false };
+
+	static int64_t make_mark(int64_t participant_index, int64_t role) noexcept
+	{
+		return (std::numeric_limits<int64_t>::min)() + participant_index * 2 + role;
+	}
+
+	static bool is_mark(int64_t sequence, int64_t role) noexcept
+	{
+		return sequence < (std::numeric_limits<int64_t>::min)() + MAX_PARTICIPANTS * 2 &&
+			((sequence - (std::numeric_limits<int64_t>::min)()) & 1) == role;
+	}
+
+	//move a position past pos unless another participant already did
+	static void advance(std::atomic<int64_t>& position, int64_t pos) noexcept
+	{
+		position.compare_exchange_strong(pos, pos + 1);
+	}
+
+	static bool process_alive(int32_t pid) noexcept
+	{
+		return ::kill(pid, 0) == 0 || errno != ESRCH;
+	}
+
+	bool map(void* base) noexcept
+	{
+		this->m_base = base;
+		this->m_header = static_cast<shm_header*>(base);
+		this->m_slots = reinterpret_cast<shm_slot*>(static_cast<char*>(base) + this->m_header->slots_offset);
+		this->m_mask = this->m_header->capacity - 1;
+
+		int32_t pid = static_cast<int32_t>(::getpid());
+		for (int64_t i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			int32_t free_pid(0);
+			if (this->m_header->participants[i].pid.compare_exchange_strong(free_pid, pid))
+			{
+				this->m_header->participants[i].in_flight = NO_OPERATION;
+				this->m_participant = i;
+				this->m_registration.add();
+				return true;
+			}
+		}
+
+		//every participant slot taken, try to reclaim the ones of dead processes once
+		recover_participants_and_retry(pid);
+		if (this->m_participant != -1)
+		{
+			this->m_registration.add();
+			return true;
+		}
+
+		::munmap(this->m_base, this->m_header->region_size);
+		this->m_base = nullptr;
+		this->m_header = nullptr;
+		this->m_slots = nullptr;
+
+		return false;
+	}
+
+	void recover_participants_and_retry(int32_t pid) noexcept
+	{
+		recover();
+
+		for (int64_t i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			int32_t free_pid(0);
+			if (this->m_header->participants[i].pid.compare_exchange_strong(free_pid, pid))
+			{
+				this->m_header->participants[i].in_flight = NO_OPERATION;
+				this->m_participant = i;
+				return;
+			}
+		}
+	}
+
+	int64_t recover_slot(int64_t participant_index, int64_t pos) noexcept
+	{
+		shm_slot* slot = &this->m_slots[pos & this->m_mask];
+
+		int64_t producer_mark = make_mark(participant_index, PRODUCER_ROLE);
+		if (slot->sequence.load() == producer_mark)
+		{
+			//claimed but never published, publish it as a hole consumers step over
+			slot->skip.store(1, std::memory_order_relaxed);
+			if (slot->sequence.compare_exchange_strong(producer_mark, pos + 1))
+			{
+				advance(this->m_header->enqueue_pos, pos);
+				this->m_header->lost++;
+				return 1;
+			}
+
+			return 0;
+		}
+
+		int64_t consumer_mark = make_mark(participant_index, CONSUMER_ROLE);
+		if (slot->sequence.load() == consumer_mark)
+		{
+			//claimed but never released, the element is intact, put it back at the tail
+			bool skip = slot->skip.load(std::memory_order_relaxed) != 0;
+			T value = slot->value;
+			if (slot->sequence.compare_exchange_strong(consumer_mark, pos + this->m_header->capacity))
+			{
+				advance(this->m_header->dequeue_pos, pos);
+				if (!skip)
+				{
+					if (this->m_participant != -1 && try_enqueue(value))
+					{
+						this->m_header->recovered++;
+					}
+					else
+					{
+						this->m_header->lost++;
+					}
+				}
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+};
+
+#endif
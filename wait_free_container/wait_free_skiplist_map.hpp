@@ -0,0 +1,576 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "wait_free_bitset.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_memory_pool.hpp"
+
+//ordered map, lock free skip list (fraser / herlihy-shavit) with nodes taken from a wait_free_memory_pool
+//insert and erase are lock free, find and range scans only read and never retry, marked nodes are stepped over
+//links are pool offsets with the low bit as the deletion mark; every operation holds the pool's element gate, so the
+//pool may grow and move its storage only between operations
+//an erased node goes back to the pool after two epoch steps, when no operation that could still see it is running,
+//so a range scan may run alongside any number of inserts and erases
+//K and V are copied bytewise when the pool grows, so both have to be trivially copyable
+template<typename K, typename V, typename TCompare = std::less<K>, template<typename U> typename TAllocator = std::allocator>
+class wait_free_skiplist_map : private wait_free_stats_base
+{
+	static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "wait_free_skiplist_map key and value must be trivially copyable");
+	static_assert(std::atomic<V>::is_always_lock_free, "wait_free_skiplist_map value must be a lock free atomic");
+
+	static constexpr int32_t MAX_LEVEL = 16;
+	static constexpr int64_t MAX_THREADS = WAIT_FREE_MAX_THREADS;
+	static constexpr int64_t RETIRE_BATCH = 64;
+	static constexpr int64_t IDLE = -1;
+	static constexpr int64_t NIL = -1;
+
+	struct node
+	{
+		using wait_free_trivially_relocatable = std::true_type;
+
+		K							key;
+		std::atomic<V>				value;
+		int32_t						level;
+		//the inserter done linking and the eraser done marking, the second of them unlinks and retires the node
+		std::atomic<int32_t>		finished;
+		//(offset + 1) << 1 | mark, 0 is the end of the list
+		std::atomic<uint64_t>		next[MAX_LEVEL];
+	};
+
+	struct retired_node
+	{
+		int64_t		epoch;
+		int64_t		offset;
+	};
+
+	struct alignas(64) thread_state
+	{
+		std::atomic<int64_t>			epoch{ IDLE };
+		int32_t							depth{ 0 };
+		//pool storage seen by the outermost guard, nested guards reuse it
+		node*							base{ nullptr };
+		std::vector<retired_node>		retired;
+	};
+
+	using pool_type = wait_free_memory_pool<node, TAllocator>;
+
+	//epoch announcement plus the pool gate for the duration of one operation
+	//only the outermost guard of a thread takes the gate, a nested one taking it again could wait on a pool growth that
+	//waits on the outer one
+	class guard
+	{
+	public:
+		explicit guard(const wait_free_skiplist_map& map) :
+			m_map(map),
+			m_state(map.local_state()),
+			m_it(map.m_pool.get(map.m_head)),
+			base(nullptr)
+		{
+			if (this->m_state.depth++ == 0)
+			{
+				int64_t epoch = map.m_epoch.load(std::memory_order_acquire);
+				while (true)
+				{
+					this->m_state.epoch.store(epoch, std::memory_order_seq_cst);
+					int64_t now = map.m_epoch.load(std::memory_order_seq_cst);
+					if (now == epoch)
+					{
+						break;
+					}
+					epoch = now;
+				}
+
+				this->m_state.base = this->m_it.lock() - map.m_head;
+			}
+
+			this->base = this->m_state.base;
+		}
+
+		~guard()
+		{
+			if (--this->m_state.depth == 0)
+			{
+				this->m_it.unlock();
+				this->m_state.base = nullptr;
+				this->m_state.epoch.store(IDLE, std::memory_order_release);
+			}
+		}
+
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+	private:
+		const wait_free_skiplist_map&		m_map;
+		thread_state&						m_state;
+		typename pool_type::iterator		m_it;
+
+	public:
+		node*								base;
+	};
+
+public:
+	explicit wait_free_skiplist_map(int64_t capacity = 1024, const TCompare& compare = TCompare(), const TAllocator<node>& allocator = TAllocator<node>()) :
+		m_pool(capacity + 1, allocator),
+		m_compare(compare),
+		m_head(NIL),
+		m_states(new std::atomic<thread_state*>[MAX_THREADS]),
+		m_epoch(0),
+		m_size(0)
+	{
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			this->m_states[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		auto it = this->m_pool.allocate();
+		this->m_head = static_cast<int64_t>(it.offset());
+
+		node* head = it.lock();
+		new (head) node();
+		head->level = MAX_LEVEL;
+		for (int32_t i = 0; i < MAX_LEVEL; i++)
+		{
+			head->next[i].store(0, std::memory_order_relaxed);
+		}
+		it.unlock();
+	}
+
+	~wait_free_skiplist_map()
+	{
+		this->m_registration.remove();
+
+		for (int64_t i = 0; i < MAX_THREADS; i++)
+		{
+			delete this->m_states[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	wait_free_skiplist_map(const wait_free_skiplist_map&) = delete;
+	wait_free_skiplist_map& operator=(const wait_free_skiplist_map&) = delete;
+
+	bool find(const K& key, V& value) const
+	{
+		guard g(*this);
+
+		int64_t curr = lookup(g.base, key);
+		if (curr == NIL || !equal(g.base[curr].key, key))
+		{
+			return false;
+		}
+
+		value = g.base[curr].value.load(std::memory_order_acquire);
+		return true;
+	}
+
+	bool contains(const K& key) const
+	{
+		V value{};
+		return find(key, value);
+	}
+
+	//false when the key is already there
+	bool insert(const K& key, const V& value)
+	{
+		//allocated before taking the gate, growing the pool waits for every gate holder
+		auto it = this->m_pool.allocate();
+		int64_t offset = static_cast<int64_t>(it.offset());
+
+		guard g(*this);
+		node* base = g.base;
+
+		node& n = *new (&base[offset]) node();
+		n.key = key;
+		n.value.store(value, std::memory_order_relaxed);
+		n.level = random_level();
+		n.finished.store(0, std::memory_order_relaxed);
+
+		int64_t preds[MAX_LEVEL];
+		int64_t succs[MAX_LEVEL];
+		while (true)
+		{
+			if (search(base, key, preds, succs, false))
+			{
+				this->m_pool.deallocate(this->m_pool.get(offset));
+				return false;
+			}
+
+			for (int32_t i = 0; i < MAX_LEVEL; i++)
+			{
+				n.next[i].store(i < n.level ? make_link(succs[i]) : 0, std::memory_order_relaxed);
+			}
+
+			uint64_t expected = make_link(succs[0]);
+			if (this->m_stats.count_cas(base[preds[0]].next[0].compare_exchange_strong(expected, make_link(offset), std::memory_order_acq_rel)))
+			{
+				break;
+			}
+		}
+
+		this->m_size.fetch_add(1, std::memory_order_relaxed);
+
+		//upper levels are a shortcut only, linking stops as soon as the node is marked
+		for (int32_t i = 1; i < n.level; i++)
+		{
+			while (true)
+			{
+				uint64_t mine = n.next[i].load(std::memory_order_acquire);
+				if (is_marked(mine))
+				{
+					finish(base, offset);
+					return true;
+				}
+
+				if (offset_of(mine) != succs[i] &&
+					!this->m_stats.count_cas(n.next[i].compare_exchange_strong(mine, make_link(succs[i]), std::memory_order_acq_rel)))
+				{
+					continue;
+				}
+
+				uint64_t expected = make_link(succs[i]);
+				if (this->m_stats.count_cas(base[preds[i]].next[i].compare_exchange_strong(expected, make_link(offset), std::memory_order_acq_rel)))
+				{
+					break;
+				}
+
+				search(base, key, preds, succs, false);
+				if (succs[0] != offset)
+				{
+					finish(base, offset);
+					return true;
+				}
+			}
+		}
+
+		finish(base, offset);
+		return true;
+	}
+
+	//false when the key isn't there
+	bool update(const K& key, const V& value)
+	{
+		guard g(*this);
+
+		int64_t curr = lookup(g.base, key);
+		if (curr == NIL || !equal(g.base[curr].key, key))
+		{
+			return false;
+		}
+
+		g.base[curr].value.store(value, std::memory_order_release);
+		return true;
+	}
+
+	//old_value gets the value of the erased entry
+	bool erase(const K& key, V* old_value = nullptr)
+	{
+		guard g(*this);
+		node* base = g.base;
+
+		int64_t preds[MAX_LEVEL];
+		int64_t succs[MAX_LEVEL];
+		if (!search(base, key, preds, succs, false))
+		{
+			return false;
+		}
+
+		int64_t victim = succs[0];
+		node& n = base[victim];
+		for (int32_t i = n.level - 1; i >= 1; i--)
+		{
+			uint64_t link = n.next[i].load(std::memory_order_acquire);
+			while (!is_marked(link) && !this->m_stats.count_cas(n.next[i].compare_exchange_weak(link, link | 1, std::memory_order_acq_rel)))
+			{
+			}
+		}
+
+		//whoever marks level 0 erased the entry
+		uint64_t link = n.next[0].load(std::memory_order_acquire);
+		while (true)
+		{
+			if (is_marked(link))
+			{
+				return false;
+			}
+
+			if (this->m_stats.count_cas(n.next[0].compare_exchange_weak(link, link | 1, std::memory_order_acq_rel)))
+			{
+				break;
+			}
+		}
+
+		if (old_value != nullptr)
+		{
+			*old_value = n.value.load(std::memory_order_acquire);
+		}
+
+		this->m_size.fetch_sub(1, std::memory_order_relaxed);
+		search(base, key, preds, succs, false);
+		finish(base, victim);
+
+		return true;
+	}
+
+	//calls f(key, value) for every entry with from <= key <= to in key order, returns how many there were
+	//an entry inserted or erased during the scan may or may not be seen, every other one is seen exactly once
+	//f runs inside the pool gate, it may find, update and erase on this map but must not insert, growing the pool would
+	//wait for the scan itself
+	template<typename TFunc>
+	int64_t for_each_range(const K& from, const K& to, TFunc&& f) const
+	{
+		guard g(*this);
+		node* base = g.base;
+
+		int64_t ret(0);
+		int64_t curr = lookup(base, from);
+		while (curr != NIL && !this->m_compare(to, base[curr].key))
+		{
+			f(base[curr].key, base[curr].value.load(std::memory_order_acquire));
+			ret++;
+			curr = next_unmarked(base, curr, 0);
+		}
+
+		return ret;
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>((std::max)(this->m_size.load(std::memory_order_relaxed), static_cast<int64_t>(0)));
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	//the node pool, erased nodes waiting for their epoch are still live in it
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		return this->m_pool.memory_usage();
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret = this->m_stats.snapshot();
+		ret += this->m_pool.stats();
+
+		return ret;
+	}
+
+private:
+	mutable pool_type									m_pool;
+	TCompare											m_compare;
+	int64_t												m_head;
+	std::unique_ptr<std::atomic<thread_state*>[]>		m_states;
+	alignas(64) std::atomic<int64_t>					m_epoch;
+	alignas(64) std::atomic<int64_t>					m_size;
+	wait_free_registration								m_registration{ this, "wait_free_skiplist_map" };
+
+	static uint64_t make_link(int64_t offset) noexcept
+	{
+		return offset == NIL ? 0 : static_cast<uint64_t>(offset + 1) << 1;
+	}
+
+	static int64_t offset_of(uint64_t link) noexcept
+	{
+		return static_cast<int64_t>(link >> 1) - 1;
+	}
+
+	static bool is_marked(uint64_t link) noexcept
+	{
+		return (link & 1) != 0;
+	}
+
+	bool equal(const K& lhd, const K& rhd) const
+	{
+		return !this->m_compare(lhd, rhd) && !this->m_compare(rhd, lhd);
+	}
+
+	static int32_t random_level() noexcept
+	{
+		//one level up with probability 1/4
+		static thread_local uint64_t state = 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(wait_free_thread_index() + 1);
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		int32_t level(1);
+		uint64_t bits = state;
+		while (level < MAX_LEVEL && (bits & 3) == 0)
+		{
+			level++;
+			bits >>= 2;
+		}
+
+		return level;
+	}
+
+	thread_state& local_state() const
+	{
+		int64_t slot = wait_free_thread_slot();
+		thread_state* ret = this->m_states[slot].load(std::memory_order_relaxed);
+		if (ret == nullptr)
+		{
+			//only the thread owning the slot creates its state
+			ret = new thread_state();
+			this->m_states[slot].store(ret, std::memory_order_release);
+		}
+
+		return *ret;
+	}
+
+	//successor of curr at level, stepping over marked nodes without unlinking them
+	static int64_t next_unmarked(node* base, int64_t curr, int32_t level) noexcept
+	{
+		int64_t ret = offset_of(base[curr].next[level].load(std::memory_order_acquire));
+		while (ret != NIL && is_marked(base[ret].next[level].load(std::memory_order_acquire)))
+		{
+			ret = offset_of(base[ret].next[level].load(std::memory_order_acquire));
+		}
+
+		return ret;
+	}
+
+	//read only descent, first unmarked node with key >= key at level 0 or NIL
+	int64_t lookup(node* base, const K& key) const
+	{
+		int64_t pred = this->m_head;
+		int64_t curr = NIL;
+		for (int32_t level = MAX_LEVEL - 1; level >= 0; level--)
+		{
+			curr = next_unmarked(base, pred, level);
+			while (curr != NIL && this->m_compare(base[curr].key, key))
+			{
+				pred = curr;
+				curr = next_unmarked(base, curr, level);
+			}
+		}
+
+		return curr;
+	}
+
+	//fills preds/succs on every level and unlinks the marked nodes it passes, true when succs[0] holds key
+	//through_equal walks past every node equal to key too, which is how a node is swept from every level before it is retired;
+	//equal keys are in no particular order, so each level of that walk starts again from the last node below key
+	bool search(node* base, const K& key, int64_t* preds, int64_t* succs, bool through_equal)
+	{
+	retry:
+		int64_t pred = this->m_head;
+		int64_t below = this->m_head;
+		for (int32_t level = MAX_LEVEL - 1; level >= 0; level--)
+		{
+			if (through_equal)
+			{
+				pred = below;
+			}
+
+			uint64_t pred_link = base[pred].next[level].load(std::memory_order_acquire);
+			if (is_marked(pred_link))
+			{
+				goto retry;
+			}
+
+			int64_t curr = offset_of(pred_link);
+			while (curr != NIL)
+			{
+				uint64_t succ_link = base[curr].next[level].load(std::memory_order_acquire);
+				if (is_marked(succ_link))
+				{
+					uint64_t expected = make_link(curr);
+					if (!this->m_stats.count_cas(base[pred].next[level].compare_exchange_strong(
+						expected, make_link(offset_of(succ_link)), std::memory_order_acq_rel)))
+					{
+						goto retry;
+					}
+
+					curr = offset_of(succ_link);
+					continue;
+				}
+
+				bool less = this->m_compare(base[curr].key, key);
+				if (less || (through_equal && !this->m_compare(key, base[curr].key)))
+				{
+					below = less ? curr : below;
+					pred = curr;
+					curr = offset_of(succ_link);
+				}
+				else
+				{
+					break;
+				}
+			}
+
+			preds[level] = pred;
+			succs[level] = curr;
+		}
+
+		return succs[0] != NIL && equal(base[succs[0]].key, key);
+	}
+
+	//the second of inserter and eraser sweeps the node out of every level, nobody can link it again after that
+	void finish(node* base, int64_t offset)
+	{
+		if (base[offset].finished.fetch_add(1, std::memory_order_acq_rel) != 1)
+		{
+			return;
+		}
+
+		int64_t preds[MAX_LEVEL];
+		int64_t succs[MAX_LEVEL];
+		search(base, base[offset].key, preds, succs, true);
+		retire(offset);
+	}
+
+	void retire(int64_t offset)
+	{
+		thread_state& state = local_state();
+		state.retired.push_back({ this->m_epoch.load(std::memory_order_acquire), offset });
+		if (static_cast<int64_t>(state.retired.size()) < RETIRE_BATCH)
+		{
+			return;
+		}
+
+		//the epoch steps once every running operation has seen the current one
+		int64_t epoch = this->m_epoch.load(std::memory_order_seq_cst);
+		bool advance(true);
+		for (int64_t i = 0; i < MAX_THREADS && advance; i++)
+		{
+			thread_state* other = this->m_states[i].load(std::memory_order_acquire);
+			if (other != nullptr)
+			{
+				int64_t announced = other->epoch.load(std::memory_order_seq_cst);
+				advance = announced == IDLE || announced == epoch;
+			}
+		}
+
+		if (advance)
+		{
+			this->m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+		}
+
+		//retired two steps ago: every operation running then has ended
+		int64_t safe = this->m_epoch.load(std::memory_order_acquire) - 2;
+		size_t kept(0);
+		for (size_t i = 0; i < state.retired.size(); i++)
+		{
+			if (state.retired[i].epoch <= safe)
+			{
+				this->m_pool.deallocate(this->m_pool.get(state.retired[i].offset));
+			}
+			else
+			{
+				state.retired[kept++] = state.retired[i];
+			}
+		}
+		state.retired.resize(kept);
+	}
+};
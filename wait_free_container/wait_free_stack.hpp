@@ -0,0 +1,261 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#include "wait_free_memory.hpp"
+#include "wait_free_memory_pool.hpp"
+#include "wait_free_stats.hpp"
+
+//lifo stack, treiber's list of nodes taken from a wait_free_memory_pool, e.g. a cache of reusable buffers
+//the head is a node offset packed with a 32 bit tag bumped on every change, so a node popped and pushed again between
+//another thread's load and cas can't be mistaken for the one it saw
+//a push or pop whose head cas fails goes to the elimination array: a pusher posts its node in a random slot for a short
+//while, a popper that finds one takes it, and the pair completes without touching the head again
+//T is copied bytewise when the pool grows, so it has to be trivially copyable
+template<typename T, template<typename U> typename TAllocator = std::allocator>
+class wait_free_stack : private wait_free_stats_base
+{
+	static_assert(std::is_trivially_copyable_v<T>, "wait_free_stack element must be trivially copyable");
+
+	static constexpr int64_t ELIMINATION_SPIN = 256;
+	static constexpr uint64_t OFFSET_MASK = 0xffffffffull;
+	static constexpr int64_t TAKEN = -1;
+
+	struct node
+	{
+		using wait_free_trivially_relocatable = std::true_type;
+
+		T							value;
+		//head word of the node below, its offset without tag
+		std::atomic<int64_t>		next;
+	};
+
+	//0 is empty, TAKEN until the pusher sees its offer was taken, otherwise the offset + 1 of a node on offer
+	//only the pusher empties a taken slot, so nobody can offer there before it has looked
+	struct alignas(64) elimination_slot
+	{
+		std::atomic<int64_t>	offer{ 0 };
+	};
+
+	using pool_type = wait_free_memory_pool<node, TAllocator>;
+
+public:
+	//elimination_width slots in the elimination array, -1 takes half the hardware threads, 0 turns elimination off
+	explicit wait_free_stack(int64_t capacity = 16, int64_t elimination_width = -1, const TAllocator<node>& allocator = TAllocator<node>()) :
+		m_head(0),
+		m_size(0),
+		m_pool(capacity + 1, allocator),
+		m_anchor(-1),
+		m_slots(nullptr),
+		m_width(0)
+	{
+		if (elimination_width < 0)
+		{
+			elimination_width = (std::max)(static_cast<int64_t>(std::thread::hardware_concurrency() / 2), static_cast<int64_t>(1));
+		}
+
+		if (elimination_width > 0)
+		{
+			this->m_width = elimination_width;
+			this->m_slots.reset(new elimination_slot[elimination_width]);
+		}
+
+		//never pushed, only locked to hold the pool gate for operations that have no node of their own
+		this->m_anchor = static_cast<int64_t>(this->m_pool.allocate().offset());
+		this->m_registration.add();
+	}
+
+	wait_free_stack(const wait_free_stack&) = delete;
+	wait_free_stack& operator=(const wait_free_stack&) = delete;
+
+	void push(const T& value)
+	{
+		//allocated before locking anything, growing the pool waits for every lock holder
+		auto it = this->m_pool.allocate();
+		int64_t offset = static_cast<int64_t>(it.offset());
+		assert(static_cast<uint64_t>(offset) < OFFSET_MASK);
+
+		//no placement new, a stale popper may still be loading next of a recycled node
+		node& n = *it.lock();
+		n.value = value;
+
+		uint64_t head = this->m_head.load(std::memory_order_acquire);
+		while (true)
+		{
+			n.next.store(offset_of(head), std::memory_order_relaxed);
+			if (this->m_stats.count_cas(this->m_head.compare_exchange_weak(head, make_head(offset, head), std::memory_order_release, std::memory_order_acquire)))
+			{
+				break;
+			}
+
+			if (offer(offset))
+			{
+				break;
+			}
+
+			head = this->m_head.load(std::memory_order_acquire);
+		}
+
+		it.unlock();
+		this->m_size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//false when empty
+	bool pop(T& value)
+	{
+		auto it = this->m_pool.get(this->m_anchor);
+		node* base = it.lock() - this->m_anchor;
+
+		int64_t offset(-1);
+		uint64_t head = this->m_head.load(std::memory_order_acquire);
+		while (true)
+		{
+			offset = offset_of(head);
+			if (offset < 0)
+			{
+				it.unlock();
+				return false;
+			}
+
+			//the node may be popped and reused meanwhile, then next is stale but the tag makes the cas fail
+			int64_t next = base[offset].next.load(std::memory_order_relaxed);
+			if (this->m_stats.count_cas(this->m_head.compare_exchange_weak(head, make_head(next, head), std::memory_order_acquire)))
+			{
+				break;
+			}
+
+			offset = take();
+			if (offset >= 0)
+			{
+				break;
+			}
+
+			head = this->m_head.load(std::memory_order_acquire);
+		}
+
+		value = base[offset].value;
+		this->m_pool.deallocate(this->m_pool.get(offset));
+		it.unlock();
+		this->m_size.fetch_sub(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	size_t size() const noexcept
+	{
+		return static_cast<size_t>((std::max)(this->m_size.load(std::memory_order_relaxed), static_cast<int64_t>(0)));
+	}
+
+	bool empty() const noexcept
+	{
+		return offset_of(this->m_head.load(std::memory_order_acquire)) < 0;
+	}
+
+	//the node pool plus the elimination array
+	wait_free_memory_usage memory_usage() const noexcept
+	{
+		wait_free_memory_usage ret = this->m_pool.memory_usage();
+		ret.reserved_bytes += this->m_width * static_cast<int64_t>(sizeof(elimination_slot));
+
+		return ret;
+	}
+
+	wait_free_stats_snapshot stats() const noexcept
+	{
+		wait_free_stats_snapshot ret = this->m_stats.snapshot();
+		ret += this->m_pool.stats();
+
+		return ret;
+	}
+
+private:
+	//tag << 32 | (offset + 1), offset + 1 == 0 is the empty stack
+	alignas(64) std::atomic<uint64_t>			m_head;
+	alignas(64) std::atomic<int64_t>			m_size;
+	pool_type									m_pool;
+	int64_t										m_anchor;
+	std::unique_ptr<elimination_slot[]>			m_slots;
+	int64_t										m_width;
+	wait_free_registration						m_registration{ this, "wait_free_stack", false };
+
+	static int64_t offset_of(uint64_t head) noexcept
+	{
+		return static_cast<int64_t>(head & OFFSET_MASK) - 1;
+	}
+
+	static uint64_t make_head(int64_t offset, uint64_t old_head) noexcept
+	{
+		return ((old_head & ~OFFSET_MASK) + (OFFSET_MASK + 1)) | static_cast<uint64_t>(offset + 1);
+	}
+
+	elimination_slot* random_slot() const noexcept
+	{
+		static thread_local uint64_t state = 0x9e3779b97f4a7c15ull * static_cast<uint64_t>(wait_free_thread_index() + 1);
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		return &this->m_slots[static_cast<int64_t>(state % static_cast<uint64_t>(this->m_width))];
+	}
+
+	//true when a popper took the node, false when nobody came and the pusher goes back to the head
+	bool offer(int64_t offset) noexcept
+	{
+		if (this->m_width == 0)
+		{
+			return false;
+		}
+
+		elimination_slot* slot = random_slot();
+		int64_t expected(0);
+		if (!this->m_stats.count_cas(slot->offer.compare_exchange_strong(expected, offset + 1, std::memory_order_release, std::memory_order_relaxed)))
+		{
+			return false;
+		}
+
+		for (int64_t i = 0; i < ELIMINATION_SPIN; i++)
+		{
+			if (slot->offer.load(std::memory_order_acquire) == TAKEN)
+			{
+				slot->offer.store(0, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		//withdraw, failing means a popper got there first
+		expected = offset + 1;
+		if (slot->offer.compare_exchange_strong(expected, 0, std::memory_order_acquire, std::memory_order_relaxed))
+		{
+			return false;
+		}
+
+		slot->offer.store(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	//offset of an offered node now owned by the caller, -1 when the slot it looked at held none
+	int64_t take() noexcept
+	{
+		if (this->m_width == 0)
+		{
+			return -1;
+		}
+
+		elimination_slot* slot = random_slot();
+		int64_t offered = slot->offer.load(std::memory_order_acquire);
+		if (offered <= 0 ||
+			!this->m_stats.count_cas(slot->offer.compare_exchange_strong(offered, TAKEN, std::memory_order_acquire, std::memory_order_relaxed)))
+		{
+			return -1;
+		}
+
+		return offered - 1;
+	}
+};
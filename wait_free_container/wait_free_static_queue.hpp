@@ -0,0 +1,160 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//bounded mpmc queue with the ring stored inline, no allocator, no resize, nothing but the object itself
+//try_enqueue fails when the ring is full and try_dequeue when it is empty, neither ever waits for another thread's resize
+//a slot sequence is kept relative to its index, so all zero memory is an empty queue: the constructor is constexpr,
+//a static instance is constant initialized and a zero filled shared memory region can be used as one in place
+//in shared memory T has to be trivially copyable and 64 bit atomics lock free, it carries no stats or registration for that reason
+template<typename T, size_t N>
+class static_wait_free_queue
+{
+	//with one slot the sequence after a dequeue equals the one after an enqueue, so full and empty look the same
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "static_wait_free_queue capacity must be a power of two of at least 2");
+	static_assert(std::atomic<int64_t>::is_always_lock_free, "static_wait_free_queue needs lock free 64 bit atomics");
+
+	static constexpr int64_t CAPACITY = static_cast<int64_t>(N);
+	static constexpr int64_t MASK = CAPACITY - 1;
+
+	//sequence + index == position that may use the slot next, enqueue at pos waits for pos, dequeue for pos + 1
+	struct slot
+	{
+		std::atomic<int64_t>					sequence{ 0 };
+		alignas(T) unsigned char				storage[sizeof(T)]{};
+	};
+
+public:
+	constexpr static_wait_free_queue() noexcept = default;
+
+	~static_wait_free_queue()
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+		{
+			int64_t enqueue_pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+			for (int64_t pos = this->m_dequeue_pos.load(std::memory_order_relaxed); pos < enqueue_pos; pos++)
+			{
+				int64_t index = pos & MASK;
+				slot& s = this->m_slots[index];
+				if (s.sequence.load(std::memory_order_relaxed) + index == pos + 1)
+				{
+					std::launder(reinterpret_cast<T*>(s.storage))->~T();
+				}
+			}
+		}
+	}
+
+	static_wait_free_queue(const static_wait_free_queue&) = delete;
+	static_wait_free_queue& operator=(const static_wait_free_queue&) = delete;
+
+	static constexpr size_t capacity() noexcept
+	{
+		return N;
+	}
+
+	bool try_enqueue(const T& value)
+	{
+		return emplace(value);
+	}
+
+	bool try_enqueue(T&& value)
+	{
+		return emplace(std::move(value));
+	}
+
+	template<typename ...TArgs>
+	bool try_emplace(TArgs&&... args)
+	{
+		return emplace(std::forward<TArgs>(args)...);
+	}
+
+	bool try_dequeue(T& elem)
+	{
+		int64_t pos = this->m_dequeue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			int64_t index = pos & MASK;
+			slot& s = this->m_slots[index];
+			int64_t diff = s.sequence.load(std::memory_order_acquire) + index - (pos + 1);
+
+			if (diff == 0)
+			{
+				if (this->m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					T* value = std::launder(reinterpret_cast<T*>(s.storage));
+					elem = std::move(*value);
+					value->~T();
+					s.sequence.store(pos + CAPACITY - index, std::memory_order_release);
+
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = this->m_dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	//a snapshot, exact only while no other thread is using the queue
+	size_t size() const noexcept
+	{
+		int64_t dequeue_pos = this->m_dequeue_pos.load(std::memory_order_relaxed);
+		int64_t enqueue_pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+		int64_t ret = enqueue_pos - dequeue_pos;
+
+		return static_cast<size_t>(ret < 0 ? 0 : (ret > CAPACITY ? CAPACITY : ret));
+	}
+
+	bool empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+private:
+	alignas(64) std::atomic<int64_t>		m_enqueue_pos{ 0 };
+	alignas(64) std::atomic<int64_t>		m_dequeue_pos{ 0 };
+	alignas(64) slot						m_slots[N]{};
+
+	template<typename ...TArgs>
+	bool emplace(TArgs&&... args)
+	{
+		int64_t pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			int64_t index = pos & MASK;
+			slot& s = this->m_slots[index];
+			int64_t diff = s.sequence.load(std::memory_order_acquire) + index - pos;
+
+			if (diff == 0)
+			{
+				if (this->m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					new (s.storage) T(std::forward<TArgs>(args)...);
+					s.sequence.store(pos + 1 - index, std::memory_order_release);
+
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = this->m_enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+//compile with WAIT_FREE_ENABLE_STATS=1 to count contention inside the containers
+//disabled, every hook is an empty inline function and the policy is an empty class
+#ifndef WAIT_FREE_ENABLE_STATS
+#define WAIT_FREE_ENABLE_STATS 0
+#endif
+
+//small sequential id per thread, used to pick the counter shard a thread writes to
+inline int64_t wait_free_thread_index() noexcept
+{
+	static std::atomic<int64_t> next_index(0);
+	static thread_local int64_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+
+	return index;
+}
+
+enum class wait_free_stat : int32_t
+{
+	cas_failure = 0,
+	yield,
+	resize,
+	resize_stall_ns,
+	spin_wait,
+	count
+};
+
+struct wait_free_stats_snapshot
+{
+	int64_t		cas_failures{ 0 };
+	int64_t		yields{ 0 };
+	int64_t		resize_count{ 0 };
+	int64_t		resize_stall_ns{ 0 };
+	int64_t		spin_waits{ 0 };
+
+	wait_free_stats_snapshot& operator+=(const wait_free_stats_snapshot& rhd) noexcept
+	{
+		this->cas_failures += rhd.cas_failures;
+		this->yields += rhd.yields;
+		this->resize_count += rhd.resize_count;
+		this->resize_stall_ns += rhd.resize_stall_ns;
+		this->spin_waits += rhd.spin_waits;
+
+		return *this;
+	}
+};
+
+template<bool enabled>
+class wait_free_stats_policy;
+
+template<>
+class wait_free_stats_policy<false>
+{
+public:
+	class stall_timer
+	{
+	public:
+		explicit stall_timer(const wait_free_stats_policy&) noexcept
+		{
+		}
+	};
+
+	void add(wait_free_stat, int64_t = 1) const noexcept
+	{
+	}
+
+	bool count_cas(bool exchanged) const noexcept
+	{
+		return exchanged;
+	}
+
+	wait_free_stats_snapshot snapshot() const noexcept
+	{
+		return {};
+	}
+
+	void reset() noexcept
+	{
+	}
+};
+
+//one cache line of counters per thread shard, threads beyond SHARD_COUNT share shards, reads sum every shard
+template<>
+class wait_free_stats_policy<true>
+{
+	static const int64_t SHARD_COUNT = 64;
+	static const int32_t COUNTER_COUNT = static_cast<int32_t>(wait_free_stat::count);
+
+	struct alignas(64) shard
+	{
+		std::atomic<int64_t> counters[COUNTER_COUNT];
+	};
+
+public:
+	//measures how long a stop-the-world section held the other threads off
+	class stall_timer
+	{
+	public:
+		explicit stall_timer(const wait_free_stats_policy& stats) noexcept :
+			m_stats(stats),
+			m_start(std::chrono::steady_clock::now())
+		{
+		}
+
+		~stall_timer()
+		{
+			auto elapsed = std::chrono::steady_clock::now() - this->m_start;
+			this->m_stats.add(wait_free_stat::resize_stall_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		}
+
+	private:
+		const wait_free_stats_policy&			m_stats;
+		std::chrono::steady_clock::time_point	m_start;
+	};
+
+	wait_free_stats_policy() noexcept
+	{
+		reset();
+	}
+
+	void add(wait_free_stat stat, int64_t value = 1) const noexcept
+	{
+		this->m_shards[thread_shard()].counters[static_cast<int32_t>(stat)].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	//pass a compare_exchange result through, counting the failures
+	bool count_cas(bool exchanged) const noexcept
+	{
+		if (!exchanged)
+		{
+			add(wait_free_stat::cas_failure);
+		}
+
+		return exchanged;
+	}
+
+	wait_free_stats_snapshot snapshot() const noexcept
+	{
+		int64_t total[COUNTER_COUNT] = {};
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			for (int32_t j = 0; j < COUNTER_COUNT; j++)
+			{
+				total[j] += this->m_shards[i].counters[j].load(std::memory_order_relaxed);
+			}
+		}
+
+		wait_free_stats_snapshot ret;
+		ret.cas_failures = total[static_cast<int32_t>(wait_free_stat::cas_failure)];
+		ret.yields = total[static_cast<int32_t>(wait_free_stat::yield)];
+		ret.resize_count = total[static_cast<int32_t>(wait_free_stat::resize)];
+		ret.resize_stall_ns = total[static_cast<int32_t>(wait_free_stat::resize_stall_ns)];
+		ret.spin_waits = total[static_cast<int32_t>(wait_free_stat::spin_wait)];
+
+		return ret;
+	}
+
+	void reset() noexcept
+	{
+		for (int64_t i = 0; i < SHARD_COUNT; i++)
+		{
+			for (int32_t j = 0; j < COUNTER_COUNT; j++)
+			{
+				this->m_shards[i].counters[j].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	mutable shard m_shards[SHARD_COUNT];
+
+	static int64_t thread_shard() noexcept
+	{
+		return wait_free_thread_index() % SHARD_COUNT;
+	}
+};
+
+using wait_free_stats = wait_free_stats_policy<WAIT_FREE_ENABLE_STATS != 0>;
+
+//containers inherit m_stats from here instead of holding a member, disabled it is a static of an empty base
+//so it takes no storage in the container
+template<bool enabled>
+class wait_free_stats_base_policy;
+
+template<>
+class wait_free_stats_base_policy<false>
+{
+protected:
+	static constexpr wait_free_stats_policy<false> m_stats{};
+};
+
+template<>
+class wait_free_stats_base_policy<true>
+{
+protected:
+	wait_free_stats_policy<true> m_stats;
+};
+
+using wait_free_stats_base = wait_free_stats_base_policy<WAIT_FREE_ENABLE_STATS != 0>;
+
+template<typename T>
+struct is_wait_free_stats : std::false_type
+{
+};
+
+template<bool enabled>
+struct is_wait_free_stats<wait_free_stats_policy<enabled>> : std::true_type
+{
+};
+
+template<typename T>
+constexpr bool is_wait_free_stats_v = is_wait_free_stats<std::decay_t<T>>::value;
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "wait_free_latency.hpp"
+#include "wait_free_stats.hpp"
+
+//operation trace of queue/vector/pool calls for offline replay against other container configurations
+//file layout, little endian:
+//	header		"WFTRACE\0", uint32 version, uint32 container count, uint64 record count
+//	containers	uint32 kind, uint32 name length, name bytes, per container
+//	records		wait_free_trace_record, sorted by timestamp
+
+enum class wait_free_trace_kind : uint32_t
+{
+	queue = 0,
+	vector,
+	pool
+};
+
+struct wait_free_trace_record
+{
+	int64_t		timestamp_ns;
+	int32_t		container;
+	int32_t		thread;
+	int32_t		op;
+	int32_t		batch;
+};
+
+struct wait_free_trace_container
+{
+	wait_free_trace_kind	kind;
+	std::string				name;
+};
+
+struct wait_free_trace
+{
+	std::vector<wait_free_trace_container>	containers;
+	std::vector<wait_free_trace_record>		records;
+
+	static constexpr char MAGIC[8] = { 'W', 'F', 'T', 'R', 'A', 'C', 'E', '\0' };
+	static const uint32_t VERSION = 1;
+	//a replay starts one thread per recorded thread id, ids are renumbered from 0 when the trace is taken
+	static constexpr int32_t MAX_THREADS = 1024;
+	static constexpr int32_t MAX_BATCH = 1 << 20;
+
+	bool save(const std::string& path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		if (!out)
+		{
+			return false;
+		}
+
+		uint32_t version(VERSION);
+		uint32_t container_count(static_cast<uint32_t>(this->containers.size()));
+		uint64_t record_count(this->records.size());
+		out.write(MAGIC, sizeof(MAGIC));
+		out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		out.write(reinterpret_cast<const char*>(&container_count), sizeof(container_count));
+		out.write(reinterpret_cast<const char*>(&record_count), sizeof(record_count));
+
+		for (auto& container : this->containers)
+		{
+			uint32_t kind(static_cast<uint32_t>(container.kind));
+			uint32_t length(static_cast<uint32_t>(container.name.size()));
+			out.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+			out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			out.write(container.name.data(), length);
+		}
+
+		out.write(reinterpret_cast<const char*>(this->records.data()), this->records.size() * sizeof(wait_free_trace_record));
+
+		return static_cast<bool>(out);
+	}
+
+	//counts and lengths are checked against the bytes left in the file before anything is allocated for them,
+	//a container kind, or a record's container, op, thread or batch out of range rejects the file
+	bool load(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in)
+		{
+			return false;
+		}
+
+		const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+		in.seekg(0);
+		auto remaining = [&]() -> uint64_t
+		{
+			return file_size - static_cast<uint64_t>(in.tellg());
+		};
+
+		char magic[sizeof(MAGIC)] = {};
+		uint32_t version(0);
+		uint32_t container_count(0);
+		uint64_t record_count(0);
+
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char*>(&version), sizeof(version));
+		in.read(reinterpret_cast<char*>(&container_count), sizeof(container_count));
+		in.read(reinterpret_cast<char*>(&record_count), sizeof(record_count));
+		if (!in || ::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION)
+		{
+			return false;
+		}
+
+		if (container_count > remaining() / (2 * sizeof(uint32_t)))
+		{
+			return false;
+		}
+
+		this->containers.resize(container_count);
+		for (auto& container : this->containers)
+		{
+			uint32_t kind(0);
+			uint32_t length(0);
+			in.read(reinterpret_cast<char*>(&kind), sizeof(kind));
+			in.read(reinterpret_cast<char*>(&length), sizeof(length));
+			if (!in || length > remaining())
+			{
+				return false;
+			}
+
+			if (kind > static_cast<uint32_t>(wait_free_trace_kind::pool))
+			{
+				return false;
+			}
+
+			container.kind = static_cast<wait_free_trace_kind>(kind);
+			container.name.resize(length);
+			in.read(&container.name[0], length);
+		}
+
+		if (!in || record_count > remaining() / sizeof(wait_free_trace_record))
+		{
+			return false;
+		}
+
+		this->records.resize(record_count);
+		in.read(reinterpret_cast<char*>(this->records.data()), record_count * sizeof(wait_free_trace_record));
+		if (!in)
+		{
+			return false;
+		}
+
+		for (auto& r : this->records)
+		{
+			if (r.container < 0 || static_cast<uint32_t>(r.container) >= container_count ||
+				r.op < 0 || r.op >= static_cast<int32_t>(wait_free_op::count) ||
+				r.thread < 0 || r.thread >= MAX_THREADS ||
+				r.batch < 0 || r.batch > MAX_BATCH)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+//appends are one fetch_add into the calling thread's shard, shards grow by pushing a new chunk in front
+//take() expects the traced threads to be quiescent, records still being written may be missing or torn
+class wait_free_trace_recorder
+{
+	static const int64_t SHARD_COUNT = 64;
+	static constexpr int64_t CHUNK_SIZE = 4096;
+
+	struct chunk
+	{
+		wait_free_trace_record		records[CHUNK_SIZE];
+		std::atomic<int64_t>		cursor{ 0 };
+		chunk*						next{ nullptr };
+	};
+
+public:
+	wait_free_trace_recorder() :
+		m_start(std::chrono::steady_clock::now()),
+		m_enabled(true)
+	{
+		for (auto& shard : this->m_shards)
+		{
+			shard.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	~wait_free_trace_recorder()
+	{
+		clear();
+	}
+
+	wait_free_trace_recorder(const wait_free_trace_recorder&) = delete;
+	wait_free_trace_recorder& operator=(const wait_free_trace_recorder&) = delete;
+
+	//setup time only, the traced wrappers call it from their constructors
+	int32_t register_container(wait_free_trace_kind kind, const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(this->m_containers_mutex);
+		this->m_containers.push_back({ kind, name });
+
+		return static_cast<int32_t>(this->m_containers.size() - 1);
+	}
+
+	void set_enabled(bool enabled) noexcept
+	{
+		this->m_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	void record(int32_t container, wait_free_op op, int64_t batch = 1) noexcept
+	{
+		if (!this->m_enabled.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		int64_t thread = wait_free_thread_index();
+		std::atomic<chunk*>& shard = this->m_shards[thread % SHARD_COUNT];
+		chunk* c = shard.load(std::memory_order_acquire);
+
+		while (true)
+		{
+			if (c != nullptr)
+			{
+				int64_t pos = c->cursor.fetch_add(1, std::memory_order_relaxed);
+				if (pos < CHUNK_SIZE)
+				{
+					wait_free_trace_record& r = c->records[pos];
+					r.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->m_start).count();
+					r.container = container;
+					r.thread = static_cast<int32_t>(thread);
+					r.op = static_cast<int32_t>(op);
+					r.batch = static_cast<int32_t>(batch);
+					return;
+				}
+			}
+
+			chunk* new_chunk = new (std::nothrow) chunk();
+			if (new_chunk == nullptr)
+			{
+				return;
+			}
+
+			new_chunk->next = c;
+			if (!shard.compare_exchange_strong(c, new_chunk, std::memory_order_acq_rel))
+			{
+				delete new_chunk;
+			}
+			else
+			{
+				c = new_chunk;
+			}
+		}
+	}
+
+	//merges every shard in timestamp order, thread ids are renumbered from 0 in order of first appearance
+	wait_free_trace take() const
+	{
+		wait_free_trace ret;
+		{
+			std::lock_guard<std::mutex> lock(this->m_containers_mutex);
+			ret.containers = this->m_containers;
+		}
+
+		for (auto& shard : this->m_shards)
+		{
+			for (chunk* c = shard.load(std::memory_order_acquire); c != nullptr; c = c->next)
+			{
+				int64_t count = (std::min)(c->cursor.load(std::memory_order_acquire), CHUNK_SIZE);
+				ret.records.insert(ret.records.end(), c->records, c->records + count);
+			}
+		}
+
+		std::stable_sort(ret.records.begin(), ret.records.end(), [](const wait_free_trace_record& a, const wait_free_trace_record& b)
+		{
+			return a.timestamp_ns < b.timestamp_ns;
+		});
+
+		std::vector<std::pair<int32_t, int32_t>> threads;
+		for (auto& r : ret.records)
+		{
+			auto it = std::find_if(threads.begin(), threads.end(), [&](const std::pair<int32_t, int32_t>& t) { return t.first == r.thread; });
+			if (it == threads.end())
+			{
+				threads.emplace_back(r.thread, static_cast<int32_t>(threads.size()));
+				r.thread = threads.back().second;
+			}
+			else
+			{
+				r.thread = it->second;
+			}
+		}
+
+		return ret;
+	}
+
+	bool save(const std::string& path) const
+	{
+		return take().save(path);
+	}
+
+	void clear() noexcept
+	{
+		for (auto& shard : this->m_shards)
+		{
+			chunk* c = shard.exchange(nullptr, std::memory_order_acq_rel);
+			while (c != nullptr)
+			{
+				chunk* next = c->next;
+				delete c;
+				c = next;
+			}
+		}
+	}
+
+private:
+	std::atomic<chunk*>							m_shards[SHARD_COUNT];
+	std::chrono::steady_clock::time_point		m_start;
+	std::atomic<bool>							m_enabled;
+	mutable std::mutex							m_containers_mutex;
+	std::vector<wait_free_trace_container>		m_containers;
+};
+
+//recording wrappers, every call is forwarded to the wrapped container after it is logged
+
+template<typename TQueue>
+class traced_queue
+{
+public:
+	template<typename ...TArgs>
+	traced_queue(wait_free_trace_recorder& recorder, const std::string& name, TArgs&&... args) :
+		m_queue(std::forward<TArgs>(args)...),
+		m_recorder(recorder),
+		m_id(recorder.register_container(wait_free_trace_kind::queue, name))
+	{
+	}
+
+	template<typename T>
+	int64_t enqueue(const T& value)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::enqueue);
+		return this->m_queue.enqueue(value);
+	}
+
+	template<typename TIterator>
+	int64_t enqueue_range(TIterator it_start, const TIterator& it_end)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::enqueue, it_end - it_start);
+		return this->m_queue.enqueue_range(it_start, it_end);
+	}
+
+	template<typename T>
+	int64_t dequeue(T& elem)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::dequeue);
+		return this->m_queue.dequeue(elem);
+	}
+
+	//wait_free_queue advances it_start to the end of what it took, generic_queue takes it by value
+	template<typename TIterator>
+	int64_t dequeue_range(TIterator& it_start, const TIterator& it_end)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::dequeue, it_end - it_start);
+		return this->m_queue.dequeue_range(it_start, it_end);
+	}
+
+	size_t size() const noexcept
+	{
+		return this->m_queue.size();
+	}
+
+	TQueue& get() noexcept
+	{
+		return this->m_queue;
+	}
+
+private:
+	TQueue						m_queue;
+	wait_free_trace_recorder&	m_recorder;
+	int32_t						m_id;
+};
+
+template<typename TVector>
+class traced_vector
+{
+public:
+	template<typename ...TArgs>
+	traced_vector(wait_free_trace_recorder& recorder, const std::string& name, TArgs&&... args) :
+		m_vector(std::forward<TArgs>(args)...),
+		m_recorder(recorder),
+		m_id(recorder.register_container(wait_free_trace_kind::vector, name))
+	{
+	}
+
+	template<typename T>
+	void push_back(const T& value)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::push_back);
+		this->m_vector.push_back(value);
+	}
+
+	template<typename T>
+	bool get(int64_t index, T& elem)
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::get);
+		return this->m_vector.get(index, elem);
+	}
+
+	size_t size() const noexcept
+	{
+		return this->m_vector.size();
+	}
+
+	TVector& get() noexcept
+	{
+		return this->m_vector;
+	}
+
+private:
+	TVector						m_vector;
+	wait_free_trace_recorder&	m_recorder;
+	int32_t						m_id;
+};
+
+template<typename TPool>
+class traced_pool
+{
+public:
+	using iterator = typename TPool::iterator;
+
+	template<typename ...TArgs>
+	traced_pool(wait_free_trace_recorder& recorder, const std::string& name, TArgs&&... args) :
+		m_pool(std::forward<TArgs>(args)...),
+		m_recorder(recorder),
+		m_id(recorder.register_container(wait_free_trace_kind::pool, name))
+	{
+	}
+
+	iterator allocate()
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::allocate);
+		return this->m_pool.allocate();
+	}
+
+	bool deallocate(const iterator& it) noexcept
+	{
+		this->m_recorder.record(this->m_id, wait_free_op::deallocate);
+		return this->m_pool.deallocate(it);
+	}
+
+	TPool& get() noexcept
+	{
+		return this->m_pool;
+	}
+
+private:
+	TPool						m_pool;
+	wait_free_trace_recorder&	m_recorder;
+	int32_t						m_id;
+};
@@ -4,31 +4,39 @@
 
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <stdint.h>
 #include <type_traits>
 
 #include "template_util.hpp"
+#include "wait_free_atomic.hpp"
+#include "wait_free_latency.hpp"
+#include "wait_free_memory.hpp"
+#include "wait_free_pages.hpp"
 
 //simple tested
 template<typename T, template<typename U> typename TAllocator = std::allocator>
-class wait_free_vector 
+class wait_free_vector : private wait_free_stats_base
 {
+    static_assert(wait_free_atomic_lock_free_v<T>, "wait_free_vector element is not lock free as an atomic, define WAIT_FREE_ALLOW_LOCKING_ATOMICS=1 to accept a locking slot");
+
 public:
-    explicit wait_free_vector(const T& free_value, int64_t capacity = 10, const TAllocator<std::atomic<T>>& allocator = TAllocator<std::atomic<T>>()) :
+    explicit wait_free_vector(const T& free_value, int64_t capacity = 10, const TAllocator<wait_free_atomic<T>>& allocator = TAllocator<wait_free_atomic<T>>()) :
         m_data(nullptr),
         m_allocator(allocator),
         m_free_value(free_value),
         m_size(0),
         m_capacity(0),
         m_elem_operating(0),
-        m_buffer_operating(0)
+        m_buffer_operating(0),
+        m_growth_count(0)
     {
         assert(capacity > 0);
 
         this->m_data = this->m_allocator.allocate(capacity);
         assert(m_data);
         std::for_each(this->m_data, this->m_data + capacity,
-            [=](std::atomic<T> &elem)
+            [this](wait_free_atomic<T> &elem)
         {
             elem.store(this->m_free_value);
         });
@@ -38,7 +46,9 @@ public:
 
     ~wait_free_vector() 
     {
-        mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+        this->m_registration.remove();
+
+        mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
         this->m_allocator.deallocate(this->m_data, this->m_capacity);
         this->m_data = nullptr;
@@ -50,6 +60,8 @@ public:
 
     void push_back(const T& value) 
     {
+        wait_free_latency::scope latency_scope(this->m_latency, wait_free_op::push_back);
+
         assert(value != this->m_free_value);
 
         int64_t old_size(0);
@@ -58,14 +70,15 @@ public:
 
         while (true)
         {
-            mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+            mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
             old_size = this->m_size;
             new_size = (std::min)(old_size + 1, static_cast<int64_t>(this->m_capacity));
-            if (old_size >= new_size || !this->m_size.compare_exchange_strong(old_size, new_size))
+            if (old_size >= new_size || !this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)))
             {
                 this->m_elem_operating--;
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::yield);
             }
             else
             {
@@ -74,12 +87,16 @@ public:
         }
 
         assert(new_size > old_size);
+        this->m_peak_size.update(new_size);
         assert(old_size >= 0);
 
+        wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
         while (!this->m_data[old_size].compare_exchange_strong(free_value, value))
         {
             free_value = this->m_free_value;
+            spin.tick();
             std::this_thread::yield();
+            this->m_stats.add(wait_free_stat::spin_wait);
         } 
 
         this->m_elem_operating--;
@@ -97,14 +114,14 @@ public:
         T old_elem{};
         T free_value{ this->m_free_value };
 
-        mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+        mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
         do
         {
             old_size = this->m_size;
             if (index < old_size)
             {
-                new_size = (std::max)(old_size - 1, 0ll);
+                new_size = (std::max)(old_size - 1, static_cast<int64_t>(0));
             }
             else
             {
@@ -112,8 +129,9 @@ public:
                 return false;
             }
         } 
-        while (!this->m_size.compare_exchange_strong(old_size, new_size));
+        while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
+        wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
         while (true)
         {
             old_elem = this->m_data[index];
@@ -124,12 +142,15 @@ public:
             }
             else 
             {
+                spin.tick();
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::spin_wait);
             }
         }
 
         if (index != old_size - 1)
         {
+            wait_free_events::wait last_spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
             while (true)
             {
                 old_elem = this->m_data[old_size - 1];
@@ -139,14 +160,19 @@ public:
                 }
                 else
                 {
+                    last_spin.tick();
                     std::this_thread::yield();
+                    this->m_stats.add(wait_free_stat::spin_wait);
                 }
             }
 
+            wait_free_events::wait move_spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
             while (!this->m_data[index].compare_exchange_strong(free_value, old_elem))
             {
                 free_value = this->m_free_value;
+                move_spin.tick();
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::spin_wait);
             }
         }
 
@@ -162,22 +188,23 @@ public:
         T old_elem{};
         T free_value{ this->m_free_value };
 
-        mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+        mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
         do
         {
             old_size = this->m_size;
             if (index < old_size)
             {
-                new_size = (std::max)(old_size - 1, 0ll);
+                new_size = (std::max)(old_size - 1, static_cast<int64_t>(0));
             }
             else
             {
                 this->m_elem_operating--;
                 return false;
             }
-        } while (!this->m_size.compare_exchange_strong(old_size, new_size));
+        } while (!this->m_stats.count_cas(this->m_size.compare_exchange_strong(old_size, new_size)));
 
+        wait_free_events::wait spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
         while (true)
         {
             old_elem = this->m_data[index];
@@ -189,12 +216,15 @@ public:
             }
             else
             {
+                spin.tick();
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::spin_wait);
             }
         }
 
         if (index != old_size - 1)
         {
+            wait_free_events::wait last_spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
             while (true)
             {
                 old_elem = this->m_data[old_size - 1];
@@ -204,14 +234,19 @@ public:
                 }
                 else
                 {
+                    last_spin.tick();
                     std::this_thread::yield();
+                    this->m_stats.add(wait_free_stat::spin_wait);
                 }
             }
 
+            wait_free_events::wait move_spin(wait_free_event::slot_spin, this, WAIT_FREE_EVENT_SPIN_NS);
             while (!this->m_data[index].compare_exchange_strong(free_value, old_elem))
             {
                 free_value = this->m_free_value;
+                move_spin.tick();
                 std::this_thread::yield();
+                this->m_stats.add(wait_free_stat::spin_wait);
             }
         }
 
@@ -227,18 +262,21 @@ public:
             increase_capacity(new_size);
         }
 
-        mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+        mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
         this->m_size = new_size;
+        this->m_peak_size.update(new_size);
         this->m_buffer_operating = false;
     }
 
     bool get(int64_t index, T& elem) 
     {
+        wait_free_latency::scope latency_scope(this->m_latency, wait_free_op::get);
+
         assert(index >= 0);
 
         T old_elem{};
 
-        mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+        mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
 
         do
         {
@@ -265,7 +303,7 @@ public:
         T old_elem{};
         bool ret{ false };
 
-        mutex_check_weak(this->m_elem_operating, this->m_buffer_operating);
+        mutex_check_weak(this->m_stats, this->m_elem_operating, this->m_buffer_operating);
         
         ret = index < this->m_size;
        
@@ -279,30 +317,81 @@ public:
         return this->m_size;
     }
 
+    //grows to capacity and prepares the pages up front, so neither a resize nor first touch faults land on the hot path
+    //meant for startup, before other threads use the vector, false when a requested lock failed
+    bool reserve(int64_t capacity, const wait_free_reserve_options& options = wait_free_reserve_options())
+    {
+        wait_free_set_reserve_options(this->m_allocator, options);
+        if (capacity > this->m_capacity)
+        {
+            increase_capacity(capacity);
+        }
+
+        return wait_free_prepare_storage(this->m_allocator, this->m_data, this->m_capacity * sizeof(wait_free_atomic<T>), options);
+    }
+
+    wait_free_memory_usage memory_usage() const noexcept
+    {
+        const int64_t slot_size = static_cast<int64_t>(sizeof(wait_free_atomic<T>));
+
+        wait_free_memory_usage ret;
+        ret.reserved_bytes = this->m_capacity * slot_size;
+        ret.live_bytes = this->m_size * slot_size;
+        ret.peak_live_bytes = this->m_peak_size.get() * slot_size;
+        ret.growth_count = this->m_growth_count;
+
+        return ret;
+    }
+
+    wait_free_stats_snapshot stats() const noexcept
+    {
+        return this->m_stats.snapshot();
+    }
+
+    //merge of every thread's samples for op, summary() gives p50/p99/p999/max in ns
+    wait_free_latency_histogram latency(wait_free_op op) const
+    {
+        return this->m_latency.histogram(op);
+    }
+
+    void set_latency_sample_rate(int64_t every_n) noexcept
+    {
+        this->m_latency.set_sample_rate(every_n);
+    }
+
 private:
 
-    std::atomic<T>*					m_data;
-    TAllocator<std::atomic<T>>		m_allocator;
+    wait_free_atomic<T>*					m_data;
+    TAllocator<wait_free_atomic<T>>		m_allocator;
     const T                         m_free_value;
     std::atomic<int64_t>            m_size;
     std::atomic<int64_t>            m_capacity;
     mutable std::atomic<int64_t>	m_elem_operating;
     mutable std::atomic<int64_t>	m_buffer_operating;
+    std::atomic<int64_t>            m_growth_count;
+    wait_free_latency               m_latency;
+    wait_free_high_water            m_peak_size;
+    wait_free_registration          m_registration{ this, "wait_free_vector" };
 
     void increase_capacity(int64_t new_capacity) 
     {
-        mutex_check_cas_lock_strong(this->m_buffer_operating, this->m_elem_operating);
+        mutex_check_cas_lock_strong(this->m_stats, this->m_buffer_operating, this->m_elem_operating);
 
         if (new_capacity <= this->m_capacity)
         {
             this->m_buffer_operating = false;
             return;
         }
+
+        wait_free_stats::stall_timer stall_timer(this->m_stats);
+        wait_free_events::scope capacity_event(wait_free_event::capacity_change, this);
+        this->m_stats.add(wait_free_stat::resize);
+        this->m_growth_count++;
         
-        std::atomic<T>* new_data = m_allocator.allocate(new_capacity);
+        wait_free_atomic<T>* new_data = m_allocator.allocate(new_capacity);
         assert(new_data);
         std::for_each(new_data, new_data + new_capacity, 
-        [=](std::atomic<T>& elem) 
+        [this](wait_free_atomic<T>& elem) 
         {
             elem.store(this->m_free_value);
         });